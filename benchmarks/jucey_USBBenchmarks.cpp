@@ -0,0 +1,432 @@
+//==============================================================================
+/** A fixed number of timings in microseconds.
+
+    Adding a timing never allocates or locks, so one thread, including a
+    real-time callback, can record while another reads the result afterwards.
+ */
+class LibUsbBenchmarkSamples
+{
+public:
+    explicit LibUsbBenchmarkSamples (int maxNumSamples)
+        : samples ((size_t) juce::jmax (1, maxNumSamples))
+        , capacity (juce::jmax (1, maxNumSamples))
+    {
+    }
+
+    void add (double microseconds) noexcept
+    {
+        const auto index {numSamples.load (std::memory_order_relaxed)};
+
+        if (index < capacity)
+        {
+            samples[index] = microseconds;
+            numSamples.store (index + 1, std::memory_order_release);
+        }
+    }
+
+    USBBenchmarks::Result getResult (const juce::String& name, double bytesPerSecond = 0.0) const
+    {
+        USBBenchmarks::Result result {};
+        result.name = name;
+        result.numSamples = numSamples.load (std::memory_order_acquire);
+        result.bytesPerSecond = bytesPerSecond;
+
+        if (result.numSamples == 0)
+            return result;
+
+        juce::Array<double> sorted {samples.getData(), result.numSamples};
+        std::sort (sorted.begin(), sorted.end());
+
+        const auto getPercentile = [&sorted] (double fraction)
+        {
+            const auto index {(int) std::ceil (fraction * sorted.size()) - 1};
+            return sorted[juce::jlimit (0, sorted.size() - 1, index)];
+        };
+
+        result.mean = std::accumulate (sorted.begin(), sorted.end(), 0.0) / sorted.size();
+        result.p50 = getPercentile (0.5);
+        result.p90 = getPercentile (0.9);
+        result.p99 = getPercentile (0.99);
+        result.max = sorted.getLast();
+        return result;
+    }
+
+private:
+    juce::HeapBlock<double> samples;
+    const int capacity;
+    std::atomic<int> numSamples {0};
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (LibUsbBenchmarkSamples)
+};
+
+//==============================================================================
+class LibUsbBenchmarkRunner : private USBDeviceManager::Listener
+{
+public:
+    explicit LibUsbBenchmarkRunner (const USBBenchmarks::Options& optionsToUse) noexcept
+        : options (optionsToUse)
+    {
+    }
+
+    juce::Array<USBBenchmarks::Result> run()
+    {
+        measureStartup();
+        measureHotplug();
+        measureGetDevices();
+        measureStreams();
+
+        return results;
+    }
+
+private:
+    static constexpr int bulkEndpoint {0x81};
+    static constexpr int interruptEndpoint {0x82};
+    static constexpr int isochronousEndpoint {0x83};
+    static constexpr double bulkBytesPerSecond {40.0e6};
+    static constexpr int interruptReportSize {64};
+    static constexpr double interruptBytesPerSecond {interruptReportSize * 8000.0};
+    static constexpr double isochronousPacketsPerSecond {8000.0};
+
+    //==============================================================================
+    static double ticksToMicroseconds (juce::int64 ticks) noexcept
+    {
+        return juce::Time::highResolutionTicksToSeconds (ticks) * 1.0e6;
+    }
+
+    static USBSimulatedBus::DeviceSpec makeStreamingDeviceSpec()
+    {
+        using TransferType = USBDevice::Endpoint::TransferType;
+
+        auto spec {LibUsbSimulatedDevices::makeDeviceSpec (0)};
+        spec.endpoints.add ({bulkEndpoint, TransferType::bulk, 512, 0, 1, bulkBytesPerSecond});
+        spec.endpoints.add ({interruptEndpoint, TransferType::interrupt, interruptReportSize, 0, 1, interruptBytesPerSecond});
+        spec.endpoints.add ({isochronousEndpoint, TransferType::isochronous, 1024, 1, 1, 0.0});
+        return spec;
+    }
+
+    //==============================================================================
+    void measureStartup()
+    {
+        for (auto index {0}; index < options.numStartupDevices; ++index)
+            bus.addDevice (LibUsbSimulatedDevices::makeDeviceSpec (index));
+
+        const auto start {juce::Time::getHighResolutionTicks()};
+        manager = &USBDeviceManager::getInstance();
+
+        LibUsbBenchmarkSamples samples {1};
+        samples.add (ticksToMicroseconds (juce::Time::getHighResolutionTicks() - start));
+        results.add (samples.getResult ("manager startup with " + juce::String (options.numStartupDevices) + " devices"));
+
+        bus.removeAllDevices();
+    }
+
+    void measureHotplug()
+    {
+        LibUsbBenchmarkSamples arrivals {options.numHotplugIterations};
+        LibUsbBenchmarkSamples removals {options.numHotplugIterations};
+
+        manager->addListener (*this, false);
+
+        for (auto iteration {0}; iteration < options.numHotplugIterations; ++iteration)
+        {
+            const auto arrivalStart {juce::Time::getHighResolutionTicks()};
+            const auto deviceId {bus.addDevice (LibUsbSimulatedDevices::makeDeviceSpec (iteration))};
+
+            if ( ! deviceArrivedEvent.wait (1000))
+                break;
+
+            arrivals.add (ticksToMicroseconds (lastCallbackTicks - arrivalStart));
+
+            const auto removalStart {juce::Time::getHighResolutionTicks()};
+            bus.removeDevice (deviceId);
+
+            if ( ! deviceRemovedEvent.wait (1000))
+                break;
+
+            removals.add (ticksToMicroseconds (lastCallbackTicks - removalStart));
+        }
+
+        manager->removeListener (*this);
+        bus.removeAllDevices();
+
+        results.add (arrivals.getResult ("device plugged in to deviceArrived"));
+        results.add (removals.getResult ("device removed to deviceRemoved"));
+    }
+
+    void measureGetDevices()
+    {
+        auto deviceCounts {options.deviceCounts};
+        std::sort (deviceCounts.begin(), deviceCounts.end());
+
+        auto numDevices {0};
+
+        for (const auto deviceCount : deviceCounts)
+        {
+            while (numDevices < deviceCount)
+                bus.addDevice (LibUsbSimulatedDevices::makeDeviceSpec (numDevices++));
+
+            if ( ! bus.waitForNumDevices (numDevices))
+                break;
+
+            LibUsbBenchmarkSamples getDevicesSamples {options.numCallsPerDeviceCount};
+            LibUsbBenchmarkSamples getSnapshotSamples {options.numCallsPerDeviceCount};
+
+            for (auto call {0}; call < options.numCallsPerDeviceCount; ++call)
+            {
+                const auto start {juce::Time::getHighResolutionTicks()};
+                const auto devices {manager->getDevices()};
+                getDevicesSamples.add (ticksToMicroseconds (juce::Time::getHighResolutionTicks() - start));
+
+                juce::ignoreUnused (devices);
+            }
+
+            for (auto call {0}; call < options.numCallsPerDeviceCount; ++call)
+            {
+                const auto start {juce::Time::getHighResolutionTicks()};
+                const auto snapshot {manager->getSnapshot()};
+                getSnapshotSamples.add (ticksToMicroseconds (juce::Time::getHighResolutionTicks() - start));
+
+                juce::ignoreUnused (snapshot);
+            }
+
+            const auto suffix {" with " + juce::String (numDevices) + " devices"};
+            results.add (getDevicesSamples.getResult ("getDevices()" + suffix));
+            results.add (getSnapshotSamples.getResult ("getSnapshot()" + suffix));
+        }
+
+        bus.removeAllDevices();
+    }
+
+    void measureStreams()
+    {
+        bus.addDevice (makeStreamingDeviceSpec());
+
+        if (bus.waitForNumDevices (1))
+        {
+            const auto device {manager->getDevices().getFirst()};
+
+            measureEndpointStream (device, "bulk IN", bulkEndpoint, 64 * 1024, bulkBytesPerSecond);
+            measureInterruptStream (device);
+            measureIsochronousStream (device);
+        }
+
+        bus.removeAllDevices();
+    }
+
+    //==============================================================================
+    void measureEndpointStream (const USBDevice& device,
+                                const juce::String& name,
+                                int endpointAddress,
+                                int transferSize,
+                                double bytesPerSecond)
+    {
+        USBEndpointStream::Options streamOptions {};
+        streamOptions.endpointAddress = endpointAddress;
+        streamOptions.transferSize = transferSize;
+
+        try
+        {
+            USBEndpointStream stream {device, streamOptions};
+
+            // every transfer completes in full, so reading whole transfers
+            // keeps each read lined up with the time stamp at its start
+            const auto chunkSize {stream.getOptions().transferSize};
+            juce::HeapBlock<juce::uint8> chunk ((size_t) chunkSize);
+            LibUsbBenchmarkSamples latencies {(int) (2.0 * options.streamSeconds * bytesPerSecond / chunkSize) + 16};
+            juce::int64 numBytes {0};
+
+            const auto start {juce::Time::getHighResolutionTicks()};
+            const auto end {start + juce::Time::secondsToHighResolutionTicks (options.streamSeconds)};
+
+            while (juce::Time::getHighResolutionTicks() < end && stream.isRunning())
+            {
+                if ( ! stream.waitUntilReady (100))
+                    continue;
+
+                while (stream.getNumBytesAvailable() >= chunkSize)
+                {
+                    stream.read (chunk, chunkSize);
+
+                    juce::int64 completedAt {0};
+                    std::memcpy (&completedAt, chunk, sizeof (completedAt));
+                    latencies.add (ticksToMicroseconds (juce::Time::getHighResolutionTicks() - completedAt));
+
+                    numBytes += chunkSize;
+                }
+            }
+
+            const auto seconds {juce::Time::highResolutionTicksToSeconds (juce::Time::getHighResolutionTicks() - start)};
+            results.add (latencies.getResult (name + " completion to read()", (double) numBytes / seconds));
+        }
+        catch (const std::exception& e)
+        {
+            results.add (LibUsbBenchmarkSamples {0}.getResult (name + " failed: " + e.what()));
+        }
+    }
+
+    void measureInterruptStream (const USBDevice& device)
+    {
+        const juce::String name {"interrupt IN"};
+
+        USBInterruptStream::Options streamOptions {};
+        streamOptions.endpointAddress = interruptEndpoint;
+
+        try
+        {
+            USBInterruptStream stream {device, streamOptions};
+
+            const auto maxReportSize {stream.getOptions().maxReportSize};
+            juce::HeapBlock<juce::uint8> report ((size_t) maxReportSize);
+            LibUsbBenchmarkSamples latencies {(int) (2.0 * options.streamSeconds * interruptBytesPerSecond / interruptReportSize) + 16};
+            juce::int64 numBytes {0};
+
+            const auto start {juce::Time::getHighResolutionTicks()};
+            const auto end {start + juce::Time::secondsToHighResolutionTicks (options.streamSeconds)};
+
+            // reports are polled the way an audio callback would, without waiting
+            while (juce::Time::getHighResolutionTicks() < end && stream.isRunning())
+            {
+                const auto length {stream.readReport (report, maxReportSize)};
+
+                if (length < 0)
+                {
+                    juce::Thread::yield();
+                    continue;
+                }
+
+                if (length >= (int) sizeof (juce::int64))
+                {
+                    juce::int64 completedAt {0};
+                    std::memcpy (&completedAt, report, sizeof (completedAt));
+                    latencies.add (ticksToMicroseconds (juce::Time::getHighResolutionTicks() - completedAt));
+                }
+
+                numBytes += length;
+            }
+
+            const auto seconds {juce::Time::highResolutionTicksToSeconds (juce::Time::getHighResolutionTicks() - start)};
+            results.add (latencies.getResult (name + " completion to readReport()", (double) numBytes / seconds));
+        }
+        catch (const std::exception& e)
+        {
+            results.add (LibUsbBenchmarkSamples {0}.getResult (name + " failed: " + e.what()));
+        }
+    }
+
+    void measureIsochronousStream (const USBDevice& device)
+    {
+        struct Callback : public USBIsochronousStream::Callback
+        {
+            explicit Callback (int maxNumSamples)
+                : latencies (maxNumSamples)
+            {
+            }
+
+            void processPackets (USBIsochronousStream::Packet* packets, int numPackets) override
+            {
+                const auto now {juce::Time::getHighResolutionTicks()};
+
+                for (auto index {0}; index < numPackets; ++index)
+                {
+                    const auto& packet = packets[index];
+
+                    if (packet.status != USBIsochronousStream::Packet::Status::completed
+                        || packet.length < (int) sizeof (juce::int64))
+                    {
+                        continue;
+                    }
+
+                    juce::int64 completedAt {0};
+                    std::memcpy (&completedAt, packet.data, sizeof (completedAt));
+                    latencies.add (ticksToMicroseconds (now - completedAt));
+
+                    numBytes.fetch_add (packet.length, std::memory_order_relaxed);
+                }
+            }
+
+            LibUsbBenchmarkSamples latencies;
+            std::atomic<juce::int64> numBytes {0};
+        };
+
+        const juce::String name {"isochronous IN"};
+
+        USBIsochronousStream::Options streamOptions {};
+        streamOptions.endpointAddress = isochronousEndpoint;
+
+        Callback callback {(int) (2.0 * options.streamSeconds * isochronousPacketsPerSecond) + 16};
+
+        try
+        {
+            const auto start {juce::Time::getHighResolutionTicks()};
+
+            {
+                USBIsochronousStream stream {device, streamOptions, callback};
+                juce::Thread::sleep ((int) (options.streamSeconds * 1000.0));
+            }
+
+            const auto seconds {juce::Time::highResolutionTicksToSeconds (juce::Time::getHighResolutionTicks() - start)};
+            results.add (callback.latencies.getResult (name + " completion to processPackets()",
+                                                       (double) callback.numBytes.load() / seconds));
+        }
+        catch (const std::exception& e)
+        {
+            results.add (LibUsbBenchmarkSamples {0}.getResult (name + " failed: " + e.what()));
+        }
+    }
+
+    //==============================================================================
+    void deviceArrived (const USBDevice&) override
+    {
+        lastCallbackTicks = juce::Time::getHighResolutionTicks();
+        deviceArrivedEvent.signal();
+    }
+
+    void deviceRemoved (const USBDevice&) override
+    {
+        lastCallbackTicks = juce::Time::getHighResolutionTicks();
+        deviceRemovedEvent.signal();
+    }
+
+    //==============================================================================
+    const USBBenchmarks::Options options;
+    // installs the bus, so the manager is created after it
+    LibUsbSimulatedDevices bus;
+    USBDeviceManager* manager {nullptr};
+    juce::Array<USBBenchmarks::Result> results;
+
+    std::atomic<juce::int64> lastCallbackTicks {0};
+    juce::WaitableEvent deviceArrivedEvent;
+    juce::WaitableEvent deviceRemovedEvent;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (LibUsbBenchmarkRunner)
+};
+
+//==============================================================================
+juce::String USBBenchmarks::Result::toString() const
+{
+    auto text {name + ": " + juce::String (numSamples) + " samples"};
+
+    if (numSamples > 0)
+    {
+        text << ", mean " << juce::String (mean, 1)
+             << " us, p50 " << juce::String (p50, 1)
+             << " us, p90 " << juce::String (p90, 1)
+             << " us, p99 " << juce::String (p99, 1)
+             << " us, max " << juce::String (max, 1) << " us";
+    }
+
+    if (bytesPerSecond > 0.0)
+        text << ", " << juce::String (bytesPerSecond / 1.0e6, 2) << " MB/s";
+
+    return text;
+}
+
+juce::Array<USBBenchmarks::Result> USBBenchmarks::runAll()
+{
+    return runAll (Options());
+}
+
+juce::Array<USBBenchmarks::Result> USBBenchmarks::runAll (const Options& options)
+{
+    return LibUsbBenchmarkRunner {options}.run();
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+//==============================================================================
+/** Measures the module against the USBSimulatedBus, so changes to polling,
+    locking and streaming can be compared without any hardware.
+
+    The benchmarks install the simulated bus and create the USBDeviceManager,
+    so they have to run in a process that hasn't used the module yet, built
+    with JUCEY_LIBUSB_ENABLE_SIMULATION enabled. A console app only needs to
+    print the results:
+
+    @code
+    int main()
+    {
+        for (const auto& result : USBBenchmarks::runAll())
+            std::cout << result.toString() << std::endl;
+
+        return 0;
+    }
+    @endcode
+ */
+class USBBenchmarks
+{
+public:
+    struct Options
+    {
+        /** The number of devices plugged in before the manager starts. */
+        int numStartupDevices {16};
+
+        /** The number of times a device is plugged in and removed again. */
+        int numHotplugIterations {100};
+
+        /** The numbers of devices to time getDevices() and getSnapshot() with. */
+        juce::Array<int> deviceCounts {1, 16, 64, 256};
+
+        /** The number of calls timed for each device count. */
+        int numCallsPerDeviceCount {10000};
+
+        /** How long each stream runs for. */
+        double streamSeconds {2.0};
+    };
+
+    /** The outcome of one benchmark, times are in microseconds. */
+    struct Result
+    {
+        /** Returns the result as a single line of text. */
+        juce::String toString() const;
+
+        juce::String name;
+        int numSamples {0};
+        double mean {0.0};
+        double p50 {0.0};
+        double p90 {0.0};
+        double p99 {0.0};
+        double max {0.0};
+
+        /** The bytes moved per second, zero for anything that doesn't move data. */
+        double bytesPerSecond {0.0};
+    };
+
+    /** Runs every benchmark with the default options and returns the results.
+
+        The simulated bus is left installed afterwards, with no devices
+        plugged in.
+     */
+    static juce::Array<Result> runAll();
+
+    /** Runs every benchmark with the given options and returns the results. */
+    static juce::Array<Result> runAll (const Options& options);
+};
@@ -0,0 +1,568 @@
+
+//==============================================================================
+/** The layout of a capture ring file.
+
+    A page sized header is followed by fixed size slots, each holding one
+    record. Every field is in host byte order, as usbmon records are. A slot's
+    sequence number is cleared while the record is being written and set to
+    one more than the record's sequence once it's complete, so a reader can
+    tell a finished record from one that's being overwritten.
+ */
+struct LibUsbCaptureRing
+{
+    static constexpr juce::uint32 magic {0x6a757362};
+    static constexpr juce::uint32 version {1};
+    static constexpr size_t headerSize {4096};
+
+    struct Header
+    {
+        juce::uint32 magic {0};
+        juce::uint32 version {0};
+        juce::uint32 slotSize {0};
+        juce::uint32 maxPayloadBytes {0};
+        juce::uint64 numSlots {0};
+        std::atomic<juce::uint64> nextSequence {0};
+
+        // used to turn high resolution ticks into the time of day
+        juce::int64 startMicroseconds {0};
+        juce::int64 startTicks {0};
+        juce::int64 ticksPerSecond {0};
+    };
+
+    struct PcapRecordHeader
+    {
+        juce::uint32 seconds;
+        juce::uint32 microseconds;
+        juce::uint32 capturedLength;
+        juce::uint32 originalLength;
+    };
+
+    /** The header of a LINKTYPE_USB_LINUX_MMAPPED packet. */
+    struct UsbmonHeader
+    {
+        juce::uint64 id;
+        juce::uint8 eventType;
+        juce::uint8 transferType;
+        juce::uint8 endpoint;
+        juce::uint8 deviceAddress;
+        juce::uint16 busNumber;
+        char setupFlag;
+        char dataFlag;
+        juce::int64 seconds;
+        juce::int32 microseconds;
+        juce::int32 status;
+        juce::uint32 length;
+        juce::uint32 capturedLength;
+
+        union
+        {
+            juce::uint8 setup[8];
+
+            struct
+            {
+                juce::int32 errorCount;
+                juce::int32 numDescriptors;
+            } iso;
+        };
+
+        juce::int32 interval;
+        juce::int32 startFrame;
+        juce::uint32 transferFlags;
+        juce::uint32 numDescriptors;
+    };
+
+    static_assert (sizeof (UsbmonHeader) == 64, "usbmon headers are 64 bytes");
+
+    struct Slot
+    {
+        std::atomic<juce::uint64> sequence;
+        PcapRecordHeader record;
+        UsbmonHeader usbmon;
+
+        // followed by up to maxPayloadBytes of data
+        juce::uint8* getPayload() noexcept
+        {
+            return reinterpret_cast<juce::uint8*> (this + 1);
+        }
+    };
+
+    static constexpr juce::uint32 linkTypeUsbLinuxMmapped {220};
+
+    // the Linux error numbers usbmon reports, whatever platform this is
+    enum LinuxStatus
+    {
+        ok          = 0,
+        noEntry     = -2,
+        noDevice    = -19,
+        brokenPipe  = -32,
+        protocol    = -71,
+        overflow    = -75,
+        timedOut    = -110,
+        inProgress  = -115
+    };
+
+    static juce::uint32 getSlotSize (int maxPayloadBytes) noexcept
+    {
+        return (juce::uint32) ((sizeof (Slot) + (size_t) maxPayloadBytes + 7) & ~(size_t) 7);
+    }
+};
+
+//==============================================================================
+/** Writes records into a mapped ring file, from any number of threads at
+    once.
+ */
+class LibUsbCaptureWriter
+{
+public:
+    LibUsbCaptureWriter (void* mappedData, juce::uint64 numSlotsToUse, int maxPayloadBytesToKeep) noexcept
+        : data (static_cast<juce::uint8*> (mappedData))
+        , header (*new (mappedData) LibUsbCaptureRing::Header())
+        , numSlots (numSlotsToUse)
+        , slotSize (LibUsbCaptureRing::getSlotSize (maxPayloadBytesToKeep))
+        , maxPayloadBytes (maxPayloadBytesToKeep)
+    {
+        header.magic = LibUsbCaptureRing::magic;
+        header.version = LibUsbCaptureRing::version;
+        header.slotSize = slotSize;
+        header.maxPayloadBytes = (juce::uint32) maxPayloadBytes;
+        header.numSlots = numSlots;
+        header.startMicroseconds = juce::Time::currentTimeMillis() * 1000;
+        header.startTicks = juce::Time::getHighResolutionTicks();
+        header.ticksPerSecond = juce::Time::getHighResolutionTicksPerSecond();
+
+        // touching every slot now means no page is faulted in for the first
+        // time while a transfer is being captured
+        for (juce::uint64 index {0}; index < numSlots; ++index)
+            new (&getSlot (index).sequence) std::atomic<juce::uint64> (0);
+    }
+
+    /** Makes this the writer completed transfers are captured by, or stops
+        capturing if it's nullptr. Once this returns nothing is using the
+        previous writer.
+     */
+    static void setCurrent (LibUsbCaptureWriter* writer) noexcept
+    {
+        getCurrentPointer() = writer;
+
+        while (getNumThreadsWriting() > 0)
+            juce::Thread::yield();
+    }
+
+    static bool isCurrent (const LibUsbCaptureWriter* writer) noexcept
+    {
+        return getCurrentPointer() == writer;
+    }
+
+    static void capture (const libusb_transfer& transfer, juce::uint64 deviceKey, juce::int64 submitTicks) noexcept
+    {
+        if (getCurrentPointer().load (std::memory_order_relaxed) == nullptr)
+            return;
+
+        ++getNumThreadsWriting();
+
+        if (auto* writer = getCurrentPointer().load())
+            writer->write (transfer, deviceKey, submitTicks);
+
+        --getNumThreadsWriting();
+    }
+
+    juce::int64 getNumRecordsWritten() const noexcept
+    {
+        return (juce::int64) header.nextSequence.load (std::memory_order_relaxed);
+    }
+
+private:
+    static std::atomic<LibUsbCaptureWriter*>& getCurrentPointer() noexcept
+    {
+        static std::atomic<LibUsbCaptureWriter*> current {nullptr};
+        return current;
+    }
+
+    static std::atomic<int>& getNumThreadsWriting() noexcept
+    {
+        static std::atomic<int> numThreadsWriting {0};
+        return numThreadsWriting;
+    }
+
+    LibUsbCaptureRing::Slot& getSlot (juce::uint64 index) const noexcept
+    {
+        return *reinterpret_cast<LibUsbCaptureRing::Slot*> (data + LibUsbCaptureRing::headerSize + index * slotSize);
+    }
+
+    static juce::uint8 getUsbmonTransferType (juce::uint8 transferType) noexcept
+    {
+        switch (transferType)
+        {
+            case LIBUSB_TRANSFER_TYPE_ISOCHRONOUS:  return 0;
+            case LIBUSB_TRANSFER_TYPE_INTERRUPT:    return 1;
+            case LIBUSB_TRANSFER_TYPE_CONTROL:      return 2;
+            default:                                return 3;
+        }
+    }
+
+    static juce::int32 getUsbmonStatus (libusb_transfer_status status) noexcept
+    {
+        switch (status)
+        {
+            case LIBUSB_TRANSFER_COMPLETED:     return LibUsbCaptureRing::ok;
+            case LIBUSB_TRANSFER_CANCELLED:     return LibUsbCaptureRing::noEntry;
+            case LIBUSB_TRANSFER_NO_DEVICE:     return LibUsbCaptureRing::noDevice;
+            case LIBUSB_TRANSFER_STALL:         return LibUsbCaptureRing::brokenPipe;
+            case LIBUSB_TRANSFER_OVERFLOW:      return LibUsbCaptureRing::overflow;
+            case LIBUSB_TRANSFER_TIMED_OUT:     return LibUsbCaptureRing::timedOut;
+            case LIBUSB_TRANSFER_ERROR:
+            default:                            return LibUsbCaptureRing::protocol;
+        }
+    }
+
+    // a submission and a completion record are both written once the
+    // transfer completes, the submission keeping the time it was submitted
+    void write (const libusb_transfer& transfer, juce::uint64 deviceKey, juce::int64 submitTicks) noexcept
+    {
+        const auto completedTicks {juce::Time::getHighResolutionTicks()};
+
+        const auto control {transfer.type == LIBUSB_TRANSFER_TYPE_CONTROL};
+        const auto iso {transfer.type == LIBUSB_TRANSFER_TYPE_ISOCHRONOUS};
+        const auto endpoint {control ? (juce::uint8) (transfer.buffer[0] & LIBUSB_ENDPOINT_DIR_MASK)
+                                     : (juce::uint8) transfer.endpoint};
+        const auto input {(endpoint & LIBUSB_ENDPOINT_DIR_MASK) == LIBUSB_ENDPOINT_IN};
+
+        const auto* transferData {control ? transfer.buffer + LIBUSB_CONTROL_SETUP_SIZE : transfer.buffer};
+        const auto requestedLength {control ? transfer.length - LIBUSB_CONTROL_SETUP_SIZE : transfer.length};
+        auto actualLength {transfer.actual_length};
+        auto numPacketErrors {0};
+
+        if (iso)
+        {
+            actualLength = 0;
+
+            for (auto index {0}; index < transfer.num_iso_packets; ++index)
+            {
+                actualLength += (int) transfer.iso_packet_desc[index].actual_length;
+
+                if (transfer.iso_packet_desc[index].status != LIBUSB_TRANSFER_COMPLETED)
+                    ++numPacketErrors;
+            }
+
+            // the packets aren't contiguous in the buffer, so their data
+            // isn't kept
+            transferData = nullptr;
+        }
+
+        const auto submission {beginRecord (transfer, deviceKey, endpoint, 'S', submitTicks)};
+        submission.slot.usbmon.status = LibUsbCaptureRing::inProgress;
+
+        if (control)
+        {
+            memcpy (submission.slot.usbmon.setup, transfer.buffer, sizeof (submission.slot.usbmon.setup));
+            submission.slot.usbmon.setupFlag = 0;
+        }
+
+        endRecord (submission, requestedLength, input ? nullptr : transferData, input ? 0 : requestedLength);
+
+        const auto completion {beginRecord (transfer, deviceKey, endpoint, 'C', completedTicks)};
+        completion.slot.usbmon.status = getUsbmonStatus (transfer.status);
+
+        if (iso)
+        {
+            completion.slot.usbmon.iso.errorCount = numPacketErrors;
+            completion.slot.usbmon.iso.numDescriptors = transfer.num_iso_packets;
+        }
+
+        endRecord (completion, actualLength, input ? transferData : nullptr, input ? actualLength : 0);
+    }
+
+    struct Record
+    {
+        LibUsbCaptureRing::Slot& slot;
+        juce::uint64 sequence;
+    };
+
+    Record beginRecord (const libusb_transfer& transfer,
+                        juce::uint64 deviceKey,
+                        juce::uint8 endpoint,
+                        char eventType,
+                        juce::int64 ticks) noexcept
+    {
+        const auto sequence {header.nextSequence.fetch_add (1, std::memory_order_relaxed)};
+        auto& slot = getSlot (sequence % numSlots);
+
+        slot.sequence.store (0, std::memory_order_relaxed);
+        std::atomic_thread_fence (std::memory_order_release);
+
+        // split into whole seconds first so the multiplication can't overflow
+        const auto elapsedTicks {ticks - header.startTicks};
+        const auto microseconds {header.startMicroseconds
+                                 + (elapsedTicks / header.ticksPerSecond) * 1000000
+                                 + (elapsedTicks % header.ticksPerSecond) * 1000000 / header.ticksPerSecond};
+
+        auto& usbmon = slot.usbmon;
+        usbmon = {};
+        usbmon.id = (juce::uint64) reinterpret_cast<juce::pointer_sized_uint> (&transfer);
+        usbmon.eventType = (juce::uint8) eventType;
+        usbmon.transferType = getUsbmonTransferType (transfer.type);
+        usbmon.endpoint = endpoint;
+        usbmon.deviceAddress = (juce::uint8) getDeviceAddressFromDeviceKey (deviceKey);
+        usbmon.busNumber = (juce::uint16) getBusNumberFromDeviceKey (deviceKey);
+        usbmon.setupFlag = '-';
+        usbmon.seconds = microseconds / 1000000;
+        usbmon.microseconds = (juce::int32) (microseconds % 1000000);
+
+        slot.record.seconds = (juce::uint32) usbmon.seconds;
+        slot.record.microseconds = (juce::uint32) usbmon.microseconds;
+
+        return {slot, sequence};
+    }
+
+    void endRecord (const Record& recordToEnd, int length, const juce::uint8* payload, int payloadLength) noexcept
+    {
+        auto& slot = recordToEnd.slot;
+        const auto capturedLength {payload != nullptr ? juce::jlimit (0, maxPayloadBytes, payloadLength) : 0};
+
+        if (capturedLength > 0)
+            memcpy (slot.getPayload(), payload, (size_t) capturedLength);
+
+        auto& usbmon = slot.usbmon;
+        usbmon.length = (juce::uint32) juce::jmax (0, length);
+        usbmon.capturedLength = (juce::uint32) capturedLength;
+
+        // zero means the data is there, otherwise which way it would go
+        const auto input {(usbmon.endpoint & LIBUSB_ENDPOINT_DIR_MASK) == LIBUSB_ENDPOINT_IN};
+        usbmon.dataFlag = capturedLength > 0 ? 0 : (input ? '<' : '>');
+
+        slot.record.capturedLength = (juce::uint32) sizeof (LibUsbCaptureRing::UsbmonHeader) + usbmon.capturedLength;
+        slot.record.originalLength = (juce::uint32) sizeof (LibUsbCaptureRing::UsbmonHeader) + usbmon.length;
+
+        slot.sequence.store (recordToEnd.sequence + 1, std::memory_order_release);
+    }
+
+    juce::uint8* const data;
+    LibUsbCaptureRing::Header& header;
+    const juce::uint64 numSlots;
+    const juce::uint32 slotSize;
+    const int maxPayloadBytes;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (LibUsbCaptureWriter)
+};
+
+void captureTransfer (const libusb_transfer& transfer, juce::uint64 deviceKey, juce::int64 submitTicks) noexcept
+{
+    LibUsbCaptureWriter::capture (transfer, deviceKey, submitTicks);
+}
+
+//==============================================================================
+class USBTrafficCapture::Pimpl
+{
+public:
+    ~Pimpl() noexcept
+    {
+        stop();
+    }
+
+    bool start (const Options& options) noexcept
+    {
+        std::unique_lock<std::mutex> lock (mutex);
+        stopLocked();
+
+        const auto numSlots {(juce::uint64) juce::jmax (2, options.numRecords)};
+        const auto maxPayloadBytes {juce::jmax (0, options.maxPayloadBytes)};
+        const auto fileSize {(juce::int64) (LibUsbCaptureRing::headerSize
+                                            + numSlots * LibUsbCaptureRing::getSlotSize (maxPayloadBytes))};
+
+        if ( ! createFile (options.file, fileSize))
+            return false;
+
+        mappedFile = std::make_unique<juce::MemoryMappedFile> (options.file, juce::MemoryMappedFile::readWrite);
+
+        if (mappedFile->getData() == nullptr || (juce::int64) mappedFile->getSize() < fileSize)
+        {
+            mappedFile.reset();
+            return false;
+        }
+
+        writer = std::make_unique<LibUsbCaptureWriter> (mappedFile->getData(), numSlots, maxPayloadBytes);
+        LibUsbCaptureWriter::setCurrent (writer.get());
+
+        return true;
+    }
+
+    void stop() noexcept
+    {
+        std::unique_lock<std::mutex> lock (mutex);
+        stopLocked();
+    }
+
+    bool isCapturing() const noexcept
+    {
+        std::unique_lock<std::mutex> lock (mutex);
+        return writer != nullptr;
+    }
+
+    juce::int64 getNumRecordsWritten() const noexcept
+    {
+        std::unique_lock<std::mutex> lock (mutex);
+        return writer != nullptr ? writer->getNumRecordsWritten() : lastNumRecordsWritten;
+    }
+
+    static bool convertToPcap (const juce::File& ringFile, const juce::File& pcapFile) noexcept
+    {
+        const juce::MemoryMappedFile mappedRing (ringFile, juce::MemoryMappedFile::readOnly);
+        const auto* ringData {static_cast<const juce::uint8*> (mappedRing.getData())};
+
+        if (ringData == nullptr || mappedRing.getSize() < LibUsbCaptureRing::headerSize)
+            return false;
+
+        const auto& header = *reinterpret_cast<const LibUsbCaptureRing::Header*> (ringData);
+
+        if (header.magic != LibUsbCaptureRing::magic
+            || header.version != LibUsbCaptureRing::version
+            || header.slotSize != LibUsbCaptureRing::getSlotSize ((int) header.maxPayloadBytes)
+            || mappedRing.getSize() < LibUsbCaptureRing::headerSize + header.numSlots * header.slotSize)
+        {
+            return false;
+        }
+
+        // copy every finished record out first, as the ring may still be
+        // being written to
+        juce::MemoryBlock records (header.numSlots * header.slotSize);
+        std::vector<std::pair<std::pair<juce::int64, juce::uint64>, size_t>> order;
+
+        for (juce::uint64 index {0}; index < header.numSlots; ++index)
+        {
+            auto& slot = *reinterpret_cast<LibUsbCaptureRing::Slot*> (const_cast<juce::uint8*> (ringData)
+                                                                      + LibUsbCaptureRing::headerSize
+                                                                      + index * header.slotSize);
+            auto* copy = static_cast<juce::uint8*> (records.getData()) + order.size() * header.slotSize;
+
+            const auto sequenceBefore {slot.sequence.load (std::memory_order_acquire)};
+
+            if (sequenceBefore == 0)
+                continue;
+
+            memcpy (copy, &slot, header.slotSize);
+            std::atomic_thread_fence (std::memory_order_acquire);
+
+            if (slot.sequence.load (std::memory_order_relaxed) != sequenceBefore)
+                continue;
+
+            const auto& usbmon = reinterpret_cast<const LibUsbCaptureRing::Slot*> (copy)->usbmon;
+            const auto microseconds {usbmon.seconds * 1000000 + usbmon.microseconds};
+
+            order.push_back ({{microseconds, sequenceBefore}, order.size()});
+        }
+
+        std::sort (order.begin(), order.end());
+
+        pcapFile.deleteFile();
+        juce::FileOutputStream output (pcapFile);
+
+        if (output.failedToOpen())
+            return false;
+
+        const juce::uint32 magic {0xa1b2c3d4};
+        const juce::uint16 versionMajor {2};
+        const juce::uint16 versionMinor {4};
+        const juce::int32 timeZone {0};
+        const juce::uint32 significantFigures {0};
+        const juce::uint32 snapLength {(juce::uint32) sizeof (LibUsbCaptureRing::UsbmonHeader) + header.maxPayloadBytes};
+
+        auto ok {output.write (&magic, sizeof (magic))
+                 && output.write (&versionMajor, sizeof (versionMajor))
+                 && output.write (&versionMinor, sizeof (versionMinor))
+                 && output.write (&timeZone, sizeof (timeZone))
+                 && output.write (&significantFigures, sizeof (significantFigures))
+                 && output.write (&snapLength, sizeof (snapLength))
+                 && output.write (&LibUsbCaptureRing::linkTypeUsbLinuxMmapped, sizeof (LibUsbCaptureRing::linkTypeUsbLinuxMmapped))};
+
+        for (const auto& entry : order)
+        {
+            const auto& slot = *reinterpret_cast<const LibUsbCaptureRing::Slot*> (static_cast<const juce::uint8*> (records.getData())
+                                                                                  + entry.second * header.slotSize);
+
+            ok = ok
+                 && output.write (&slot.record, sizeof (slot.record))
+                 && output.write (&slot.usbmon, slot.record.capturedLength);
+        }
+
+        output.flush();
+        return ok;
+    }
+
+private:
+    static bool createFile (const juce::File& file, juce::int64 size) noexcept
+    {
+        file.deleteFile();
+
+        if (file.create().failed())
+            return false;
+
+        // extending the file leaves it full of zeros, which marks every slot
+        // as empty
+        juce::FileOutputStream output (file);
+
+        return ! output.failedToOpen()
+            && output.setPosition (size - 1)
+            && output.writeByte (0);
+    }
+
+    // called with the mutex locked
+    void stopLocked() noexcept
+    {
+        if (writer == nullptr)
+            return;
+
+        if (LibUsbCaptureWriter::isCurrent (writer.get()))
+            LibUsbCaptureWriter::setCurrent (nullptr);
+
+        lastNumRecordsWritten = writer->getNumRecordsWritten();
+
+        writer.reset();
+        mappedFile.reset();
+    }
+
+    std::unique_ptr<juce::MemoryMappedFile> mappedFile;
+    std::unique_ptr<LibUsbCaptureWriter> writer;
+    juce::int64 lastNumRecordsWritten {0};
+    mutable std::mutex mutex;
+};
+
+//==============================================================================
+USBTrafficCapture& USBTrafficCapture::getInstance()
+{
+    static USBTrafficCapture instance;
+    return instance;
+}
+
+USBTrafficCapture::USBTrafficCapture() noexcept
+    : pimpl (std::make_unique<Pimpl>())
+{
+}
+
+USBTrafficCapture::~USBTrafficCapture() noexcept
+{
+}
+
+bool USBTrafficCapture::start (const Options& options) noexcept
+{
+    return pimpl->start (options);
+}
+
+void USBTrafficCapture::stop() noexcept
+{
+    pimpl->stop();
+}
+
+bool USBTrafficCapture::isCapturing() const noexcept
+{
+    return pimpl->isCapturing();
+}
+
+juce::int64 USBTrafficCapture::getNumRecordsWritten() const noexcept
+{
+    return pimpl->getNumRecordsWritten();
+}
+
+bool USBTrafficCapture::convertToPcap (const juce::File& ringFile, const juce::File& pcapFile) noexcept
+{
+    return Pimpl::convertToPcap (ringFile, pcapFile);
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+//==============================================================================
+/** Records every transfer made by the module into a memory-mapped ring file,
+    so what went over the wire can be looked at after a device misbehaves.
+
+    Each transfer is written as a pair of Linux usbmon records, one for its
+    submission and one for its completion, in the format Wireshark and
+    tcpdump read as LINKTYPE_USB_LINUX_MMAPPED. The ring file itself isn't a
+    pcap file, as it wraps, use convertToPcap() to turn what it holds into one.
+    The ring is written in place so it survives the process crashing.
+
+    The file is allocated and mapped when the capture starts. After that a
+    record is written with a few stores into the mapping, with no locks,
+    allocations or system calls, from whichever thread completed the
+    transfer. When no capture is running the completion path pays for no more
+    than one atomic load, so it can be left in live builds and started when
+    needed.
+
+    @code
+    USBTrafficCapture::Options options;
+    options.file = juce::File::getSpecialLocation (juce::File::tempDirectory).getChildFile ("usb.ring");
+    options.maxPayloadBytes = 64;
+
+    auto& capture = USBTrafficCapture::getInstance();
+    capture.start (options);
+    ...
+    capture.stop();
+    USBTrafficCapture::convertToPcap (options.file, options.file.withFileExtension ("pcap"));
+    @endcode
+ */
+class USBTrafficCapture
+{
+public:
+    /** Returns the one and only instance of this object */
+    static USBTrafficCapture& getInstance();
+
+    /** Destructor. */
+    ~USBTrafficCapture() noexcept;
+
+    struct Options
+    {
+        /** The ring file, any existing file is replaced. */
+        juce::File file;
+
+        /** The number of records the ring holds before the oldest are
+            overwritten, each transfer takes two.
+         */
+        int numRecords {16384};
+
+        /** The most bytes of each transfer's data to keep, zero only keeps
+            the headers. The setup packet of a control transfer is always
+            kept, isochronous data never is.
+         */
+        int maxPayloadBytes {0};
+    };
+
+    /** Creates the ring file and starts capturing, stopping any capture
+        already running. Returns false if the file couldn't be created.
+     */
+    bool start (const Options& options) noexcept;
+
+    /** Stops capturing, waiting for any record being written to finish. The
+        ring file is left in place.
+     */
+    void stop() noexcept;
+
+    /** Returns true while transfers are being captured. */
+    bool isCapturing() const noexcept;
+
+    /** Returns the number of records written since the capture started,
+        including any that have since been overwritten.
+     */
+    juce::int64 getNumRecordsWritten() const noexcept;
+
+    /** Writes the records held in a ring file to a pcap file, oldest first.
+
+        This can be called on a ring that's still being written to, records
+        overwritten while being read are left out. Returns false if the ring
+        file can't be read or the pcap file can't be written.
+     */
+    static bool convertToPcap (const juce::File& ringFile, const juce::File& pcapFile) noexcept;
+
+private:
+    /** Default constructor. */
+    USBTrafficCapture() noexcept;
+
+    class Pimpl;
+    std::unique_ptr<Pimpl> pimpl;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (USBTrafficCapture)
+};
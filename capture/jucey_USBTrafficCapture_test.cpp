@@ -0,0 +1,198 @@
+//==============================================================================
+class USBTrafficCaptureTests : public juce::UnitTest
+{
+public:
+    USBTrafficCaptureTests()
+        : juce::UnitTest ("USBTrafficCapture", "jucey_libusb")
+    {
+    }
+
+    void runTest() override
+    {
+        LibUsbSimulatedDevices bus;
+
+        auto spec {LibUsbSimulatedDevices::makeDeviceSpec (1)};
+        spec.endpoints.add ({bulkEndpoint, USBDevice::Endpoint::TransferType::bulk, 512, 0, 1, 16.0e6});
+        bus.addDevice (spec);
+        expect (bus.waitForNumDevices (1));
+
+        const auto device {bus.findDevice (1)};
+        const juce::TemporaryFile ringFile {".ring"};
+        const juce::TemporaryFile pcapFile {".pcap"};
+
+        beginTest ("Every transfer is converted to a submission and a completion");
+        {
+            const auto numRecordsWritten {capture (device, ringFile.getFile(), 4096)};
+            expect (numRecordsWritten > 0);
+
+            const auto records {convert (ringFile.getFile(), pcapFile.getFile())};
+            expectEquals ((juce::int64) records.size(), numRecordsWritten);
+
+            std::unordered_set<juce::uint64> transfersInFlight;
+
+            for (const auto& record : records)
+            {
+                const auto& usbmon = record.usbmon;
+
+                if (usbmon.endpoint != bulkEndpoint)
+                    continue;
+
+                expectEquals ((int) usbmon.busNumber, device.getBusNumber());
+                expectEquals ((int) usbmon.deviceAddress, device.getAddress());
+
+                if (usbmon.eventType == 'S')
+                {
+                    expect (transfersInFlight.insert (usbmon.id).second, "A transfer was submitted twice");
+                    expectEquals ((int) record.capturedLength, (int) sizeof (usbmon));
+                }
+                else
+                {
+                    expect (usbmon.eventType == 'C');
+                    expect (transfersInFlight.erase (usbmon.id) == 1, "A transfer completed without being submitted");
+
+                    if (usbmon.status == LibUsbCaptureRing::ok)
+                        expectEquals ((int) record.capturedLength, (int) sizeof (usbmon) + maxPayloadBytes);
+                }
+            }
+
+            expect (transfersInFlight.empty());
+        }
+
+        beginTest ("A ring that has wrapped keeps the newest records in order");
+        {
+            const auto numRecords {16};
+            expect (capture (device, ringFile.getFile(), numRecords) > numRecords);
+
+            const auto records {convert (ringFile.getFile(), pcapFile.getFile())};
+            expect (records.size() > 0 && records.size() <= numRecords);
+
+            for (auto index {1}; index < records.size(); ++index)
+            {
+                const auto& previous = records.getReference (index - 1);
+                const auto& record = records.getReference (index);
+
+                expect (previous.seconds < record.seconds
+                        || (previous.seconds == record.seconds && previous.microseconds <= record.microseconds));
+            }
+        }
+
+        beginTest ("Files that aren't rings aren't converted");
+        {
+            const juce::TemporaryFile notRing {".ring"};
+            const juce::MemoryBlock zeros (LibUsbCaptureRing::headerSize * 2, true);
+            expect (notRing.getFile().replaceWithData (zeros.getData(), zeros.getSize()));
+
+            expect ( ! USBTrafficCapture::convertToPcap (notRing.getFile(), pcapFile.getFile()));
+        }
+    }
+
+private:
+    static constexpr int bulkEndpoint {0x81};
+    static constexpr int maxPayloadBytes {16};
+
+    struct Record
+    {
+        juce::uint32 seconds;
+        juce::uint32 microseconds;
+        juce::uint32 capturedLength;
+        LibUsbCaptureRing::UsbmonHeader usbmon;
+    };
+
+    // streams from the device for a moment and returns the number of records written
+    juce::int64 capture (const USBDevice& device, const juce::File& ringFile, int numRecords)
+    {
+        USBTrafficCapture::Options options {};
+        options.file = ringFile;
+        options.numRecords = numRecords;
+        options.maxPayloadBytes = maxPayloadBytes;
+
+        auto& capture = USBTrafficCapture::getInstance();
+        expect (capture.start (options));
+
+        try
+        {
+            USBEndpointStream::Options streamOptions {};
+            streamOptions.endpointAddress = bulkEndpoint;
+            streamOptions.transferSize = 4096;
+            streamOptions.numTransfers = 4;
+
+            USBEndpointStream stream {device, streamOptions};
+            juce::HeapBlock<juce::uint8> chunk ((size_t) streamOptions.transferSize);
+
+            for (auto numTransfersRead {0}; numTransfersRead < 100 && stream.waitUntilReady (1000);)
+            {
+                while (stream.getNumBytesAvailable() >= streamOptions.transferSize)
+                {
+                    stream.read (chunk, streamOptions.transferSize);
+                    ++numTransfersRead;
+                }
+            }
+        }
+        catch (const std::exception& e)
+        {
+            expect (false, e.what());
+        }
+
+        capture.stop();
+        return capture.getNumRecordsWritten();
+    }
+
+    juce::Array<Record> convert (const juce::File& ringFile, const juce::File& pcapFile)
+    {
+        juce::Array<Record> records;
+        juce::MemoryBlock data;
+
+        expect (USBTrafficCapture::convertToPcap (ringFile, pcapFile));
+        expect (pcapFile.loadFileAsData (data));
+
+        constexpr size_t fileHeaderSize {24};
+        const auto* bytes {static_cast<const juce::uint8*> (data.getData())};
+
+        if (data.getSize() < fileHeaderSize)
+        {
+            expect (false, "The pcap file has no header");
+            return records;
+        }
+
+        juce::uint32 magic {0};
+        juce::uint32 linkType {0};
+        std::memcpy (&magic, bytes, sizeof (magic));
+        std::memcpy (&linkType, bytes + 20, sizeof (linkType));
+        expect (magic == 0xa1b2c3d4);
+        expect (linkType == LibUsbCaptureRing::linkTypeUsbLinuxMmapped);
+
+        for (auto offset {fileHeaderSize}; offset < data.getSize();)
+        {
+            LibUsbCaptureRing::PcapRecordHeader header {};
+
+            if (data.getSize() - offset < sizeof (header))
+            {
+                expect (false, "A record header is cut short");
+                break;
+            }
+
+            std::memcpy (&header, bytes + offset, sizeof (header));
+            offset += sizeof (header);
+
+            if (header.capturedLength < sizeof (LibUsbCaptureRing::UsbmonHeader)
+                || data.getSize() - offset < header.capturedLength)
+            {
+                expect (false, "A record is cut short");
+                break;
+            }
+
+            Record record {};
+            record.seconds = header.seconds;
+            record.microseconds = header.microseconds;
+            record.capturedLength = header.capturedLength;
+            std::memcpy (&record.usbmon, bytes + offset, sizeof (record.usbmon));
+            records.add (record);
+
+            offset += header.capturedLength;
+        }
+
+        return records;
+    }
+};
+
+static USBTrafficCaptureTests usbTrafficCaptureTests;
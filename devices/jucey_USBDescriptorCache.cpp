@@ -0,0 +1,240 @@
+//==============================================================================
+/** Remembers the string descriptors of devices between runs so they can be
+    reported as soon as a device is found, rather than after waiting on the
+    control transfers needed to read them.
+
+    The file is a header followed by fixed size entries and a pool of null
+    terminated UTF-8 strings, so it's read straight out of a memory mapped
+    file. Entries are keyed by the bus and port path a device is plugged into
+    and only used if the vendor ID, product ID and device release number still
+    match. The serial number can't be known without asking the device, so it's
+    stored and corrected by the background read instead.
+ */
+class LibUsbDescriptorCache
+{
+public:
+    LibUsbDescriptorCache() = default;
+    ~LibUsbDescriptorCache() = default;
+
+    /** Sets the file to use and loads any entries already in it, an empty
+        File stops using a cache.
+     */
+    void setFile (const juce::File& newFile) noexcept
+    {
+        std::unique_lock<std::mutex> lock (mutex);
+
+        file = newFile;
+        entries.clear();
+        needsSaving = false;
+
+        if (file.existsAsFile())
+            load();
+    }
+
+    bool find (juce::uint64 deviceKey,
+               const libusb_device_descriptor& descriptor,
+               LibUsbDescriptorStrings& result) const noexcept
+    {
+        std::unique_lock<std::mutex> lock (mutex);
+
+        const auto iter {entries.find (getLocation (deviceKey))};
+
+        if (iter == entries.end() || ! iter->second.matches (descriptor))
+            return false;
+
+        result = iter->second.strings;
+        return true;
+    }
+
+    void update (juce::uint64 deviceKey,
+                 const libusb_device_descriptor& descriptor,
+                 const LibUsbDescriptorStrings& strings) noexcept
+    {
+        std::unique_lock<std::mutex> lock (mutex);
+
+        if (file == juce::File())
+            return;
+
+        auto& entry = entries[getLocation (deviceKey)];
+
+        if (entry.matches (descriptor)
+            && entry.strings.manufacturerName == strings.manufacturerName
+            && entry.strings.productName == strings.productName
+            && entry.strings.serialNumber == strings.serialNumber)
+        {
+            return;
+        }
+
+        entry.vendorId = descriptor.idVendor;
+        entry.productId = descriptor.idProduct;
+        entry.deviceVersion = descriptor.bcdDevice;
+        entry.strings = strings;
+        needsSaving = true;
+    }
+
+    void saveIfNeeded() noexcept
+    {
+        std::unique_lock<std::mutex> lock (mutex);
+
+        if ( ! needsSaving || file == juce::File())
+            return;
+
+        needsSaving = ! save();
+    }
+
+private:
+    static constexpr char magic[4] {'J', 'U', 'D', 'C'};
+    static constexpr uint32_t currentVersion {1};
+
+    struct FileHeader
+    {
+        char magic[4];
+        uint32_t version;
+        uint32_t numEntries;
+        uint32_t stringPoolSize;
+    };
+
+    // string offsets are into the pool, which always starts with an empty string
+    struct FileEntry
+    {
+        juce::uint64 location;
+        uint16_t vendorId;
+        uint16_t productId;
+        uint16_t deviceVersion;
+        uint16_t reserved;
+        uint32_t manufacturerName;
+        uint32_t productName;
+        uint32_t serialNumber;
+        uint32_t reserved2;
+    };
+
+    static_assert (sizeof (FileHeader) == 16, "The cache file layout must not change");
+    static_assert (sizeof (FileEntry) == 32, "The cache file layout must not change");
+
+    struct Entry
+    {
+        bool matches (const libusb_device_descriptor& descriptor) const noexcept
+        {
+            return vendorId == descriptor.idVendor
+                && productId == descriptor.idProduct
+                && deviceVersion == descriptor.bcdDevice;
+        }
+
+        uint16_t vendorId {0};
+        uint16_t productId {0};
+        uint16_t deviceVersion {0};
+        LibUsbDescriptorStrings strings {};
+    };
+
+    // the device address changes every time a device is plugged in, so only
+    // the bus number and port path are used
+    static juce::uint64 getLocation (juce::uint64 deviceKey) noexcept
+    {
+        return deviceKey & ~((juce::uint64) 0x7f << 48);
+    }
+
+    void load() noexcept
+    {
+        const juce::MemoryMappedFile mappedFile {file, juce::MemoryMappedFile::readOnly};
+        const auto* data {static_cast<const char*> (mappedFile.getData())};
+        const auto size {mappedFile.getSize()};
+
+        if (data == nullptr || size < sizeof (FileHeader))
+            return;
+
+        FileHeader header {};
+        std::memcpy (&header, data, sizeof (header));
+
+        if (std::memcmp (header.magic, magic, sizeof (magic)) != 0
+            || header.version != currentVersion
+            || header.stringPoolSize == 0
+            || size != sizeof (FileHeader) + (size_t) header.numEntries * sizeof (FileEntry) + header.stringPoolSize)
+        {
+            return;
+        }
+
+        const auto* stringPool {data + sizeof (FileHeader) + (size_t) header.numEntries * sizeof (FileEntry)};
+
+        // every string must be terminated inside the pool
+        if (stringPool[header.stringPoolSize - 1] != 0)
+            return;
+
+        const auto getString = [&] (uint32_t offset)
+        {
+            return offset < header.stringPoolSize ? juce::String (juce::CharPointer_UTF8 (stringPool + offset))
+                                                  : juce::String();
+        };
+
+        for (uint32_t index {0}; index < header.numEntries; ++index)
+        {
+            FileEntry fileEntry {};
+            std::memcpy (&fileEntry, data + sizeof (FileHeader) + index * sizeof (FileEntry), sizeof (fileEntry));
+
+            auto& entry = entries[fileEntry.location];
+            entry.vendorId = fileEntry.vendorId;
+            entry.productId = fileEntry.productId;
+            entry.deviceVersion = fileEntry.deviceVersion;
+            entry.strings.manufacturerName = getString (fileEntry.manufacturerName);
+            entry.strings.productName = getString (fileEntry.productName);
+            entry.strings.serialNumber = getString (fileEntry.serialNumber);
+        }
+    }
+
+    bool save() const noexcept
+    {
+        juce::MemoryBlock stringPool {};
+        stringPool.append ("", 1);
+
+        const auto addString = [&stringPool] (const juce::String& string)
+        {
+            if (string.isEmpty())
+                return (uint32_t) 0;
+
+            const auto offset {(uint32_t) stringPool.getSize()};
+            stringPool.append (string.toRawUTF8(), string.getNumBytesAsUTF8() + 1);
+            return offset;
+        };
+
+        juce::MemoryBlock fileEntries {};
+
+        for (const auto& locationAndEntry : entries)
+        {
+            const auto& entry = locationAndEntry.second;
+
+            FileEntry fileEntry {};
+            fileEntry.location = locationAndEntry.first;
+            fileEntry.vendorId = entry.vendorId;
+            fileEntry.productId = entry.productId;
+            fileEntry.deviceVersion = entry.deviceVersion;
+            fileEntry.manufacturerName = addString (entry.strings.manufacturerName);
+            fileEntry.productName = addString (entry.strings.productName);
+            fileEntry.serialNumber = addString (entry.strings.serialNumber);
+
+            fileEntries.append (&fileEntry, sizeof (fileEntry));
+        }
+
+        FileHeader header {};
+        std::memcpy (header.magic, magic, sizeof (magic));
+        header.version = currentVersion;
+        header.numEntries = (uint32_t) entries.size();
+        header.stringPoolSize = (uint32_t) stringPool.getSize();
+
+        juce::MemoryBlock data {&header, sizeof (header)};
+        data.append (fileEntries.getData(), fileEntries.getSize());
+        data.append (stringPool.getData(), stringPool.getSize());
+
+        if (file.getParentDirectory().createDirectory().failed())
+            return false;
+
+        // writes to a temporary file first so a reader never maps a half
+        // written cache
+        return file.replaceWithData (data.getData(), data.getSize());
+    }
+
+    mutable std::mutex mutex;
+    juce::File file;
+    std::unordered_map<juce::uint64, Entry> entries;
+    bool needsSaving {false};
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (LibUsbDescriptorCache)
+};
@@ -0,0 +1,150 @@
+//==============================================================================
+class USBDescriptorCacheTests : public juce::UnitTest
+{
+public:
+    USBDescriptorCacheTests()
+        : juce::UnitTest ("USBDescriptorCache", "jucey_libusb")
+    {
+    }
+
+    void runTest() override
+    {
+        const juce::TemporaryFile cacheFile {".cache"};
+        const auto descriptor {makeDescriptor (0x1234, 0x0001, 0x0100)};
+        const auto key {makeKey (1, 5, {1, 3})};
+
+        LibUsbDescriptorStrings strings {};
+        strings.manufacturerName = "jucey";
+        strings.productName = juce::CharPointer_UTF8 ("Pr\xc3\xb6" "duct");
+        strings.serialNumber = "0123";
+
+        beginTest ("Saved entries are loaded again");
+        {
+            {
+                LibUsbDescriptorCache cache;
+                cache.setFile (cacheFile.getFile());
+                cache.update (key, descriptor, strings);
+                cache.update (makeKey (2, 1, {4}), makeDescriptor (0x4321, 0x0002, 0x0200), {});
+                cache.saveIfNeeded();
+            }
+
+            LibUsbDescriptorCache cache;
+            cache.setFile (cacheFile.getFile());
+
+            LibUsbDescriptorStrings found {};
+            expect (cache.find (key, descriptor, found));
+            expectEquals (found.manufacturerName, strings.manufacturerName);
+            expectEquals (found.productName, strings.productName);
+            expectEquals (found.serialNumber, strings.serialNumber);
+
+            expect (cache.find (makeKey (2, 1, {4}), makeDescriptor (0x4321, 0x0002, 0x0200), found));
+            expect (found.manufacturerName.isEmpty() && found.productName.isEmpty() && found.serialNumber.isEmpty());
+        }
+
+        beginTest ("Entries are found by location");
+        {
+            LibUsbDescriptorCache cache;
+            cache.setFile (cacheFile.getFile());
+
+            // the address changes every time a device is plugged in
+            LibUsbDescriptorStrings found {};
+            expect (cache.find (makeKey (1, 9, {1, 3}), descriptor, found));
+            expectEquals (found.serialNumber, strings.serialNumber);
+
+            expect ( ! cache.find (makeKey (1, 5, {1, 4}), descriptor, found));
+            expect ( ! cache.find (makeKey (3, 5, {1, 3}), descriptor, found));
+            expect ( ! cache.find (key, makeDescriptor (0x1234, 0x0002, 0x0100), found));
+            expect ( ! cache.find (key, makeDescriptor (0x1234, 0x0001, 0x0101), found));
+        }
+
+        beginTest ("Damaged files are ignored");
+        {
+            juce::MemoryBlock data;
+            expect (cacheFile.getFile().loadFileAsData (data));
+
+            const auto expectIgnored = [&] (const juce::MemoryBlock& damaged)
+            {
+                expect (cacheFile.getFile().replaceWithData (damaged.getData(), damaged.getSize()));
+
+                LibUsbDescriptorCache cache;
+                cache.setFile (cacheFile.getFile());
+
+                LibUsbDescriptorStrings found {};
+                expect ( ! cache.find (key, descriptor, found));
+            };
+
+            auto truncated {data};
+            truncated.setSize (data.getSize() - 1);
+            expectIgnored (truncated);
+
+            auto wrongMagic {data};
+            wrongMagic[0] = 'X';
+            expectIgnored (wrongMagic);
+
+            auto wrongVersion {data};
+            wrongVersion[4] = 2;
+            expectIgnored (wrongVersion);
+
+            // the last string has lost its terminator
+            auto unterminated {data};
+            unterminated[data.getSize() - 1] = 'X';
+            expectIgnored (unterminated);
+        }
+
+        beginTest ("Strings from the cache are provisional until the device is read");
+        {
+            LibUsbSimulatedDevices bus;
+            auto& manager = bus.getManager();
+            const juce::TemporaryFile managerCacheFile {".cache"};
+            manager.setDescriptorCacheFile (managerCacheFile.getFile());
+
+            auto spec {LibUsbSimulatedDevices::makeDeviceSpec (1)};
+            const auto deviceId {bus.addDevice (spec)};
+            expect (bus.waitForNumDevices (1));
+            expect (LibUsbSimulatedDevices::waitUntil ([&] { return managerCacheFile.getFile().existsAsFile(); }));
+
+            bus.removeDevice (deviceId);
+            expect (bus.waitForNumDevices (0));
+
+            // another unit of the same product, plugged in where the first was
+            const auto cachedSerialNumber {spec.serialNumber};
+            spec.serialNumber = "another";
+            spec.descriptorReadDelayMs = 500;
+            bus.addDevice (spec);
+            expect (bus.waitForNumDevices (1));
+
+            const auto device {bus.findDevice (1)};
+            expect (device.areDescriptorStringsAvailable());
+            expect (device.areDescriptorStringsProvisional());
+            expectEquals (device.getSerialNumber(), cachedSerialNumber);
+
+            expect (LibUsbSimulatedDevices::waitUntil ([&] { return ! device.areDescriptorStringsProvisional(); }));
+            expectEquals (device.getSerialNumber(), spec.serialNumber);
+
+            manager.setDescriptorCacheFile ({});
+        }
+    }
+
+private:
+    static libusb_device_descriptor makeDescriptor (int vendorId, int productId, int deviceVersion) noexcept
+    {
+        libusb_device_descriptor descriptor {};
+        descriptor.idVendor = (uint16_t) vendorId;
+        descriptor.idProduct = (uint16_t) productId;
+        descriptor.bcdDevice = (uint16_t) deviceVersion;
+        return descriptor;
+    }
+
+    // laid out the same way as getDeviceKey()
+    static juce::uint64 makeKey (int busNumber, int address, const juce::Array<int>& portPath) noexcept
+    {
+        auto key {(juce::uint64) busNumber << 56 | (juce::uint64) address << 48};
+
+        for (auto index {0}; index < portPath.size(); ++index)
+            key |= (juce::uint64) portPath[index] << (6 * index);
+
+        return key;
+    }
+};
+
+static USBDescriptorCacheTests usbDescriptorCacheTests;
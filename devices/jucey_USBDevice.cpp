@@ -3,11 +3,14 @@
 juce::String getDescriptorString (libusb_device_handle* handle,
                                   uint8_t index) noexcept
 {
-    if (index == 0)
+    if (index == 0 || handle == nullptr)
+        return {};
+
+    unsigned char buffer[255] {};
+
+    if (getLibUsbBackend().getStringDescriptorAscii (handle, index, buffer, sizeof(buffer)) < 0)
         return {};
 
-    unsigned char buffer[255];
-    libusb_get_string_descriptor_ascii (handle, index, buffer, sizeof(buffer));
     return juce::String (juce::CharPointer_UTF8 (reinterpret_cast<char*>(buffer)));
 }
 
@@ -35,23 +38,36 @@ int getPowerUnitsFromSpeed (libusb_speed speed)
     }
 }
 
+//==============================================================================
+struct LibUsbDescriptorStrings
+{
+    juce::String manufacturerName {};
+    juce::String productName {};
+    juce::String serialNumber {};
+
+    /** True for strings taken from the descriptor cache, which were read from
+        whichever unit was last at the device's location.
+     */
+    bool provisional {false};
+};
+
 //==============================================================================
 struct LibUsbConfig
 {
     LibUsbConfig (libusb_device* device, int index) noexcept
     {
-        libusb_get_config_descriptor (device, index, &descriptor);
+        getLibUsbBackend().getConfigDescriptor (device, index, &descriptor);
     }
 
     LibUsbConfig (libusb_device* device) noexcept
     {
-        libusb_get_active_config_descriptor (device, &descriptor);
+        getLibUsbBackend().getActiveConfigDescriptor (device, &descriptor);
     }
 
     ~LibUsbConfig() noexcept
     {
         if (descriptor != nullptr)
-            libusb_free_config_descriptor (descriptor);
+            getLibUsbBackend().freeConfigDescriptor (descriptor);
     }
 
     bool operator== (const LibUsbConfig& other) const noexcept
@@ -72,21 +88,719 @@ struct LibUsbConfig
 };
 
 //==============================================================================
-struct LibUsbDevice
+struct LibUsbDevice;
+
+/** Closes device handles once nothing has used them for a while.
+
+    Devices are only opened while something needs them, when the last user is
+    done the device is handed over here and closed once the idle timeout
+    passes, unless it's used again in the meantime.
+ */
+class LibUsbIdleHandleCloser  : private juce::Thread
+{
+public:
+    LibUsbIdleHandleCloser() noexcept
+        : juce::Thread ("jucey USB idle handles")
+    {
+        startThread (juce::Thread::Priority::low);
+    }
+
+    ~LibUsbIdleHandleCloser() noexcept override
+    {
+        stopThread (1000);
+    }
+
+    /** The time a handle is kept open after its last use, a negative timeout
+        keeps handles open until the device goes away.
+     */
+    static std::atomic<int>& getIdleTimeoutMs() noexcept
+    {
+        static std::atomic<int> idleTimeoutMs {5000};
+        return idleTimeoutMs;
+    }
+
+    void closeLater (LibUsbDevice& device) noexcept
+    {
+        const auto timeoutMs {getIdleTimeoutMs().load()};
+
+        if (timeoutMs < 0)
+            return;
+
+        {
+            std::unique_lock<std::mutex> lock (mutex);
+            closeTimes[&device] = juce::Time::getHighResolutionTicks()
+                                + juce::Time::secondsToHighResolutionTicks (timeoutMs / 1000.0);
+        }
+
+        notify();
+    }
+
+    /** Forgets a device, once this returns the device won't be touched. */
+    void cancel (LibUsbDevice& device) noexcept
+    {
+        std::unique_lock<std::mutex> lock (mutex);
+        closeTimes.erase (&device);
+    }
+
+private:
+    void run() override;
+
+    std::mutex mutex;
+    std::unordered_map<LibUsbDevice*, juce::int64> closeTimes;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (LibUsbIdleHandleCloser)
+};
+
+//==============================================================================
+struct LibUsbDevice   : private LibUsbUser
 {
     LibUsbDevice (libusb_device* dev) noexcept
-        : device (dev)
+        : device (getLibUsbBackend().refDevice (dev))
     {
-        libusb_open (device, &handle);
     }
 
     ~LibUsbDevice() noexcept
     {
-        libusb_close (handle);
+        // something is still using the handle!
+        jassert (numLeases == 0);
+
+        idleHandleCloser->cancel (*this);
+        closeHandle();
+
+        getLibUsbBackend().unrefDevice (device);
+    }
+
+    //==============================================================================
+    /** Keeps the device open for as long as it exists, opening it first if
+        need be. Opening can be slow so avoid taking a lease while holding any
+        locks.
+     */
+    class Lease
+    {
+    public:
+        explicit Lease (LibUsbDevice& deviceToOpen) noexcept
+            : device (deviceToOpen)
+            , result (device.acquireHandle())
+        {
+        }
+
+        ~Lease() noexcept
+        {
+            if (result == LIBUSB_SUCCESS)
+                device.releaseHandle();
+        }
+
+        /** Returns LIBUSB_SUCCESS, or the reason the device couldn't be opened. */
+        int getResult() const noexcept
+        {
+            return result;
+        }
+
+        /** Returns the open handle, or nullptr if the device couldn't be opened. */
+        libusb_device_handle* getHandle() const noexcept
+        {
+            return result == LIBUSB_SUCCESS ? device.getHandle() : nullptr;
+        }
+
+        /** Returns the context the handle was opened in, transfers on the
+            handle only complete while its events are being handled.
+         */
+        std::shared_ptr<LibUsbContext> getContext() const noexcept
+        {
+            return result == LIBUSB_SUCCESS ? device.handleContext : nullptr;
+        }
+
+    private:
+        LibUsbDevice& device;
+        const int result;
+
+        JUCE_DECLARE_NON_COPYABLE (Lease)
+    };
+
+    /** Returns the open handle, this must only be called while holding a
+        Lease. The handle is never closed while there is a lease on it.
+     */
+    libusb_device_handle* getHandle() const noexcept
+    {
+        jassert (numLeases > 0);
+        return handle;
+    }
+
+    /** Returns the pool transfer buffers for this device should be allocated
+        from, this must only be called while holding a Lease. The pool goes
+        when the handle is closed, so every buffer has to be returned before
+        the lease is released.
+     */
+    LibUsbBufferPool& getBufferPool() const noexcept
+    {
+        jassert (numLeases > 0);
+        return *bufferPool;
+    }
+
+    /** Claims an interface, an interface can be claimed more than once and
+        will only be released once every claim has been released. This must
+        only be called while holding a Lease.
+     */
+    int claimInterface (int interfaceNumber) noexcept
+    {
+        std::unique_lock<std::mutex> lock (claimedInterfacesMutex);
+        auto& numClaims = claimedInterfaces[interfaceNumber];
+
+        if (numClaims == 0)
+        {
+            const auto result {getLibUsbBackend().claimInterface (getHandle(), interfaceNumber)};
+
+            if (result != LIBUSB_SUCCESS)
+            {
+                claimedInterfaces.erase (interfaceNumber);
+                return result;
+            }
+        }
+
+        ++numClaims;
+        return LIBUSB_SUCCESS;
+    }
+
+    void releaseInterface (int interfaceNumber) noexcept
+    {
+        std::unique_lock<std::mutex> lock (claimedInterfacesMutex);
+        const auto iter {claimedInterfaces.find (interfaceNumber)};
+
+        // you can't release an interface that hasn't been claimed!
+        jassert (iter != claimedInterfaces.end());
+
+        if (iter != claimedInterfaces.end() && --iter->second == 0)
+        {
+            getLibUsbBackend().releaseInterface (getHandle(), interfaceNumber);
+            claimedInterfaces.erase (iter);
+        }
+    }
+
+    /** Closes the handle if nothing has taken a lease since it went idle. */
+    void closeIfIdle() noexcept
+    {
+        std::unique_lock<std::mutex> lock (handleMutex);
+
+        if (numLeases == 0)
+            closeHandle();
     }
 
     libusb_device* device = nullptr;
+
+    /** Counts every transfer made by the device's streams. */
+    LibUsbTransferCounters transferCounters {nullptr, getDeviceKey (device)};
+
+    /** The index of the active configuration in the descriptor tree, or -1
+        if the device isn't configured, read from the device the first time
+        it's needed. It's forgotten when this module may have changed the
+        configuration, by opening the device or sending SET_CONFIGURATION.
+     */
+    static constexpr int activeConfigurationUnknown {-2};
+    std::atomic<int> activeConfigurationIndex {activeConfigurationUnknown};
+
+private:
+    int acquireHandle() noexcept
+    {
+        std::unique_lock<std::mutex> lock (handleMutex);
+
+        if (handle == nullptr)
+        {
+            handleContext = getContextForDevice (device, handleDevice);
+            const auto result {getLibUsbBackend().open (handleDevice, &handle)};
+
+            if (result != LIBUSB_SUCCESS)
+            {
+                getLibUsbBackend().unrefDevice (handleDevice);
+                handleDevice = nullptr;
+                handleContext = nullptr;
+                handle = nullptr;
+                return result;
+            }
+
+            bufferPool = std::make_unique<LibUsbBufferPool> (handle);
+
+            // anything could have changed the configuration while the device
+            // was closed
+            activeConfigurationIndex = activeConfigurationUnknown;
+        }
+
+        ++numLeases;
+        return LIBUSB_SUCCESS;
+    }
+
+    void releaseHandle() noexcept
+    {
+        {
+            std::unique_lock<std::mutex> lock (handleMutex);
+            jassert (numLeases > 0);
+
+            if (--numLeases > 0)
+                return;
+        }
+
+        idleHandleCloser->closeLater (*this);
+    }
+
+    // called with the handle mutex locked, or from the destructor
+    void closeHandle() noexcept
+    {
+        if (handle == nullptr)
+            return;
+
+        // device memory has to be freed before the handle is closed
+        bufferPool.reset();
+
+        getLibUsbBackend().close (handle);
+        getLibUsbBackend().unrefDevice (handleDevice);
+
+        handle = nullptr;
+        handleDevice = nullptr;
+        handleContext = nullptr;
+    }
+
+    // the handle may be opened in another context than the one the device
+    // was found in, in which case the device is the same one in that context
     libusb_device_handle* handle = nullptr;
+    libusb_device* handleDevice = nullptr;
+    std::shared_ptr<LibUsbContext> handleContext;
+    std::unique_ptr<LibUsbBufferPool> bufferPool;
+    std::atomic<int> numLeases {0};
+    std::mutex handleMutex;
+
+    std::unordered_map<int, int> claimedInterfaces;
+    std::mutex claimedInterfacesMutex;
+
+    juce::SharedResourcePointer<LibUsbIdleHandleCloser> idleHandleCloser;
+};
+
+//==============================================================================
+void LibUsbIdleHandleCloser::run()
+{
+    while ( ! threadShouldExit())
+    {
+        auto waitMs {-1};
+
+        {
+            std::unique_lock<std::mutex> lock (mutex);
+            const auto now {juce::Time::getHighResolutionTicks()};
+
+            // devices are closed with the lock held, so a device can't be
+            // deleted part way through being closed
+            for (auto iter {closeTimes.begin()}; iter != closeTimes.end();)
+            {
+                if (iter->second <= now)
+                {
+                    iter->first->closeIfIdle();
+                    iter = closeTimes.erase (iter);
+                    continue;
+                }
+
+                const auto msUntilClose {1 + (int) (juce::Time::highResolutionTicksToSeconds (iter->second - now) * 1000.0)};
+                waitMs = waitMs < 0 ? msUntilClose : juce::jmin (waitMs, msUntilClose);
+                ++iter;
+            }
+        }
+
+        wait (waitMs);
+    }
+}
+
+//==============================================================================
+struct LibUsbClaimedInterface
+{
+    LibUsbClaimedInterface (LibUsbDevice& deviceToClaim, int interfaceToClaim)
+        : device (deviceToClaim)
+        , lease (deviceToClaim)
+        , interfaceNumber (interfaceToClaim)
+    {
+        throwOnLibUsbError (lease.getResult());
+        throwOnLibUsbError (device.claimInterface (interfaceNumber));
+    }
+
+    ~LibUsbClaimedInterface() noexcept
+    {
+        device.releaseInterface (interfaceNumber);
+    }
+
+    LibUsbDevice& device;
+
+    // the device stays open for as long as the interface is claimed
+    const LibUsbDevice::Lease lease;
+    const int interfaceNumber;
+
+    JUCE_DECLARE_NON_COPYABLE (LibUsbClaimedInterface)
+};
+
+//==============================================================================
+/** Returns the SuperSpeed endpoint companion descriptor of an endpoint, or
+    nullptr if it doesn't have one.
+
+    The companion descriptor follows the endpoint descriptor, so it's found in
+    the extra bytes without asking libusb.
+ */
+const uint8_t* findSuperSpeedCompanion (const libusb_endpoint_descriptor& endpoint) noexcept
+{
+    for (auto offset {0}; offset + 1 < endpoint.extra_length;)
+    {
+        const auto* extra {endpoint.extra + offset};
+        const auto length {(int) extra[0]};
+
+        if (length < 2)
+            break;
+
+        if (extra[1] == LIBUSB_DT_SS_ENDPOINT_COMPANION && length >= LIBUSB_DT_SS_ENDPOINT_COMPANION_SIZE
+            && offset + length <= endpoint.extra_length)
+        {
+            return extra;
+        }
+
+        offset += length;
+    }
+
+    return nullptr;
+}
+
+int getMaxBytesPerInterval (const libusb_endpoint_descriptor& endpoint, libusb_speed speed) noexcept
+{
+    const auto transferType {endpoint.bmAttributes & LIBUSB_TRANSFER_TYPE_MASK};
+    const auto isPeriodic {transferType == LIBUSB_ENDPOINT_TRANSFER_TYPE_ISOCHRONOUS
+                        || transferType == LIBUSB_ENDPOINT_TRANSFER_TYPE_INTERRUPT};
+
+    if (isPeriodic && (speed == LIBUSB_SPEED_SUPER || speed == LIBUSB_SPEED_SUPER_PLUS))
+    {
+        if (const auto* companion = findSuperSpeedCompanion (endpoint))
+            return companion[4] | (companion[5] << 8);
+    }
+
+    // bits 11 and 12 hold the number of additional transactions per microframe
+    const auto packetSize {endpoint.wMaxPacketSize & 0x7ff};
+    const auto numTransactions {1 + ((endpoint.wMaxPacketSize >> 11) & 0x03)};
+    return packetSize * numTransactions;
+}
+
+/** Returns the log2 of the number of streams a SuperSpeed bulk endpoint
+    supports, zero meaning it doesn't support streams.
+ */
+int getMaxBulkStreamsExponent (const libusb_endpoint_descriptor& endpoint, libusb_speed speed) noexcept
+{
+    if ((endpoint.bmAttributes & LIBUSB_TRANSFER_TYPE_MASK) != LIBUSB_ENDPOINT_TRANSFER_TYPE_BULK
+        || (speed != LIBUSB_SPEED_SUPER && speed != LIBUSB_SPEED_SUPER_PLUS))
+    {
+        return 0;
+    }
+
+    // bits 0 to 4 of the companion's attributes hold the exponent
+    const auto* companion = findSuperSpeedCompanion (endpoint);
+    return companion != nullptr ? (companion[3] & 0x1f) : 0;
+}
+
+//==============================================================================
+/** Every configuration, interface, alternate setting and endpoint of a device
+    parsed once into a single block of memory.
+
+    Each level is a flat array of small records that refer to their children by
+    the index of the first child and the number of children, so walking the
+    tree never chases pointers around the heap.
+ */
+class USBDevice::DescriptorTree
+{
+public:
+    struct ConfigurationRecord
+    {
+        uint8_t configurationValue;
+        uint8_t attributes;
+        uint16_t milliampsRequired;
+        uint16_t firstInterface;
+        uint16_t numInterfaces;
+    };
+
+    struct InterfaceRecord
+    {
+        uint8_t interfaceNumber;
+        uint8_t reserved;
+        uint16_t firstAlternateSetting;
+        uint16_t numAlternateSettings;
+    };
+
+    struct AlternateSettingRecord
+    {
+        uint8_t interfaceNumber;
+        uint8_t alternateSetting;
+        uint8_t interfaceClass;
+        uint8_t interfaceSubclass;
+        uint8_t interfaceProtocol;
+        uint8_t reserved;
+        uint16_t firstEndpoint;
+        uint16_t numEndpoints;
+    };
+
+    struct EndpointRecord
+    {
+        uint8_t address;
+        uint8_t attributes;
+        uint8_t interval;
+        uint8_t maxBulkStreamsExponent;
+        uint16_t maxPacketSize;
+        uint16_t maxBytesPerInterval;
+    };
+
+    DescriptorTree (libusb_device* device, libusb_speed speed, int numConfigurationsToRead) noexcept
+    {
+        juce::OwnedArray<LibUsbConfig> configs;
+
+        for (auto index {0}; index < numConfigurationsToRead; ++index)
+        {
+            auto config {std::make_unique<LibUsbConfig> (device, index)};
+
+            if (config->descriptor != nullptr)
+                configs.add (std::move (config));
+        }
+
+        // count everything first so the arena can be allocated in one go
+        for (const auto* config : configs)
+        {
+            numInterfaces += config->descriptor->bNumInterfaces;
+
+            for (auto interfaceIndex {0}; interfaceIndex < config->descriptor->bNumInterfaces; ++interfaceIndex)
+            {
+                const auto& usbInterface = config->descriptor->interface[interfaceIndex];
+                numAlternateSettings += usbInterface.num_altsetting;
+
+                for (auto altIndex {0}; altIndex < usbInterface.num_altsetting; ++altIndex)
+                    numEndpoints += usbInterface.altsetting[altIndex].bNumEndpoints;
+            }
+        }
+
+        numConfigurations = configs.size();
+        allocateArena();
+
+        auto interfaceIndex {0};
+        auto altSettingIndex {0};
+        auto endpointIndex {0};
+
+        for (auto configIndex {0}; configIndex < numConfigurations; ++configIndex)
+        {
+            const auto& config = *configs[configIndex]->descriptor;
+
+            configurations[configIndex] = { config.bConfigurationValue,
+                                            config.bmAttributes,
+                                            (uint16_t) (getPowerUnitsFromSpeed (speed) * config.MaxPower),
+                                            (uint16_t) interfaceIndex,
+                                            config.bNumInterfaces };
+
+            for (auto index {0}; index < config.bNumInterfaces; ++index)
+            {
+                const auto& usbInterface = config.interface[index];
+                const auto interfaceNumber {usbInterface.num_altsetting > 0 ? usbInterface.altsetting[0].bInterfaceNumber
+                                                                            : (uint8_t) index};
+
+                interfaces[interfaceIndex++] = { interfaceNumber,
+                                                 0,
+                                                 (uint16_t) altSettingIndex,
+                                                 (uint16_t) usbInterface.num_altsetting };
+
+                for (auto altIndex {0}; altIndex < usbInterface.num_altsetting; ++altIndex)
+                {
+                    const auto& setting = usbInterface.altsetting[altIndex];
+
+                    alternateSettings[altSettingIndex++] = { setting.bInterfaceNumber,
+                                                             setting.bAlternateSetting,
+                                                             setting.bInterfaceClass,
+                                                             setting.bInterfaceSubClass,
+                                                             setting.bInterfaceProtocol,
+                                                             0,
+                                                             (uint16_t) endpointIndex,
+                                                             setting.bNumEndpoints };
+
+                    for (auto index2 {0}; index2 < setting.bNumEndpoints; ++index2)
+                    {
+                        const auto& endpoint = setting.endpoint[index2];
+
+                        endpoints[endpointIndex++] = { endpoint.bEndpointAddress,
+                                                       endpoint.bmAttributes,
+                                                       endpoint.bInterval,
+                                                       (uint8_t) getMaxBulkStreamsExponent (endpoint, speed),
+                                                       (uint16_t) (endpoint.wMaxPacketSize & 0x7ff),
+                                                       (uint16_t) getMaxBytesPerInterval (endpoint, speed) };
+                    }
+                }
+            }
+        }
+    }
+
+    ~DescriptorTree() = default;
+
+    int getNumConfigurations() const noexcept       { return numConfigurations; }
+    int getNumInterfaces() const noexcept           { return numInterfaces; }
+    int getNumAlternateSettings() const noexcept    { return numAlternateSettings; }
+    int getNumEndpoints() const noexcept            { return numEndpoints; }
+
+    const ConfigurationRecord& getConfiguration (int index) const noexcept
+    {
+        jassert (juce::isPositiveAndBelow (index, numConfigurations));
+        return configurations[index];
+    }
+
+    const InterfaceRecord& getInterface (int index) const noexcept
+    {
+        jassert (juce::isPositiveAndBelow (index, numInterfaces));
+        return interfaces[index];
+    }
+
+    const AlternateSettingRecord& getAlternateSetting (int index) const noexcept
+    {
+        jassert (juce::isPositiveAndBelow (index, numAlternateSettings));
+        return alternateSettings[index];
+    }
+
+    const EndpointRecord& getEndpoint (int index) const noexcept
+    {
+        jassert (juce::isPositiveAndBelow (index, numEndpoints));
+        return endpoints[index];
+    }
+
+    /** Returns the index of the configuration with the given value, or -1. */
+    int findConfiguration (int configurationValue) const noexcept
+    {
+        for (auto index {0}; index < numConfigurations; ++index)
+        {
+            if (configurations[index].configurationValue == configurationValue)
+                return index;
+        }
+
+        return -1;
+    }
+
+    /** Returns the index of the interface with the given number in a
+        configuration, or -1.
+     */
+    int findInterface (int configurationIndex, int interfaceNumber) const noexcept
+    {
+        if ( ! juce::isPositiveAndBelow (configurationIndex, numConfigurations))
+            return -1;
+
+        const auto& config = configurations[configurationIndex];
+
+        for (auto index {config.firstInterface}; index < config.firstInterface + config.numInterfaces; ++index)
+        {
+            if (interfaces[index].interfaceNumber == interfaceNumber)
+                return index;
+        }
+
+        return -1;
+    }
+
+    /** Returns the index of the alternate setting with the given value in an
+        interface, or -1.
+     */
+    int findAlternateSetting (int interfaceIndex, int alternateSetting) const noexcept
+    {
+        if ( ! juce::isPositiveAndBelow (interfaceIndex, numInterfaces))
+            return -1;
+
+        const auto& usbInterface = interfaces[interfaceIndex];
+
+        for (auto index {usbInterface.firstAlternateSetting};
+             index < usbInterface.firstAlternateSetting + usbInterface.numAlternateSettings;
+             ++index)
+        {
+            if (alternateSettings[index].alternateSetting == alternateSetting)
+                return index;
+        }
+
+        return -1;
+    }
+
+    /** Returns the index of the endpoint with the given address in an
+        alternate setting, or -1.
+     */
+    int findEndpoint (int alternateSettingIndex, int endpointAddress) const noexcept
+    {
+        if ( ! juce::isPositiveAndBelow (alternateSettingIndex, numAlternateSettings))
+            return -1;
+
+        const auto& setting = alternateSettings[alternateSettingIndex];
+
+        for (auto index {setting.firstEndpoint}; index < setting.firstEndpoint + setting.numEndpoints; ++index)
+        {
+            if (endpoints[index].address == endpointAddress)
+                return index;
+        }
+
+        return -1;
+    }
+
+    /** Returns the index of an endpoint in a configuration, or -1. A negative
+        alternate setting searches every alternate setting of the interface.
+     */
+    int findEndpoint (int configurationIndex,
+                      int interfaceNumber,
+                      int alternateSetting,
+                      int endpointAddress) const noexcept
+    {
+        const auto interfaceIndex {findInterface (configurationIndex, interfaceNumber)};
+
+        if (interfaceIndex < 0)
+            return -1;
+
+        if (alternateSetting >= 0)
+            return findEndpoint (findAlternateSetting (interfaceIndex, alternateSetting), endpointAddress);
+
+        const auto& usbInterface = interfaces[interfaceIndex];
+
+        for (auto index {usbInterface.firstAlternateSetting};
+             index < usbInterface.firstAlternateSetting + usbInterface.numAlternateSettings;
+             ++index)
+        {
+            const auto endpointIndex {findEndpoint (index, endpointAddress)};
+
+            if (endpointIndex >= 0)
+                return endpointIndex;
+        }
+
+        return -1;
+    }
+
+private:
+    void allocateArena() noexcept
+    {
+        const auto alignUp = [] (size_t offset, size_t alignment)
+        {
+            return (offset + alignment - 1) & ~(alignment - 1);
+        };
+
+        const auto interfacesOffset {alignUp (sizeof (ConfigurationRecord) * (size_t) numConfigurations,
+                                              alignof (InterfaceRecord))};
+
+        const auto alternateSettingsOffset {alignUp (interfacesOffset + sizeof (InterfaceRecord) * (size_t) numInterfaces,
+                                                     alignof (AlternateSettingRecord))};
+
+        const auto endpointsOffset {alignUp (alternateSettingsOffset + sizeof (AlternateSettingRecord) * (size_t) numAlternateSettings,
+                                             alignof (EndpointRecord))};
+
+        const auto arenaSize {endpointsOffset + sizeof (EndpointRecord) * (size_t) numEndpoints};
+
+        arena.calloc (juce::jmax ((size_t) 1, arenaSize));
+
+        configurations    = reinterpret_cast<ConfigurationRecord*> (arena.get());
+        interfaces        = reinterpret_cast<InterfaceRecord*> (arena.get() + interfacesOffset);
+        alternateSettings = reinterpret_cast<AlternateSettingRecord*> (arena.get() + alternateSettingsOffset);
+        endpoints         = reinterpret_cast<EndpointRecord*> (arena.get() + endpointsOffset);
+    }
+
+    juce::HeapBlock<char> arena;
+
+    ConfigurationRecord* configurations {nullptr};
+    InterfaceRecord* interfaces {nullptr};
+    AlternateSettingRecord* alternateSettings {nullptr};
+    EndpointRecord* endpoints {nullptr};
+
+    int numConfigurations {0};
+    int numInterfaces {0};
+    int numAlternateSettings {0};
+    int numEndpoints {0};
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (DescriptorTree)
 };
 
 //==============================================================================
@@ -98,46 +812,258 @@ public:
 
     Pimpl (libusb_device* device) noexcept
         : LibUsbDevice (device)
+        , key (getDeviceKey (device))
         , descriptor (getDeviceDescriptor (device))
-        , speed ((libusb_speed) libusb_get_device_speed (device))
-        , manufacturerName (getDescriptorString (handle, descriptor.iManufacturer))
-        , productName (getDescriptorString (handle, descriptor.iProduct))
-        , serialNumber (getDescriptorString (handle, descriptor.iSerialNumber))
+        , speed ((libusb_speed) getLibUsbBackend().getDeviceSpeed (device))
+        , descriptorTree (std::make_shared<DescriptorTree> (device, speed, descriptor.bNumConfigurations))
+    {
+
+    }
+
+    using DescriptorStrings = LibUsbDescriptorStrings;
+
+    /** Returns the string descriptors, reading them from the device if they
+        haven't been read or primed from the cache yet. Any other threads
+        calling this in the meantime will wait for the first read to finish.
+     */
+    std::shared_ptr<const DescriptorStrings> getDescriptorStrings() noexcept
+    {
+        if (const auto strings {std::atomic_load (&descriptorStrings)})
+            return strings;
+
+        std::call_once (descriptorStringsRead, [this] { readDescriptorStrings(); });
+        return std::atomic_load (&descriptorStrings);
+    }
+
+    /** Reads the string descriptors from the device, replacing any that were
+        primed from the cache. If the device can't be opened any primed
+        strings are kept. Returns true if the strings were read.
+     */
+    bool readDescriptorStrings() noexcept
+    {
+        const Lease lease {*this};
+        const auto deviceHandle {lease.getHandle()};
+
+        if (deviceHandle == nullptr && std::atomic_load (&descriptorStrings) != nullptr)
+            return false;
+
+        auto strings {std::make_shared<DescriptorStrings>()};
+        strings->manufacturerName = getDescriptorString (deviceHandle, descriptor.iManufacturer);
+        strings->productName      = getDescriptorString (deviceHandle, descriptor.iProduct);
+        strings->serialNumber     = getDescriptorString (deviceHandle, descriptor.iSerialNumber);
+
+        std::atomic_store (&descriptorStrings, std::shared_ptr<const DescriptorStrings> (std::move (strings)));
+        return deviceHandle != nullptr;
+    }
+
+    /** Makes strings from an earlier run available without talking to the
+        device, does nothing if the strings are already available.
+     */
+    void primeDescriptorStrings (const DescriptorStrings& strings) noexcept
     {
+        auto primedStrings {std::make_shared<DescriptorStrings> (strings)};
+        primedStrings->provisional = true;
 
+        std::shared_ptr<const DescriptorStrings> expected {};
+        std::atomic_compare_exchange_strong (&descriptorStrings,
+                                             &expected,
+                                             std::shared_ptr<const DescriptorStrings> (std::move (primedStrings)));
+    }
+
+    bool areDescriptorStringsAvailable() const noexcept
+    {
+        return std::atomic_load (&descriptorStrings) != nullptr;
+    }
+
+    bool areDescriptorStringsProvisional() const noexcept
+    {
+        const auto strings {std::atomic_load (&descriptorStrings)};
+        return strings != nullptr && strings->provisional;
     }
 
+    const juce::uint64 key {0};
+
     const libusb_device_descriptor descriptor {};
 
     const libusb_speed speed {LIBUSB_SPEED_UNKNOWN};
 
-    const juce::String manufacturerName {};
-    const juce::String productName {};
-    const juce::String serialNumber {};
+    // the descriptors never change so they're read once when the device is
+    // found, copying a USBDevice is then no more than copying a pointer
+    const std::shared_ptr<const DescriptorTree> descriptorTree;
+
+    /** Returns the index of the active configuration in the descriptor tree,
+        or -1 if the device isn't configured.
+     */
+    int getActiveConfigurationIndex() noexcept
+    {
+        const auto cachedIndex {activeConfigurationIndex.load()};
+
+        if (cachedIndex != activeConfigurationUnknown)
+            return cachedIndex;
+
+        const LibUsbConfig activeConfig {device};
+
+        // reading the configuration can mean asking the device on some
+        // platforms, so being unconfigured is remembered as well, until the
+        // device is opened or sent SET_CONFIGURATION
+        const auto index {activeConfig.descriptor != nullptr
+                              ? descriptorTree->findConfiguration (activeConfig.descriptor->bConfigurationValue)
+                              : -1};
+
+        auto expected {activeConfigurationUnknown};
+        activeConfigurationIndex.compare_exchange_strong (expected, index);
+
+        return index;
+    }
+
+    /** Returns the index of an endpoint of the active configuration in the
+        descriptor tree, or -1. A negative alternate setting searches every
+        alternate setting of the interface.
+     */
+    int findActiveEndpoint (int interfaceNumber, int alternateSetting, int endpointAddress) noexcept
+    {
+        return descriptorTree->findEndpoint (getActiveConfigurationIndex(),
+                                             interfaceNumber,
+                                             alternateSetting,
+                                             endpointAddress);
+    }
+
+private:
+    std::shared_ptr<const DescriptorStrings> descriptorStrings;
+    std::once_flag descriptorStringsRead;
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (Pimpl)
 };
 
 //==============================================================================
-class USBDevice::Configuration::Pimpl : public LibUsbConfig
+/** One asynchronous control transfer, which deletes itself once it has
+    called back.
+
+    The device is kept alive, and events are handled, for as long as the
+    transfer is in flight.
+ */
+class LibUsbControlTransfer
 {
 public:
-    Pimpl() = default;
-    ~Pimpl() = default;
+    static void submit (const std::shared_ptr<LibUsbDevice>& device,
+                        const USBDevice::ControlRequest& request,
+                        USBDevice::ControlCallback callback) noexcept
+    {
+        const auto fail = [&callback] (int result)
+        {
+            USBDevice::ControlResult controlResult {};
+            controlResult.error = getLibUsbErrorString (result);
+
+            if (callback != nullptr)
+                callback (controlResult);
+        };
+
+        const auto input {(request.requestType & LIBUSB_ENDPOINT_DIR_MASK) == LIBUSB_ENDPOINT_IN};
+        const auto length {input ? request.length : (int) request.data.getSize()};
+
+        if (length < 0 || length > 0xffff)
+            return fail (LIBUSB_ERROR_INVALID_PARAM);
+
+        // opens the device, while this is held the transfer's own lease can't fail
+        const LibUsbDevice::Lease lease {*device};
+
+        if (lease.getResult() != LIBUSB_SUCCESS)
+            return fail (lease.getResult());
+
+        std::unique_ptr<LibUsbControlTransfer> controlTransfer;
+
+        try
+        {
+            controlTransfer.reset (new LibUsbControlTransfer (device, LIBUSB_CONTROL_SETUP_SIZE + length));
+        }
+        catch (const std::exception&)
+        {
+            return fail (LIBUSB_ERROR_NO_MEM);
+        }
+
+        auto& usbTransfer = controlTransfer->usbTransfer;
+        auto* buffer = usbTransfer.buffer.getData();
+
+        libusb_fill_control_setup (buffer,
+                                   (uint8_t) request.requestType,
+                                   (uint8_t) request.request,
+                                   (uint16_t) request.value,
+                                   (uint16_t) request.index,
+                                   (uint16_t) length);
+
+        if ( ! input && length > 0)
+            memcpy (buffer + LIBUSB_CONTROL_SETUP_SIZE, request.data.getData(), (size_t) length);
+
+        libusb_fill_control_transfer (usbTransfer.transfer,
+                                      controlTransfer->lease.getHandle(),
+                                      buffer,
+                                      transferCallback,
+                                      &usbTransfer,
+                                      (unsigned int) juce::jmax (0, request.timeoutMs));
+
+        usbTransfer.owner = controlTransfer.get();
+        controlTransfer->callback = std::move (callback);
+
+        const auto result {usbTransfer.submit (device->transferCounters)};
+
+        if (result != LIBUSB_SUCCESS)
+        {
+            callback = std::move (controlTransfer->callback);
+            return fail (result);
+        }
+
+        // from here on the transfer deletes itself when it completes
+        controlTransfer.release();
+    }
 
-    Pimpl (const USBDevice& device, int index) noexcept
-        : LibUsbConfig (device.pimpl->device, index)
-        , numberOfInterfaces (descriptor->bNumInterfaces)
-        , milliampsRequired (getPowerUnitsFromSpeed (device.pimpl->speed) * descriptor->MaxPower)
-        , description (getDescriptorString (device.pimpl->handle, descriptor->iConfiguration))
+private:
+    LibUsbControlTransfer (const std::shared_ptr<LibUsbDevice>& deviceToUse, int bufferSize)
+        : device (deviceToUse)
+        , lease (*device)
+        , usbTransfer (device->getBufferPool(), bufferSize)
+    {
+        jassert (lease.getResult() == LIBUSB_SUCCESS);
+    }
 
+    static void LIBUSB_CALL transferCallback (libusb_transfer* transfer)
     {
+        auto& usbTransfer = LibUsbTransfer::fromLibUsb (*transfer);
+        std::unique_ptr<LibUsbControlTransfer> controlTransfer {static_cast<LibUsbControlTransfer*> (usbTransfer.owner)};
+        controlTransfer->transferCompleted();
+    }
+
+    void transferCompleted() noexcept
+    {
+        usbTransfer.completed (device->transferCounters);
+
+        const auto& transfer = *usbTransfer.transfer;
+        const auto input {(transfer.buffer[0] & LIBUSB_ENDPOINT_DIR_MASK) == LIBUSB_ENDPOINT_IN};
+
+        const auto setConfiguration {transfer.buffer[0] == ((int) LIBUSB_REQUEST_TYPE_STANDARD | (int) LIBUSB_RECIPIENT_DEVICE)
+                                     && transfer.buffer[1] == LIBUSB_REQUEST_SET_CONFIGURATION};
+
+        if (setConfiguration && transfer.status == LIBUSB_TRANSFER_COMPLETED)
+            device->activeConfigurationIndex = LibUsbDevice::activeConfigurationUnknown;
 
+        USBDevice::ControlResult result {};
+        result.numBytesTransferred = transfer.actual_length;
+
+        if (transfer.status != LIBUSB_TRANSFER_COMPLETED)
+            result.error = getTransferStatusString (transfer.status);
+        else if (input)
+            result.data.append (libusb_control_transfer_get_data (usbTransfer.transfer), (size_t) transfer.actual_length);
+
+        if (callback != nullptr)
+            callback (result);
     }
 
-    const int numberOfInterfaces = 0;
-    const int milliampsRequired = 0;
-    const juce::String description;
+    const std::shared_ptr<LibUsbDevice> device;
+    const LibUsbDevice::Lease lease;
+    USBDevice::ControlCallback callback;
+    LibUsbTransfer usbTransfer;
+    const LibUsbEventHandler eventHandler {lease.getContext()};
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (LibUsbControlTransfer)
 };
 
 //==============================================================================
@@ -146,9 +1072,30 @@ USBDevice::USBDevice (const std::shared_ptr<Pimpl>& pimpl) noexcept
 {
     jassert (pimpl != nullptr);
     jassert (pimpl->device != nullptr);
+}
+
+bool USBDevice::ControlResult::wasOk() const noexcept
+{
+    return error.isEmpty();
+}
+
+void USBDevice::controlTransferAsync (const ControlRequest& request, ControlCallback callback) const noexcept
+{
+    jassert (pimpl != nullptr);
+    LibUsbControlTransfer::submit (pimpl, request, std::move (callback));
+}
+
+std::future<USBDevice::ControlResult> USBDevice::controlTransferAsync (const ControlRequest& request) const noexcept
+{
+    auto promise {std::make_shared<std::promise<ControlResult>>()};
+    auto future {promise->get_future()};
 
-    for (auto index {0}; index < pimpl->descriptor.bNumConfigurations; ++index)
-        configurations.add (Configuration (std::make_shared<USBDevice::Configuration::Pimpl>(*this, index)));
+    controlTransferAsync (request, [promise] (const ControlResult& result)
+    {
+        promise->set_value (result);
+    });
+
+    return future;
 }
 
 bool USBDevice::operator== (const USBDevice& other) const noexcept
@@ -176,40 +1123,64 @@ int USBDevice::getProductId() const noexcept
 juce::String USBDevice::getManufacturerName() const noexcept
 {
     jassert (pimpl != nullptr);
-    return pimpl->manufacturerName;
+    return pimpl->getDescriptorStrings()->manufacturerName;
 }
 
 juce::String USBDevice::getProductName() const noexcept
 {
     jassert (pimpl != nullptr);
-    return pimpl->productName;
+    return pimpl->getDescriptorStrings()->productName;
 }
 
 juce::String USBDevice::getSerialNumber() const noexcept
 {
     jassert (pimpl != nullptr);
-    return pimpl->serialNumber;
+    return pimpl->getDescriptorStrings()->serialNumber;
+}
+
+bool USBDevice::areDescriptorStringsAvailable() const noexcept
+{
+    jassert (pimpl != nullptr);
+    return pimpl->areDescriptorStringsAvailable();
+}
+
+bool USBDevice::areDescriptorStringsProvisional() const noexcept
+{
+    jassert (pimpl != nullptr);
+    return pimpl->areDescriptorStringsProvisional();
+}
+
+juce::uint64 USBDevice::getKey() const noexcept
+{
+    jassert (pimpl != nullptr);
+    return pimpl->key;
 }
 
 int USBDevice::getBusNumber() const noexcept
 {
     jassert (pimpl != nullptr);
     jassert (pimpl->device != nullptr);
-    return libusb_get_bus_number (pimpl->device);
+    return getLibUsbBackend().getBusNumber (pimpl->device);
 }
 
 int USBDevice::getPortNumber() const noexcept
 {
     jassert (pimpl != nullptr);
     jassert (pimpl->device != nullptr);
-    return libusb_get_port_number (pimpl->device);
+    return getLibUsbBackend().getPortNumber (pimpl->device);
+}
+
+USBTransferStatistics USBDevice::getStatistics() const noexcept
+{
+    jassert (pimpl != nullptr);
+    return pimpl->transferCounters.getStatistics();
 }
 
 int USBDevice::getAddress() const noexcept
 {
     jassert (pimpl != nullptr);
     jassert (pimpl->device != nullptr);
-    return libusb_get_device_address (pimpl->device);
+    return getLibUsbBackend().getDeviceAddress (pimpl->device);
 }
 
 juce::String USBDevice::getUSBSpecificationVersionString() const noexcept
@@ -325,19 +1296,25 @@ USBDevice::Configuration USBDevice::getActiveConfiguration() const noexcept
     jassert (pimpl != nullptr);
     jassert (pimpl->device != nullptr);
 
-    const LibUsbConfig activeConfig {pimpl->device};
+    const auto index {pimpl->getActiveConfigurationIndex()};
 
-    for (const auto& config : configurations)
-    {
-        if (activeConfig == *config.pimpl)
-            return config;
-    }
+    if (index < 0)
+        return {};
 
-    return {};
+    return Configuration (pimpl->descriptorTree, index);
 }
 
 juce::Array<USBDevice::Configuration> USBDevice::getConfigurations() const noexcept
 {
+    if (pimpl == nullptr)
+        return {};
+
+    juce::Array<Configuration> configurations;
+    configurations.ensureStorageAllocated (pimpl->descriptorTree->getNumConfigurations());
+
+    for (auto index {0}; index < pimpl->descriptorTree->getNumConfigurations(); ++index)
+        configurations.add (Configuration (pimpl->descriptorTree, index));
+
     return configurations;
 }
 
@@ -348,25 +1325,287 @@ int USBDevice::getCurrentMilliampsRequired() const noexcept
 
 int USBDevice::getMaximumMilliampsRequired() const noexcept
 {
+    if (pimpl == nullptr)
+        return 0;
+
     auto milliamps {0};
 
-    for (const auto& config : getConfigurations())
-        milliamps = juce::jmax (milliamps, config.getMilliampsRequired());
+    for (auto index {0}; index < pimpl->descriptorTree->getNumConfigurations(); ++index)
+        milliamps = juce::jmax (milliamps, Configuration (pimpl->descriptorTree, index).getMilliampsRequired());
 
     return milliamps;
 }
 
+USBDevice::Info USBDevice::getInfo() const noexcept
+{
+    if (pimpl == nullptr)
+        return {};
+
+    Info info {};
+    info.key                        = pimpl->key;
+    info.vendorId                   = pimpl->descriptor.idVendor;
+    info.productId                  = pimpl->descriptor.idProduct;
+    info.deviceClass                = pimpl->descriptor.bDeviceClass;
+    info.usbSpecificationVersion    = pimpl->descriptor.bcdUSB;
+    info.version                    = pimpl->descriptor.bcdDevice;
+    info.speedMbps                  = getSpeedMbps();
+    info.busNumber                  = getBusNumberFromDeviceKey (pimpl->key);
+    info.portNumber                 = getPortNumber();
+    info.address                    = getAddress();
+
+    if (pimpl->areDescriptorStringsAvailable())
+    {
+        const auto strings {pimpl->getDescriptorStrings()};
+        info.manufacturerName       = strings->manufacturerName;
+        info.productName            = strings->productName;
+        info.serialNumber           = strings->serialNumber;
+        info.areDescriptorStringsAvailable = true;
+        info.areDescriptorStringsProvisional = strings->provisional;
+    }
+
+    info.activeConfiguration        = getActiveConfiguration();
+    info.currentMilliampsRequired   = info.activeConfiguration.getMilliampsRequired();
+    info.maximumMilliampsRequired   = getMaximumMilliampsRequired();
+
+    return info;
+}
+
 //==============================================================================
-USBDevice::Configuration::Configuration (const std::shared_ptr<Pimpl>& pimpl) noexcept
-    : pimpl (pimpl)
+USBDevice::Configuration::Configuration (const std::shared_ptr<const DescriptorTree>& descriptorTree,
+                                         int configurationIndex) noexcept
+    : tree (descriptorTree)
+    , index (configurationIndex)
 {
 
 }
 
+bool USBDevice::Configuration::isValid() const noexcept
+{
+    return tree != nullptr;
+}
+
+int USBDevice::Configuration::getConfigurationValue() const noexcept
+{
+    if (tree == nullptr)
+        return 0;
+
+    return tree->getConfiguration (index).configurationValue;
+}
+
 int USBDevice::Configuration::getMilliampsRequired() const noexcept
 {
-    if (pimpl == nullptr)
+    if (tree == nullptr)
+        return 0;
+
+    return tree->getConfiguration (index).milliampsRequired;
+}
+
+int USBDevice::Configuration::getNumInterfaces() const noexcept
+{
+    if (tree == nullptr)
+        return 0;
+
+    return tree->getConfiguration (index).numInterfaces;
+}
+
+USBDevice::Interface USBDevice::Configuration::getInterface (int interfaceIndex) const noexcept
+{
+    if ( ! juce::isPositiveAndBelow (interfaceIndex, getNumInterfaces()))
+        return {};
+
+    return Interface (tree, tree->getConfiguration (index).firstInterface + interfaceIndex);
+}
+
+USBDevice::Interface USBDevice::Configuration::findInterface (int interfaceNumber) const noexcept
+{
+    if (tree == nullptr)
+        return {};
+
+    const auto interfaceIndex {tree->findInterface (index, interfaceNumber)};
+    return interfaceIndex < 0 ? Interface() : Interface (tree, interfaceIndex);
+}
+
+USBDevice::Endpoint USBDevice::Configuration::findEndpoint (int interfaceNumber,
+                                                            int alternateSetting,
+                                                            int endpointAddress) const noexcept
+{
+    if (tree == nullptr)
+        return {};
+
+    const auto endpointIndex {tree->findEndpoint (index, interfaceNumber, alternateSetting, endpointAddress)};
+    return endpointIndex < 0 ? Endpoint() : Endpoint (tree, endpointIndex);
+}
+
+//==============================================================================
+USBDevice::Interface::Interface (const std::shared_ptr<const DescriptorTree>& descriptorTree,
+                                 int interfaceIndex) noexcept
+    : tree (descriptorTree)
+    , index (interfaceIndex)
+{
+
+}
+
+bool USBDevice::Interface::isValid() const noexcept
+{
+    return tree != nullptr;
+}
+
+int USBDevice::Interface::getInterfaceNumber() const noexcept
+{
+    if (tree == nullptr)
         return 0;
 
-    return pimpl->milliampsRequired;
+    return tree->getInterface (index).interfaceNumber;
+}
+
+int USBDevice::Interface::getNumAlternateSettings() const noexcept
+{
+    if (tree == nullptr)
+        return 0;
+
+    return tree->getInterface (index).numAlternateSettings;
+}
+
+USBDevice::AlternateSetting USBDevice::Interface::getAlternateSettingAtIndex (int settingIndex) const noexcept
+{
+    if ( ! juce::isPositiveAndBelow (settingIndex, getNumAlternateSettings()))
+        return {};
+
+    return AlternateSetting (tree, tree->getInterface (index).firstAlternateSetting + settingIndex);
+}
+
+USBDevice::AlternateSetting USBDevice::Interface::findAlternateSetting (int alternateSetting) const noexcept
+{
+    if (tree == nullptr)
+        return {};
+
+    const auto settingIndex {tree->findAlternateSetting (index, alternateSetting)};
+    return settingIndex < 0 ? AlternateSetting() : AlternateSetting (tree, settingIndex);
+}
+
+//==============================================================================
+USBDevice::AlternateSetting::AlternateSetting (const std::shared_ptr<const DescriptorTree>& descriptorTree,
+                                               int settingIndex) noexcept
+    : tree (descriptorTree)
+    , index (settingIndex)
+{
+
+}
+
+bool USBDevice::AlternateSetting::isValid() const noexcept
+{
+    return tree != nullptr;
+}
+
+int USBDevice::AlternateSetting::getInterfaceNumber() const noexcept
+{
+    return tree != nullptr ? tree->getAlternateSetting (index).interfaceNumber : 0;
+}
+
+int USBDevice::AlternateSetting::getAlternateSetting() const noexcept
+{
+    return tree != nullptr ? tree->getAlternateSetting (index).alternateSetting : 0;
+}
+
+int USBDevice::AlternateSetting::getInterfaceClass() const noexcept
+{
+    return tree != nullptr ? tree->getAlternateSetting (index).interfaceClass : 0;
+}
+
+int USBDevice::AlternateSetting::getInterfaceSubclass() const noexcept
+{
+    return tree != nullptr ? tree->getAlternateSetting (index).interfaceSubclass : 0;
+}
+
+int USBDevice::AlternateSetting::getInterfaceProtocol() const noexcept
+{
+    return tree != nullptr ? tree->getAlternateSetting (index).interfaceProtocol : 0;
+}
+
+int USBDevice::AlternateSetting::getNumEndpoints() const noexcept
+{
+    return tree != nullptr ? tree->getAlternateSetting (index).numEndpoints : 0;
+}
+
+USBDevice::Endpoint USBDevice::AlternateSetting::getEndpoint (int endpointIndex) const noexcept
+{
+    if ( ! juce::isPositiveAndBelow (endpointIndex, getNumEndpoints()))
+        return {};
+
+    return Endpoint (tree, tree->getAlternateSetting (index).firstEndpoint + endpointIndex);
+}
+
+USBDevice::Endpoint USBDevice::AlternateSetting::findEndpoint (int endpointAddress) const noexcept
+{
+    if (tree == nullptr)
+        return {};
+
+    const auto endpointIndex {tree->findEndpoint (index, endpointAddress)};
+    return endpointIndex < 0 ? Endpoint() : Endpoint (tree, endpointIndex);
+}
+
+//==============================================================================
+USBDevice::Endpoint::Endpoint (const std::shared_ptr<const DescriptorTree>& descriptorTree,
+                               int endpointIndex) noexcept
+    : tree (descriptorTree)
+    , index (endpointIndex)
+{
+
+}
+
+bool USBDevice::Endpoint::isValid() const noexcept
+{
+    return tree != nullptr;
+}
+
+int USBDevice::Endpoint::getAddress() const noexcept
+{
+    return tree != nullptr ? tree->getEndpoint (index).address : 0;
+}
+
+bool USBDevice::Endpoint::isInput() const noexcept
+{
+    return (getAddress() & LIBUSB_ENDPOINT_DIR_MASK) == LIBUSB_ENDPOINT_IN;
+}
+
+USBDevice::Endpoint::TransferType USBDevice::Endpoint::getTransferType() const noexcept
+{
+    if (tree == nullptr)
+        return TransferType::control;
+
+    switch (tree->getEndpoint (index).attributes & LIBUSB_TRANSFER_TYPE_MASK)
+    {
+        case LIBUSB_ENDPOINT_TRANSFER_TYPE_ISOCHRONOUS:
+            return TransferType::isochronous;
+
+        case LIBUSB_ENDPOINT_TRANSFER_TYPE_BULK:
+            return TransferType::bulk;
+
+        case LIBUSB_ENDPOINT_TRANSFER_TYPE_INTERRUPT:
+            return TransferType::interrupt;
+
+        default:
+            return TransferType::control;
+    }
+}
+
+int USBDevice::Endpoint::getMaxPacketSize() const noexcept
+{
+    return tree != nullptr ? tree->getEndpoint (index).maxPacketSize : 0;
+}
+
+int USBDevice::Endpoint::getMaxBytesPerInterval() const noexcept
+{
+    return tree != nullptr ? tree->getEndpoint (index).maxBytesPerInterval : 0;
+}
+
+int USBDevice::Endpoint::getMaxBulkStreams() const noexcept
+{
+    const auto exponent {tree != nullptr ? (int) tree->getEndpoint (index).maxBulkStreamsExponent : 0};
+    return exponent > 0 ? 1 << exponent : 0;
+}
+
+int USBDevice::Endpoint::getInterval() const noexcept
+{
+    return tree != nullptr ? tree->getEndpoint (index).interval : 0;
 }
@@ -3,6 +3,8 @@
 
 class USBDevice
 {
+    class DescriptorTree;
+
 public:
     /** Default constructor. */
     USBDevice() = default;
@@ -22,15 +24,52 @@ public:
     /** Returns the Product ID. */
     int getProductId() const noexcept;
 
-    /** Returns the manufacturer name. */
+    /** Returns the manufacturer name.
+
+        The descriptor strings are read from the device the first time any of
+        them is asked for, unless the USBDeviceManager has already fetched
+        them in the background or found them in its descriptor cache, so this
+        may block while the device responds.
+
+        @see areDescriptorStringsAvailable
+     */
     juce::String getManufacturerName() const noexcept;
 
-    /** Returns the product name. */
+    /** Returns the product name.
+
+        @see getManufacturerName, areDescriptorStringsAvailable
+     */
     juce::String getProductName() const noexcept;
 
-    /** Returns the serial number. */
+    /** Returns the serial number.
+
+        A serial number from the descriptor cache may belong to a different
+        unit of the same product that was last plugged in at the same
+        location, so check areDescriptorStringsProvisional() before using it
+        to tell units apart.
+
+        @see getManufacturerName, areDescriptorStringsAvailable
+     */
     juce::String getSerialNumber() const noexcept;
 
+    /** Returns true if the manufacturer name, product name and serial number
+        have been read from the device or found in the descriptor cache,
+        meaning they can be retrieved without blocking.
+
+        @see areDescriptorStringsProvisional
+     */
+    bool areDescriptorStringsAvailable() const noexcept;
+
+    /** Returns true if the descriptor strings came from the descriptor cache
+        and haven't been read from the device yet.
+
+        The cache remembers strings by location, so until the device has been
+        read these may describe a different unit of the same product,
+        particularly its serial number. The USBDeviceManager reads every device
+        in the background and replaces them once it has.
+     */
+    bool areDescriptorStringsProvisional() const noexcept;
+
     /** Retruns the USB specification version number as a binary-coded decimal
 
         A value of 0x0200 indicates USB 2.0, 0x0110 indicates USB 1.1, etc
@@ -64,6 +103,16 @@ public:
     /** Returns the negotiated connection speed as a string. */
     juce::String getSpeedString() const noexcept;
 
+    /** Returns a compact identifier for this device, made up of its bus
+        number, port path and address.
+
+        The key is unique amongst the currently connected devices and changes
+        if the device is reconnected.
+
+        @see USBDeviceManager::getDeviceByKey
+     */
+    juce::uint64 getKey() const noexcept;
+
     /** Returns a unique identifier for this device for the bus it is on. */
     int getAddress() const noexcept;
 
@@ -73,6 +122,172 @@ public:
     /** Returns the port number the device is connected to on the bus. */
     int getPortNumber() const noexcept;
 
+    /** Returns the statistics of every transfer made to or from this device
+        by any stream, this never blocks.
+
+        @see USBEndpointStream::getStatistics, USBInterruptStream::getStatistics,
+             USBIsochronousStream::getStatistics
+     */
+    USBTransferStatistics getStatistics() const noexcept;
+
+    class Configuration;
+    class Interface;
+    class AlternateSetting;
+
+    //==============================================================================
+    /** An endpoint of an alternate setting.
+
+        This and the other descriptor classes are views into descriptors that
+        are read once when the device is found, so they're cheap to copy and
+        asking for them never talks to the device.
+     */
+    class Endpoint
+    {
+    public:
+        /** Default constructor. */
+        Endpoint() = default;
+
+        /** Destructor. */
+        ~Endpoint() = default;
+
+        enum class TransferType
+        {
+            control,
+            isochronous,
+            bulk,
+            interrupt
+        };
+
+        /** Returns false for a default constructed Endpoint. */
+        bool isValid() const noexcept;
+
+        /** Returns the endpoint address, including the direction bit. */
+        int getAddress() const noexcept;
+
+        /** Returns true if data flows from the device to the host. */
+        bool isInput() const noexcept;
+
+        /** Returns the type of transfer the endpoint is used for. */
+        TransferType getTransferType() const noexcept;
+
+        /** Returns the largest packet the endpoint can send or receive in one
+            transaction.
+         */
+        int getMaxPacketSize() const noexcept;
+
+        /** Returns the most bytes the endpoint can move in one service
+            interval, taking high bandwidth and SuperSpeed bursts into account.
+         */
+        int getMaxBytesPerInterval() const noexcept;
+
+        /** Returns the number of SuperSpeed bulk streams the endpoint
+            supports, or zero if it doesn't support streams.
+         */
+        int getMaxBulkStreams() const noexcept;
+
+        /** Returns the polling interval as encoded in the descriptor. */
+        int getInterval() const noexcept;
+
+    private:
+        friend class USBDevice;
+        friend class AlternateSetting;
+        friend class Configuration;
+
+        std::shared_ptr<const DescriptorTree> tree;
+        int index {-1};
+
+        /** Internal constructor. */
+        Endpoint (const std::shared_ptr<const DescriptorTree>& tree, int index) noexcept;
+    };
+
+    //==============================================================================
+    /** One alternate setting of an interface. */
+    class AlternateSetting
+    {
+    public:
+        /** Default constructor. */
+        AlternateSetting() = default;
+
+        /** Destructor. */
+        ~AlternateSetting() = default;
+
+        /** Returns false for a default constructed AlternateSetting. */
+        bool isValid() const noexcept;
+
+        /** Returns the number of the interface this setting belongs to. */
+        int getInterfaceNumber() const noexcept;
+
+        /** Returns the value used to select this setting. */
+        int getAlternateSetting() const noexcept;
+
+        /** Returns the USB-IF class, subclass and protocol codes. */
+        int getInterfaceClass() const noexcept;
+        int getInterfaceSubclass() const noexcept;
+        int getInterfaceProtocol() const noexcept;
+
+        /** Returns the number of endpoints, not including endpoint zero. */
+        int getNumEndpoints() const noexcept;
+
+        /** Returns the endpoint at the given index. */
+        Endpoint getEndpoint (int index) const noexcept;
+
+        /** Returns the endpoint with the given address, or an invalid Endpoint
+            if there isn't one.
+         */
+        Endpoint findEndpoint (int endpointAddress) const noexcept;
+
+    private:
+        friend class USBDevice;
+        friend class Interface;
+        friend class Configuration;
+
+        std::shared_ptr<const DescriptorTree> tree;
+        int index {-1};
+
+        /** Internal constructor. */
+        AlternateSetting (const std::shared_ptr<const DescriptorTree>& tree, int index) noexcept;
+    };
+
+    //==============================================================================
+    /** An interface and its alternate settings. */
+    class Interface
+    {
+    public:
+        /** Default constructor. */
+        Interface() = default;
+
+        /** Destructor. */
+        ~Interface() = default;
+
+        /** Returns false for a default constructed Interface. */
+        bool isValid() const noexcept;
+
+        /** Returns the interface number. */
+        int getInterfaceNumber() const noexcept;
+
+        /** Returns the number of alternate settings. */
+        int getNumAlternateSettings() const noexcept;
+
+        /** Returns the alternate setting at the given index. */
+        AlternateSetting getAlternateSettingAtIndex (int index) const noexcept;
+
+        /** Returns the alternate setting with the given value, or an invalid
+            AlternateSetting if there isn't one.
+         */
+        AlternateSetting findAlternateSetting (int alternateSetting) const noexcept;
+
+    private:
+        friend class USBDevice;
+        friend class Configuration;
+
+        std::shared_ptr<const DescriptorTree> tree;
+        int index {-1};
+
+        /** Internal constructor. */
+        Interface (const std::shared_ptr<const DescriptorTree>& tree, int index) noexcept;
+    };
+
+    //==============================================================================
     class Configuration
     {
     public:
@@ -82,22 +297,50 @@ public:
         /** Destructor. */
         ~Configuration() = default;
 
+        /** Returns false for a default constructed Configuration. */
+        bool isValid() const noexcept;
+
+        /** Returns the value used to select this configuration. */
+        int getConfigurationValue() const noexcept;
+
         /** Returns the maximum power consumption in milliamps based on this
             configuration.
          */
         int getMilliampsRequired() const noexcept;
 
+        /** Returns the number of interfaces. */
+        int getNumInterfaces() const noexcept;
+
+        /** Returns the interface at the given index. */
+        Interface getInterface (int index) const noexcept;
+
+        /** Returns the interface with the given number, or an invalid
+            Interface if there isn't one.
+         */
+        Interface findInterface (int interfaceNumber) const noexcept;
+
+        /** Returns an endpoint of the given interface and alternate setting,
+            or an invalid Endpoint if there isn't one.
+         */
+        Endpoint findEndpoint (int interfaceNumber,
+                               int alternateSetting,
+                               int endpointAddress) const noexcept;
+
     private:
         friend class USBDevice;
 
-        class Pimpl;
-        std::shared_ptr<Pimpl> pimpl;
+        std::shared_ptr<const DescriptorTree> tree;
+        int index {-1};
 
         /** Internal constructor. */
-        Configuration (const std::shared_ptr<Pimpl>& pimpl) noexcept;
+        Configuration (const std::shared_ptr<const DescriptorTree>& tree, int index) noexcept;
     };
 
-    /** Returns the configuration currently in use. */
+    /** Returns the configuration currently in use.
+
+        The configuration is only read from the device the first time this is
+        called, after that it's remembered until it may have changed.
+     */
     Configuration getActiveConfiguration() const noexcept;
 
     /** Returns all possible configurations. */
@@ -113,20 +356,134 @@ public:
      */
     int getMaximumMilliampsRequired() const noexcept;
 
+    //==============================================================================
+    /** Everything commonly shown about a device, gathered in one go. */
+    struct Info
+    {
+        juce::uint64 key {0};
+        int vendorId {0};
+        int productId {0};
+        int deviceClass {0};
+
+        /** The USB specification and device versions, in binary-coded
+            decimal.
+         */
+        int usbSpecificationVersion {0};
+        int version {0};
+
+        float speedMbps {0.f};
+        int busNumber {0};
+        int portNumber {0};
+        int address {0};
+
+        /** The descriptor strings, these are empty if they haven't been read
+            from the device yet.
+         */
+        juce::String manufacturerName;
+        juce::String productName;
+        juce::String serialNumber;
+        bool areDescriptorStringsAvailable {false};
+
+        /** True if the strings came from the descriptor cache and may belong
+            to a different unit, see areDescriptorStringsProvisional().
+         */
+        bool areDescriptorStringsProvisional {false};
+
+        Configuration activeConfiguration;
+        int currentMilliampsRequired {0};
+        int maximumMilliampsRequired {0};
+    };
+
+    /** Returns a snapshot of the device's details.
+
+        This never opens the device. The first call reads the active
+        configuration, which on some platforms means asking the device, so
+        make that call off any thread that mustn't block. After that the
+        configuration, or the device being unconfigured, is remembered until
+        this module opens the device or sends it a SET_CONFIGURATION request.
+        From then on getInfo() is cheap enough to call for every device
+        whenever a UI repaints. A configuration changed outside this module,
+        such as by another process, isn't noticed until then.
+     */
+    Info getInfo() const noexcept;
+
+    //==============================================================================
+    /** A request sent to the device's default control endpoint. */
+    struct ControlRequest
+    {
+        /** The bmRequestType field, when the top bit is set data is read from
+            the device.
+         */
+        int requestType {0};
+
+        /** The bRequest, wValue and wIndex fields. */
+        int request {0};
+        int value {0};
+        int index {0};
+
+        /** The data to send, for requests that write to the device. */
+        juce::MemoryBlock data;
+
+        /** The most bytes to read, for requests that read from the device. */
+        int length {0};
+
+        /** How long to wait for the device, zero waits forever. */
+        int timeoutMs {1000};
+    };
+
+    /** The outcome of a control transfer. */
+    struct ControlResult
+    {
+        /** Returns true if the transfer completed. */
+        bool wasOk() const noexcept;
+
+        /** A description of what went wrong, empty if the transfer completed. */
+        juce::String error;
+
+        /** The data read, for requests that read from the device. */
+        juce::MemoryBlock data;
+
+        /** The number of bytes sent or received. */
+        int numBytesTransferred {0};
+    };
+
+    using ControlCallback = std::function<void (const ControlResult&)>;
+
+    /** Sends a request to the default control endpoint without waiting for
+        the device to respond.
+
+        Any number of requests can be in flight at once, to this and other
+        devices. The callback is called on the libusb event thread once the
+        request completes, so it should return quickly. If the request can't
+        be sent at all, because the device can't be opened for example, the
+        callback is called straight away on the calling thread.
+
+        The device is opened the first time this is called.
+     */
+    void controlTransferAsync (const ControlRequest& request, ControlCallback callback) const noexcept;
+
+    /** Sends a request to the default control endpoint, returning a future
+        that becomes ready once the request completes.
+
+        @see controlTransferAsync
+     */
+    std::future<ControlResult> controlTransferAsync (const ControlRequest& request) const noexcept;
+
     /** Comparison operators */
     bool operator== (const USBDevice& other) const noexcept;
     bool operator!= (const USBDevice& other) const noexcept;
 
 private:
     friend class USBDeviceManager;
+    friend class USBEndpointStream;
+    friend class USBInterruptStream;
+    friend class USBIsochronousStream;
     
     class Pimpl;
     std::shared_ptr<Pimpl> pimpl;
 
     /** Internal constructor. */
     USBDevice (const std::shared_ptr<Pimpl>& pimpl) noexcept;
-
-    juce::Array<Configuration> configurations;
     
     JUCE_LEAK_DETECTOR (USBDevice)
 };
@@ -4,13 +4,13 @@ class LibUsbDevices : private LibUsbUser
 public:
     LibUsbDevices() noexcept
     {
-        const auto numDevices {(int) libusb_get_device_list (getContext(), &deviceList)};
+        const auto numDevices {(int) getLibUsbBackend().getDeviceList (getContext(), &deviceList)};
         devices.addArray (deviceList, numDevices);
     }
 
     ~LibUsbDevices() noexcept
     {
-        libusb_free_device_list (deviceList, true);
+        getLibUsbBackend().freeDeviceList (deviceList, true);
     }
 
     libusb_device* const* begin() const noexcept
@@ -23,11 +23,6 @@ public:
         return devices.end();
     }
 
-    bool contains (libusb_device* device) const
-    {
-        return devices.contains (device);
-    }
-
 private:
     libusb_device** deviceList;
     juce::Array<libusb_device*> devices;
@@ -35,34 +30,277 @@ private:
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (LibUsbDevices)
 };
 
+//==============================================================================
+/** The cheap to read details of a device that filters are matched against,
+    none of which need the device to be opened.
+
+    A device the manager already knows about is matched using its descriptor
+    tree and remembered active configuration, so only a device that hasn't
+    been seen before is asked for its active configuration.
+ */
+struct USBDeviceManager::Filter::Candidate
+{
+    explicit Candidate (libusb_device* deviceToMatch) noexcept
+        : device (deviceToMatch)
+        , key (getDeviceKey (deviceToMatch))
+        , descriptor (getDeviceDescriptor (deviceToMatch))
+    {
+    }
+
+    explicit Candidate (USBDevice::Pimpl& knownDeviceToMatch) noexcept
+        : device (knownDeviceToMatch.device)
+        , key (knownDeviceToMatch.key)
+        , descriptor (knownDeviceToMatch.descriptor)
+        , knownDevice (&knownDeviceToMatch)
+    {
+    }
+
+    bool hasInterfaceClass (int interfaceClass) const noexcept
+    {
+        if (knownDevice != nullptr)
+            return knownDeviceHasInterfaceClass (interfaceClass);
+
+        const LibUsbConfig activeConfig {device};
+
+        if (activeConfig.descriptor == nullptr)
+            return false;
+
+        for (auto interfaceIndex {0}; interfaceIndex < activeConfig.descriptor->bNumInterfaces; ++interfaceIndex)
+        {
+            const auto& usbInterface = activeConfig.descriptor->interface[interfaceIndex];
+
+            for (auto altIndex {0}; altIndex < usbInterface.num_altsetting; ++altIndex)
+            {
+                if (usbInterface.altsetting[altIndex].bInterfaceClass == interfaceClass)
+                    return true;
+            }
+        }
+
+        return false;
+    }
+
+    bool knownDeviceHasInterfaceClass (int interfaceClass) const noexcept
+    {
+        const auto configIndex {knownDevice->getActiveConfigurationIndex()};
+
+        if (configIndex < 0)
+            return false;
+
+        const auto& tree = *knownDevice->descriptorTree;
+        const auto& config = tree.getConfiguration (configIndex);
+
+        for (auto interfaceIndex {config.firstInterface}; interfaceIndex < config.firstInterface + config.numInterfaces; ++interfaceIndex)
+        {
+            const auto& usbInterface = tree.getInterface (interfaceIndex);
+
+            for (auto altIndex {usbInterface.firstAlternateSetting};
+                 altIndex < usbInterface.firstAlternateSetting + usbInterface.numAlternateSettings;
+                 ++altIndex)
+            {
+                if (tree.getAlternateSetting (altIndex).interfaceClass == interfaceClass)
+                    return true;
+            }
+        }
+
+        return false;
+    }
+
+    libusb_device* const device;
+    const juce::uint64 key;
+    const libusb_device_descriptor descriptor;
+    USBDevice::Pimpl* const knownDevice {nullptr};
+};
+
 //==============================================================================
 class USBDeviceManager::Pimpl   : private LibUsbUser
                                 , public juce::HighResolutionTimer
+                                , private juce::Thread
 {
 public:
     Pimpl (USBDeviceManager& manager) noexcept
-        : manager (manager)
+        : juce::Thread ("jucey USB hotplug")
+        , manager (manager)
     {
-        hiResTimerCallback();
     }
     
     ~Pimpl() noexcept
     {
+        stopMonitoring();
+        debounceTimer.stopTimer();
+
+        // reads that haven't started are dropped, but one that's running uses
+        // the cache, so it has to finish before the cache can be saved and
+        // destroyed
+        descriptorStringReaders.removeAllJobs (true, -1);
+        descriptorCache.saveIfNeeded();
+
+        delete publishedSnapshot.load();
+    }
+
+    void startMonitoring (int pollingIntervalMs) noexcept
+    {
+        if (isTimerRunning() || hotplugCallbackRegistered)
+            return;
+
+        // register before scanning so no device can slip between the scan and
+        // the first hotplug event, any duplicates are ignored when processed
+        usingHotplugEvents = registerHotplugCallback();
+        scanDevices();
+
+        if (usingHotplugEvents)
+        {
+            startThread();
+            startHandlingEvents();
+        }
+        else
+        {
+            startTimer (pollingIntervalMs);
+        }
+    }
+
+    void stopMonitoring() noexcept
+    {
+        stopTimer();
+
+        if (hotplugCallbackRegistered)
+        {
+            getLibUsbBackend().hotplugDeregisterCallback (getContext(), hotplugCallbackHandle);
+            hotplugCallbackRegistered = false;
+
+            stopHandlingEvents();
+            signalThreadShouldExit();
+            notify();
+            stopThread (1000);
+
+            for (const auto& event : takePendingHotplugEvents())
+                getLibUsbBackend().unrefDevice (event.device);
+        }
+    }
+
+    bool isUsingHotplugEvents() const noexcept
+    {
+        return usingHotplugEvents;
+    }
+
+    void setEventThreadRealtime (bool shouldBeRealtime, int realtimePriority) noexcept
+    {
+        LibUsbUser::setEventThreadRealtime (shouldBeRealtime, realtimePriority);
+    }
+
+    void setEventThreadSharding (const EventThreadSharding& newSharding) noexcept
+    {
+        LibUsbUser::setEventThreadSharding (newSharding);
+    }
+
+    EventThreadSharding getEventThreadSharding() const noexcept
+    {
+        return LibUsbUser::getEventThreadSharding();
     }
     
-    juce::Array<USBDevice> getDevices() const noexcept
+    void setDescriptorCacheFile (const juce::File& file) noexcept
     {
-        std::unique_lock<std::recursive_mutex> lock (mutex);
-        return devices.get();
+        std::unique_lock<std::recursive_mutex> dispatchLock (dispatchMutex);
+
+        descriptorCache.setFile (file);
+
+        // devices found before the cache was set either get their strings
+        // from it, or put the strings already read into it
+        for (const auto& device : *getSnapshot())
+        {
+            auto& pimpl = *device.pimpl;
+
+            if (pimpl.areDescriptorStringsAvailable())
+                descriptorCache.update (pimpl.key, pimpl.descriptor, *pimpl.getDescriptorStrings());
+            else
+                primeDescriptorStrings (pimpl);
+        }
+
+        descriptorCache.saveIfNeeded();
+    }
+
+    // a reader counts itself in before loading the pointer and out once it
+    // has its own reference, so a replaced snapshot is only let go of when no
+    // reader is in between
+    std::shared_ptr<const Snapshot> getSnapshot() const noexcept
+    {
+        ++numSnapshotReaders;
+        auto currentSnapshot {publishedSnapshot.load()->snapshot};
+        --numSnapshotReaders;
+
+        return currentSnapshot;
+    }
+
+    Changes getChangesSince (juce::uint64 generation) const noexcept
+    {
+        std::unique_lock<std::mutex> lock (historyMutex);
+
+        const auto currentSnapshot {getSnapshot()};
+
+        Changes changes {};
+        changes.fromGeneration = generation;
+        changes.toGeneration = currentSnapshot->getGeneration();
+
+        if (generation >= changes.toGeneration)
+            return changes;
+
+        // the history doesn't go back far enough, so report everything
+        if (history.isEmpty() || history.getFirst().fromGeneration > generation)
+        {
+            changes.arrived = currentSnapshot->getDevices();
+            changes.isComplete = false;
+            return changes;
+        }
+
+        for (const auto& step : history)
+        {
+            if (step.toGeneration <= generation)
+                continue;
+
+            changes.arrived.addArray (step.arrived);
+
+            for (const auto& device : step.removed)
+            {
+                // a device that came and went in the meantime is of no interest
+                if (changes.arrived.contains (device))
+                    changes.arrived.removeFirstMatchingValue (device);
+                else
+                    changes.removed.add (device);
+            }
+        }
+
+        return changes;
     }
     
-    void addListener (Listener& listenerToAdd, bool shouldCallBackWithCurrentDevices) noexcept
+    void setFilters (const juce::Array<Filter>& newFilters) noexcept
     {
-        std::unique_lock<std::recursive_mutex> lock (mutex);
-        
-        if (shouldCallBackWithCurrentDevices)
+        std::unique_lock<std::recursive_mutex> dispatchLock (dispatchMutex);
+        filters = newFilters;
+
+        // devices that no longer match are removed and any that now match are
+        // added, even if hotplug events are in use
+        scanDevices();
+    }
+
+    juce::Array<Filter> getFilters() const noexcept
+    {
+        std::unique_lock<std::recursive_mutex> dispatchLock (dispatchMutex);
+        return filters;
+    }
+
+    void addListener (Listener& listenerToAdd,
+                      bool shouldCallBackWithCurrentDevices,
+                      const juce::Array<Filter>& filtersForListener) noexcept
+    {
+        std::unique_lock<std::recursive_mutex> dispatchLock (dispatchMutex);
+
+        if ( ! filtersForListener.isEmpty())
+            listenerFilterStates[&listenerToAdd].filters = filtersForListener;
+
+        // the current devices are matched even if the listener isn't told
+        // about them, so it's told when they're removed
+        for (auto& device : *getSnapshot())
         {
-            for (auto& device : devices.get())
+            if (listenerWantsArrival (listenerToAdd, device) && shouldCallBackWithCurrentDevices)
                 listenerToAdd.deviceArrived (device);
         }
         
@@ -71,102 +309,511 @@ public:
     
     void removeListener (Listener& listenerToRemove) noexcept
     {
-        std::unique_lock<std::recursive_mutex> lock (mutex);
+        std::unique_lock<std::recursive_mutex> dispatchLock (dispatchMutex);
         listeners.remove (&listenerToRemove);
+        listenerFilterStates.erase (&listenerToRemove);
+    }
+
+    void addBatchListener (BatchListener& listenerToAdd,
+                           bool shouldCallBackWithCurrentDevices,
+                           const juce::Array<Filter>& filtersForListener) noexcept
+    {
+        std::unique_lock<std::recursive_mutex> dispatchLock (dispatchMutex);
+        const auto currentSnapshot {getSnapshot()};
+
+        // the listener only hears about changes after the current snapshot
+        auto& state = batchListenerStates[&listenerToAdd];
+        state.snapshot = currentSnapshot;
+        state.filterState.filters = filtersForListener;
+
+        // the current devices are matched even if the listener isn't told
+        // about them, so it's told when they're removed
+        Changes changes {};
+        changes.toGeneration = currentSnapshot->getGeneration();
+        changes.arrived = currentSnapshot->getDevices();
+
+        state.filterState.filterChanges (changes);
+
+        if (shouldCallBackWithCurrentDevices && ! changes.isEmpty())
+            listenerToAdd.devicesChanged (changes);
+
+        batchListeners.add (&listenerToAdd);
+    }
+
+    void removeBatchListener (BatchListener& listenerToRemove) noexcept
+    {
+        std::unique_lock<std::recursive_mutex> dispatchLock (dispatchMutex);
+        batchListeners.remove (&listenerToRemove);
+        batchListenerStates.erase (&listenerToRemove);
+    }
+
+    int getBatchDebounceMs() const noexcept
+    {
+        return batchDebounceMs;
+    }
+
+    void setBatchDebounceMs (int newBatchDebounceMs) noexcept
+    {
+        batchDebounceMs = juce::jmax (0, newBatchDebounceMs);
     }
     
 private:
-    class Devices
+    struct HotplugEvent
+    {
+        libusb_device* device {nullptr};
+        bool arrived {false};
+    };
+
+    bool registerHotplugCallback() noexcept
     {
-    public:
-        USBDevice addAndReturn (libusb_device* deviceToAdd) noexcept
+        if (getLibUsbBackend().hasCapability (LIBUSB_CAP_HAS_HOTPLUG) == 0)
+            return false;
+
+        const auto result = getLibUsbBackend().hotplugRegisterCallback (getContext(),
+                                                                        LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED
+                                                                            | LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT,
+                                                                        0,
+                                                                        LIBUSB_HOTPLUG_MATCH_ANY,
+                                                                        LIBUSB_HOTPLUG_MATCH_ANY,
+                                                                        LIBUSB_HOTPLUG_MATCH_ANY,
+                                                                        hotplugCallback,
+                                                                        this,
+                                                                        &hotplugCallbackHandle);
+
+        hotplugCallbackRegistered = result == LIBUSB_SUCCESS;
+        return hotplugCallbackRegistered;
+    }
+
+    // called by libusb on the event thread, opening devices and reading their
+    // descriptors from here isn't allowed so the work is handed to run()
+    static int LIBUSB_CALL hotplugCallback (libusb_context*,
+                                            libusb_device* device,
+                                            libusb_hotplug_event event,
+                                            void* userData)
+    {
+        auto& pimpl = *static_cast<Pimpl*> (userData);
+
         {
-            // you shouldn't add a device twice!
-            jassert ( ! contains (deviceToAdd));
+            std::unique_lock<std::mutex> lock (pimpl.pendingHotplugEventsMutex);
+            pimpl.pendingHotplugEvents.add ({getLibUsbBackend().refDevice (device),
+                                             event == LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED});
+        }
+
+        pimpl.notify();
+        return 0;
+    }
 
-            libusbDevices.add (deviceToAdd);
-            devices.add (USBDevice (std::make_shared<USBDevice::Pimpl>(deviceToAdd)));
-            return devices.getLast();
+    juce::Array<HotplugEvent> takePendingHotplugEvents() noexcept
+    {
+        std::unique_lock<std::mutex> lock (pendingHotplugEventsMutex);
+
+        juce::Array<HotplugEvent> events;
+        events.swapWith (pendingHotplugEvents);
+        return events;
+    }
+
+    void run() override
+    {
+        while ( ! threadShouldExit())
+        {
+            wait (-1);
+            processHotplugEvents (takePendingHotplugEvents());
         }
+    }
+
+    void processHotplugEvents (const juce::Array<HotplugEvent>& events)
+    {
+        std::unique_lock<std::recursive_mutex> dispatchLock (dispatchMutex);
+        const auto currentSnapshot {getSnapshot()};
+        Changes changes {};
 
-        USBDevice removeAndReturn (libusb_device* deviceToRemove) noexcept
+        for (const auto& event : events)
         {
-            // you cant remove a device that hasn't been added!
-            jassert (contains (deviceToRemove));
+            const auto key {getDeviceKey (event.device)};
+
+            if (event.arrived)
+            {
+                if ( ! currentSnapshot->contains (key)
+                    && ! containsKey (changes.arrived, key)
+                    && matchesFilters (event.device))
+                {
+                    changes.arrived.add (createDevice (event.device));
+                }
+            }
+            else if (containsKey (changes.arrived, key))
+            {
+                // the device came and went before anyone saw it
+                changes.arrived.removeIf ([key] (const USBDevice& device) { return device.getKey() == key; });
+            }
+            else if (currentSnapshot->contains (key) && ! containsKey (changes.removed, key))
+            {
+                changes.removed.add (currentSnapshot->getDeviceByKey (key));
+            }
 
-            auto device = devices.removeAndReturn (indexOf (deviceToRemove));
-            libusbDevices.remove (&deviceToRemove);
-            return device;
+            getLibUsbBackend().unrefDevice (event.device);
         }
 
-        int indexOf (libusb_device* deviceToFind) const noexcept
+        publish (changes);
+        callListeners (changes);
+    }
+
+    static bool containsKey (const juce::Array<USBDevice>& devices, juce::uint64 key) noexcept
+    {
+        for (const auto& device : devices)
         {
-            jassert (contains (deviceToFind));
-            return libusbDevices.indexOf (deviceToFind);
+            if (device.getKey() == key)
+                return true;
+        }
+
+        return false;
+    }
+
+    USBDevice createDevice (libusb_device* device) noexcept
+    {
+        const auto pimpl {std::make_shared<USBDevice::Pimpl> (device)};
+        primeDescriptorStrings (*pimpl);
+        return USBDevice (pimpl);
+    }
+
+    void primeDescriptorStrings (USBDevice::Pimpl& pimpl) noexcept
+    {
+        LibUsbDescriptorStrings strings {};
+
+        if (descriptorCache.find (pimpl.key, pimpl.descriptor, strings))
+            pimpl.primeDescriptorStrings (strings);
+    }
+
+    // only the thread holding the dispatch mutex publishes snapshots, readers
+    // never wait, they keep seeing the previous snapshot until the new one is
+    // swapped in
+    void publish (Changes& changes) noexcept
+    {
+        if (changes.isEmpty())
+            return;
+
+        {
+            std::unique_lock<std::mutex> lock (historyMutex);
+            const auto currentSnapshot {getSnapshot()};
+
+            changes.fromGeneration = currentSnapshot->getGeneration();
+            changes.toGeneration = changes.fromGeneration + 1;
+
+            auto* nextSnapshot = new PublishedSnapshot {std::shared_ptr<const Snapshot> (new Snapshot (*currentSnapshot, changes))};
+            retiredSnapshots.add (publishedSnapshot.exchange (nextSnapshot));
+
+            // otherwise they're let go of after a later publish
+            if (numSnapshotReaders == 0)
+                retiredSnapshots.clear();
+
+            history.add (changes);
+
+            if (history.size() > maxHistorySize)
+                history.remove (0);
+        }
+
+        for (const auto& device : changes.removed)
+            forgetDeviceInShards (device.getKey());
+
+        // reading the descriptor strings means opening the device and waiting
+        // on several control transfers, doing this for every device at once
+        // means a scan takes about as long as the slowest device. Devices
+        // primed from the cache are read again to keep the cache up to date,
+        // which is saved once all the reads have finished. Devices that were
+        // already read, such as those that start matching the filters again,
+        // aren't read twice
+        for (const auto& device : changes.arrived)
+        {
+            if (hasReadDescriptorStrings (*device.pimpl))
+                continue;
+
+            ++numPendingDescriptorStringReads;
+
+            descriptorStringReaders.addJob ([this, pimpl = device.pimpl]
+            {
+                if ( ! hasReadDescriptorStrings (*pimpl) && pimpl->readDescriptorStrings())
+                    descriptorCache.update (pimpl->key, pimpl->descriptor, *pimpl->getDescriptorStrings());
+
+                if (--numPendingDescriptorStringReads == 0)
+                    descriptorCache.saveIfNeeded();
+            });
         }
+    }
+
+    static bool hasReadDescriptorStrings (const USBDevice::Pimpl& device) noexcept
+    {
+        return device.areDescriptorStringsAvailable() && ! device.areDescriptorStringsProvisional();
+    }
 
-        bool contains (libusb_device* deviceToFind) const noexcept
+    static bool matchesAny (const juce::Array<Filter>& filtersToMatch,
+                            const Filter::Candidate& candidate) noexcept
+    {
+        for (const auto& filter : filtersToMatch)
         {
-            return libusbDevices.contains (deviceToFind);
+            if (filter.matches (candidate))
+                return true;
         }
 
-        libusb_device* const* begin() const noexcept
+        return false;
+    }
+
+    // checked before a device is created so devices that don't match are
+    // never opened
+    bool matchesFilters (libusb_device* device) const noexcept
+    {
+        return filters.isEmpty() || matchesAny (filters, Filter::Candidate (device));
+    }
+
+    bool matchesFilters (USBDevice::Pimpl& device) const noexcept
+    {
+        return filters.isEmpty() || matchesAny (filters, Filter::Candidate (device));
+    }
+
+    /** The filters of a listener and the devices that matched them.
+
+        Filters are only matched when a device arrives, by the time it's
+        removed it may not be able to say what its configuration was. Its
+        removal is reported to the listener if its arrival was.
+     */
+    struct ListenerFilterState
+    {
+        bool deviceArrived (const USBDevice& device) noexcept
         {
-            return libusbDevices.begin();
+            if (filters.isEmpty())
+                return true;
+
+            if ( ! matchesAny (filters, Filter::Candidate (*device.pimpl)))
+                return false;
+
+            matchedKeys.insert (device.getKey());
+            return true;
         }
 
-        libusb_device* const* end() const noexcept
+        bool deviceRemoved (const USBDevice& device) noexcept
         {
-            return libusbDevices.end();
+            return filters.isEmpty() || matchedKeys.erase (device.getKey()) > 0;
         }
 
-        juce::Array<USBDevice> get() const noexcept
+        void filterChanges (Changes& changes) noexcept
         {
-            return devices;
+            if (filters.isEmpty())
+                return;
+
+            changes.removed.removeIf ([this] (const USBDevice& device) { return ! deviceRemoved (device); });
+            changes.arrived.removeIf ([this] (const USBDevice& device) { return ! deviceArrived (device); });
         }
 
-    private:
-        juce::Array<USBDevice> devices;
-        juce::Array<libusb_device*> libusbDevices;
+        juce::Array<Filter> filters;
+        std::unordered_set<juce::uint64> matchedKeys;
     };
-    
+
+    bool listenerWantsArrival (Listener& listener, const USBDevice& device) noexcept
+    {
+        const auto iter {listenerFilterStates.find (&listener)};
+        return iter == listenerFilterStates.end() || iter->second.deviceArrived (device);
+    }
+
+    bool listenerWantsRemoval (Listener& listener, const USBDevice& device) noexcept
+    {
+        const auto iter {listenerFilterStates.find (&listener)};
+        return iter == listenerFilterStates.end() || iter->second.deviceRemoved (device);
+    }
+
+    // called with the dispatch mutex locked, a slow listener can hold up
+    // other listeners but not anyone asking for the devices
+    void callListeners (const Changes& changes)
+    {
+        for (const auto& device : changes.arrived)
+        {
+            listeners.call ([this, &device] (Listener& listener)
+            {
+                if (listenerWantsArrival (listener, device))
+                    listener.deviceArrived (device);
+            });
+        }
+
+        for (const auto& device : changes.removed)
+        {
+            listeners.call ([this, &device] (Listener& listener)
+            {
+                if (listenerWantsRemoval (listener, device))
+                    listener.deviceRemoved (device);
+            });
+        }
+
+        if (changes.isEmpty() || batchListeners.isEmpty())
+            return;
+
+        if (batchDebounceMs <= 0)
+            callBatchListeners();
+        else if ( ! debounceTimer.isTimerRunning())
+            debounceTimer.startTimer (batchDebounceMs);
+    }
+
+    // called with the dispatch mutex locked, each listener is given whatever
+    // changed since it was last called back so listeners added part way
+    // through a debounce don't hear about devices twice. A listener that
+    // fell further behind than the history goes back, such as during a storm
+    // of hotplug events, is given the difference between the snapshot it
+    // last saw and the current one instead
+    void callBatchListeners()
+    {
+        const auto currentSnapshot {getSnapshot()};
+
+        batchListeners.call ([this, &currentSnapshot] (BatchListener& listener)
+        {
+            const auto iter {batchListenerStates.find (&listener)};
+
+            if (iter == batchListenerStates.end())
+                return;
+
+            auto& lastSnapshot = iter->second.snapshot;
+            auto changes {getChangesSince (lastSnapshot->getGeneration())};
+
+            if ( ! changes.isComplete)
+                changes = compareSnapshots (*lastSnapshot, *currentSnapshot);
+
+            lastSnapshot = currentSnapshot;
+
+            iter->second.filterState.filterChanges (changes);
+
+            if ( ! changes.isEmpty())
+                listener.devicesChanged (changes);
+        });
+    }
+
+    static Changes compareSnapshots (const Snapshot& from, const Snapshot& to) noexcept
+    {
+        Changes changes {};
+        changes.fromGeneration = from.getGeneration();
+        changes.toGeneration = to.getGeneration();
+
+        for (const auto& device : to)
+        {
+            if ( ! from.contains (device.getKey()))
+                changes.arrived.add (device);
+        }
+
+        for (const auto& device : from)
+        {
+            if ( ! to.contains (device.getKey()))
+                changes.removed.add (device);
+        }
+
+        return changes;
+    }
+
+    void debounceTimerExpired()
+    {
+        std::unique_lock<std::recursive_mutex> dispatchLock (dispatchMutex);
+
+        debounceTimer.stopTimer();
+        callBatchListeners();
+    }
+
     void hiResTimerCallback() override
     {
-        std::unique_lock<std::recursive_mutex> lock (mutex);
+        scanDevices();
+    }
+
+    void scanDevices()
+    {
+        std::unique_lock<std::recursive_mutex> dispatchLock (dispatchMutex);
+        const auto currentSnapshot {getSnapshot()};
         LibUsbDevices connectedDevices {};
+        std::unordered_set<juce::uint64> connectedKeys {};
+        Changes changes {};
 
-        // any devices already added will be ignored
+        // devices already added are matched against the filters using what's
+        // already known about them, so they aren't asked for their
+        // configuration on every scan
         for (const auto& connectedDevice : connectedDevices)
         {
-            if ( ! devices.contains (connectedDevice))
+            const auto key {getDeviceKey (connectedDevice)};
+            const auto knownDevice {currentSnapshot->getDeviceByKey (key)};
+
+            if (knownDevice.pimpl != nullptr)
             {
-                listeners.call (&USBDeviceManager::Listener::deviceArrived,
-                                devices.addAndReturn (connectedDevice));
+                if (matchesFilters (*knownDevice.pimpl))
+                    connectedKeys.insert (key);
             }
+            else if (matchesFilters (connectedDevice))
+            {
+                connectedKeys.insert (key);
+                changes.arrived.add (createDevice (connectedDevice));
+            }
+        }
+
+        // any device that isn't currently connected, or no longer matches the
+        // filters, should be removed
+        for (const auto& device : *currentSnapshot)
+        {
+            if (connectedKeys.find (device.getKey()) == connectedKeys.end())
+                changes.removed.add (device);
         }
 
-        juce::Array<libusb_device*> devicesToRemove {};
+        publish (changes);
+        callListeners (changes);
+    }
+    
+    struct BatchListenerState
+    {
+        // snapshots are immutable, so holding the last one the listener saw
+        // is cheap and lets it catch up however far behind it falls
+        std::shared_ptr<const Snapshot> snapshot;
+        ListenerFilterState filterState;
+    };
 
-        // find devices to remove, any device that isn't currently connected
-        // should be marked for removal
-        for (auto& device : devices)
+    struct DebounceTimer   : public juce::HighResolutionTimer
+    {
+        explicit DebounceTimer (Pimpl& pimplToCall) noexcept
+            : pimpl (pimplToCall)
         {
-            if ( ! connectedDevices.contains (device))
-                devicesToRemove.add (device);
         }
 
-        // remove the devices
-        for (const auto& deviceToRemove : devicesToRemove)
+        void hiResTimerCallback() override
         {
-            listeners.call (&USBDeviceManager::Listener::deviceRemoved,
-                            devices.removeAndReturn (deviceToRemove));
+            pimpl.debounceTimerExpired();
         }
-    }
-    
+
+        Pimpl& pimpl;
+    };
+
     USBDeviceManager& manager;
-    Devices devices;
     juce::ListenerList<Listener> listeners;
-    mutable std::recursive_mutex mutex;
+    std::unordered_map<Listener*, ListenerFilterState> listenerFilterStates;
+
+    juce::ListenerList<BatchListener> batchListeners;
+    std::unordered_map<BatchListener*, BatchListenerState> batchListenerStates;
+    std::atomic<int> batchDebounceMs {0};
+    DebounceTimer debounceTimer {*this};
+    juce::Array<Filter> filters;
+    mutable std::recursive_mutex dispatchMutex;
+
+    // the current snapshot is published through a plain atomic pointer, as
+    // std::atomic_load on a shared_ptr takes a lock
+    struct PublishedSnapshot
+    {
+        std::shared_ptr<const Snapshot> snapshot;
+    };
+
+    static constexpr int maxHistorySize {64};
+    std::atomic<PublishedSnapshot*> publishedSnapshot {new PublishedSnapshot {std::shared_ptr<const Snapshot> (new Snapshot())}};
+    mutable std::atomic<int> numSnapshotReaders {0};
+    juce::OwnedArray<PublishedSnapshot> retiredSnapshots;
+    juce::Array<Changes> history;
+    mutable std::mutex historyMutex;
+
+    libusb_hotplug_callback_handle hotplugCallbackHandle {};
+    bool hotplugCallbackRegistered {false};
+    bool usingHotplugEvents {false};
+    juce::Array<HotplugEvent> pendingHotplugEvents;
+    std::mutex pendingHotplugEventsMutex;
+
+    LibUsbDescriptorCache descriptorCache;
+    std::atomic<int> numPendingDescriptorStringReads {0};
+
+    static constexpr int numDescriptorStringReaders {16};
+    juce::ThreadPool descriptorStringReaders {numDescriptorStringReaders};
     
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (Pimpl)
 };
@@ -181,7 +828,7 @@ USBDeviceManager& USBDeviceManager::getInstance()
 USBDeviceManager::USBDeviceManager() noexcept
     : pimpl (std::make_unique<USBDeviceManager::Pimpl>(*this))
 {
-    pimpl->startTimer (pollingIntervalMs);
+    pimpl->startMonitoring (pollingIntervalMs);
 }
 
 USBDeviceManager::~USBDeviceManager() noexcept
@@ -199,20 +846,57 @@ void USBDeviceManager::setPollingIntervalMs (int newPollingIntervalMs) noexcept
     pollingIntervalMs = newPollingIntervalMs;
 }
 
+int USBDeviceManager::getIdleHandleTimeoutMs() const noexcept
+{
+    return LibUsbIdleHandleCloser::getIdleTimeoutMs();
+}
+
+void USBDeviceManager::setIdleHandleTimeoutMs (int newIdleHandleTimeoutMs) noexcept
+{
+    LibUsbIdleHandleCloser::getIdleTimeoutMs() = newIdleHandleTimeoutMs;
+}
+
 void USBDeviceManager::pausePolling() noexcept
 {
-    pimpl->stopTimer();
+    pimpl->stopMonitoring();
 }
 
 void USBDeviceManager::resumePolling() noexcept
 {
-    pimpl->startTimer (pollingIntervalMs);
+    pimpl->startMonitoring (pollingIntervalMs);
+}
+
+bool USBDeviceManager::isUsingHotplugEvents() const noexcept
+{
+    return pimpl->isUsingHotplugEvents();
+}
+
+void USBDeviceManager::setEventThreadRealtime (bool shouldBeRealtime, int realtimePriority) noexcept
+{
+    pimpl->setEventThreadRealtime (shouldBeRealtime, realtimePriority);
+}
+
+void USBDeviceManager::setEventThreadSharding (const EventThreadSharding& newSharding) noexcept
+{
+    pimpl->setEventThreadSharding (newSharding);
+}
+
+USBDeviceManager::EventThreadSharding USBDeviceManager::getEventThreadSharding() const noexcept
+{
+    return pimpl->getEventThreadSharding();
 }
     
 void USBDeviceManager::addListener (USBDeviceManager::Listener& listenerToAdd,
                                     bool shouldCallBackWithCurrentDevices) noexcept
 {
-    pimpl->addListener (listenerToAdd, shouldCallBackWithCurrentDevices);
+    pimpl->addListener (listenerToAdd, shouldCallBackWithCurrentDevices, {});
+}
+
+void USBDeviceManager::addListener (USBDeviceManager::Listener& listenerToAdd,
+                                    bool shouldCallBackWithCurrentDevices,
+                                    const juce::Array<Filter>& filters) noexcept
+{
+    pimpl->addListener (listenerToAdd, shouldCallBackWithCurrentDevices, filters);
 }
     
 void USBDeviceManager::removeListener (USBDeviceManager::Listener& listenerToRemove) noexcept
@@ -220,7 +904,232 @@ void USBDeviceManager::removeListener (USBDeviceManager::Listener& listenerToRem
     pimpl->removeListener (listenerToRemove);
 }
 
+void USBDeviceManager::addBatchListener (BatchListener& listenerToAdd,
+                                         bool shouldCallBackWithCurrentDevices) noexcept
+{
+    pimpl->addBatchListener (listenerToAdd, shouldCallBackWithCurrentDevices, {});
+}
+
+void USBDeviceManager::addBatchListener (BatchListener& listenerToAdd,
+                                         bool shouldCallBackWithCurrentDevices,
+                                         const juce::Array<Filter>& filters) noexcept
+{
+    pimpl->addBatchListener (listenerToAdd, shouldCallBackWithCurrentDevices, filters);
+}
+
+void USBDeviceManager::removeBatchListener (BatchListener& listenerToRemove) noexcept
+{
+    pimpl->removeBatchListener (listenerToRemove);
+}
+
+int USBDeviceManager::getBatchDebounceMs() const noexcept
+{
+    return pimpl->getBatchDebounceMs();
+}
+
+void USBDeviceManager::setBatchDebounceMs (int newBatchDebounceMs) noexcept
+{
+    pimpl->setBatchDebounceMs (newBatchDebounceMs);
+}
+
 juce::Array<USBDevice> USBDeviceManager::getDevices() const noexcept
 {
-    return pimpl->getDevices();
+    return pimpl->getSnapshot()->getDevices();
+}
+
+USBDevice USBDeviceManager::getDeviceByKey (juce::uint64 key) const noexcept
+{
+    return pimpl->getSnapshot()->getDeviceByKey (key);
+}
+
+void USBDeviceManager::setFilters (const juce::Array<Filter>& filters) noexcept
+{
+    pimpl->setFilters (filters);
+}
+
+juce::Array<USBDeviceManager::Filter> USBDeviceManager::getFilters() const noexcept
+{
+    return pimpl->getFilters();
+}
+
+void USBDeviceManager::setDescriptorCacheFile (const juce::File& file) noexcept
+{
+    pimpl->setDescriptorCacheFile (file);
+}
+
+std::shared_ptr<const USBDeviceManager::Snapshot> USBDeviceManager::getSnapshot() const noexcept
+{
+    return pimpl->getSnapshot();
+}
+
+juce::uint64 USBDeviceManager::getGeneration() const noexcept
+{
+    return pimpl->getSnapshot()->getGeneration();
+}
+
+USBDeviceManager::Changes USBDeviceManager::getChangesSince (juce::uint64 generation) const noexcept
+{
+    return pimpl->getChangesSince (generation);
+}
+
+//==============================================================================
+bool USBDeviceManager::Changes::isEmpty() const noexcept
+{
+    return arrived.isEmpty() && removed.isEmpty();
+}
+
+//==============================================================================
+USBDeviceManager::Snapshot::Snapshot (const Snapshot& previous, const Changes& changes) noexcept
+    : generation (changes.toGeneration)
+{
+    devices.ensureStorageAllocated (previous.size() + changes.arrived.size());
+
+    // looking the removed devices up by key keeps each step linear in the
+    // number of devices
+    std::unordered_set<juce::uint64> removedKeys;
+    removedKeys.reserve ((size_t) changes.removed.size());
+
+    for (const auto& device : changes.removed)
+        removedKeys.insert (device.getKey());
+
+    for (const auto& device : previous)
+    {
+        if (removedKeys.find (device.getKey()) == removedKeys.end())
+            devices.add (device);
+    }
+
+    devices.addArray (changes.arrived);
+    devicesByKey.reserve ((size_t) devices.size());
+
+    for (const auto& device : devices)
+        devicesByKey.emplace (device.getKey(), device);
+}
+
+juce::uint64 USBDeviceManager::Snapshot::getGeneration() const noexcept
+{
+    return generation;
+}
+
+const juce::Array<USBDevice>& USBDeviceManager::Snapshot::getDevices() const noexcept
+{
+    return devices;
+}
+
+int USBDeviceManager::Snapshot::size() const noexcept
+{
+    return devices.size();
+}
+
+bool USBDeviceManager::Snapshot::contains (juce::uint64 key) const noexcept
+{
+    return devicesByKey.find (key) != devicesByKey.end();
+}
+
+USBDevice USBDeviceManager::Snapshot::getDeviceByKey (juce::uint64 key) const noexcept
+{
+    const auto iter {devicesByKey.find (key)};
+    return iter != devicesByKey.end() ? iter->second : USBDevice();
+}
+
+const USBDevice* USBDeviceManager::Snapshot::begin() const noexcept
+{
+    return devices.begin();
+}
+
+const USBDevice* USBDeviceManager::Snapshot::end() const noexcept
+{
+    return devices.end();
+}
+
+//==============================================================================
+USBDeviceManager::Filter USBDeviceManager::Filter::withVendorId (int vendorId) const noexcept
+{
+    return withVendorIdRange (vendorId, vendorId);
+}
+
+USBDeviceManager::Filter USBDeviceManager::Filter::withVendorIdRange (int first, int last) const noexcept
+{
+    auto filter {*this};
+    filter.firstVendorId = first;
+    filter.lastVendorId = last;
+    return filter;
+}
+
+USBDeviceManager::Filter USBDeviceManager::Filter::withProductId (int productId) const noexcept
+{
+    return withProductIdRange (productId, productId);
+}
+
+USBDeviceManager::Filter USBDeviceManager::Filter::withProductIdRange (int first, int last) const noexcept
+{
+    auto filter {*this};
+    filter.firstProductId = first;
+    filter.lastProductId = last;
+    return filter;
+}
+
+USBDeviceManager::Filter USBDeviceManager::Filter::withDeviceClass (int newDeviceClass) const noexcept
+{
+    auto filter {*this};
+    filter.deviceClass = newDeviceClass;
+    return filter;
+}
+
+USBDeviceManager::Filter USBDeviceManager::Filter::withInterfaceClass (int newInterfaceClass) const noexcept
+{
+    auto filter {*this};
+    filter.interfaceClass = newInterfaceClass;
+    return filter;
+}
+
+USBDeviceManager::Filter USBDeviceManager::Filter::withBusNumber (int newBusNumber) const noexcept
+{
+    auto filter {*this};
+    filter.busNumber = newBusNumber;
+    return filter;
+}
+
+USBDeviceManager::Filter USBDeviceManager::Filter::withPortPath (const juce::Array<int>& newPortPath) const noexcept
+{
+    auto filter {*this};
+    filter.portPath = newPortPath;
+    return filter;
+}
+
+bool USBDeviceManager::Filter::matches (const USBDevice& device) const noexcept
+{
+    if (device.pimpl == nullptr)
+        return false;
+
+    return matches (Candidate (*device.pimpl));
+}
+
+bool USBDeviceManager::Filter::matches (const Candidate& candidate) const noexcept
+{
+    const auto& descriptor = candidate.descriptor;
+
+    if (descriptor.idVendor < firstVendorId || descriptor.idVendor > lastVendorId)
+        return false;
+
+    if (descriptor.idProduct < firstProductId || descriptor.idProduct > lastProductId)
+        return false;
+
+    if (busNumber >= 0 && getBusNumberFromDeviceKey (candidate.key) != busNumber)
+        return false;
+
+    for (auto tier {0}; tier < portPath.size(); ++tier)
+    {
+        if (getPortNumberFromDeviceKey (candidate.key, tier) != portPath[tier])
+            return false;
+    }
+
+    if (deviceClass >= 0 && descriptor.bDeviceClass != deviceClass)
+        return false;
+
+    // checked last as it's the only rule that needs more than the device
+    // descriptor
+    if (interfaceClass >= 0 && ! candidate.hasInterfaceClass (interfaceClass))
+        return false;
+
+    return true;
 }
@@ -16,15 +16,286 @@ public:
     /** Sets the interval between polling events in milliseconds. */
     void setPollingIntervalMs (int newPollingIntervalMs) noexcept;
 
-    /** Pauses polling for devices. */
+    /** Returns how long a device is kept open after it was last used. */
+    int getIdleHandleTimeoutMs() const noexcept;
+
+    /** Sets how long a device is kept open after it was last used.
+
+        Devices are opened when something needs to talk to them, such as a
+        stream or a control transfer, and closed once nothing has used them
+        for this long. Zero closes a device as soon as it's no longer used,
+        a negative timeout keeps devices open until they're removed.
+     */
+    void setIdleHandleTimeoutMs (int newIdleHandleTimeoutMs) noexcept;
+
+    /** Pauses polling for devices.
+
+        When hotplug events are in use this stops listening for them instead.
+     */
     void pausePolling() noexcept;
 
-    /** Resumes polling for devices. */
+    /** Resumes polling for devices.
+
+        Any changes that happened while paused are reported straight away.
+     */
     void resumePolling() noexcept;
 
+    /** Returns true if device changes are being reported by hotplug events
+        from the OS rather than by polling.
+
+        Hotplug events are used whenever the platform supports them, in which
+        case the polling interval is ignored.
+     */
+    bool isUsingHotplugEvents() const noexcept;
+
+    /** Sets whether the thread that handles libusb events runs with real-time
+        priority.
+
+        Every stream and hotplug notification in the module is completed on
+        this one shared thread, unless devices are sharded across several
+        threads in which case this applies to all of them. Making it
+        real-time keeps the latency between a transfer completing and its
+        data becoming available low. If a real-time thread can't be created a
+        high priority thread is used instead.
+
+        @param shouldBeRealtime     true to use a real-time thread.
+        @param realtimePriority     the real-time priority between 0 and 10.
+     */
+    void setEventThreadRealtime (bool shouldBeRealtime, int realtimePriority = 10) noexcept;
+
+    /** How open devices are spread across event threads. */
+    struct EventThreadSharding
+    {
+        enum class Mode
+        {
+            /** Every device uses the shared event thread. */
+            none,
+
+            /** Devices on the same bus share a thread. */
+            byBus,
+
+            /** Each device opened goes to the next thread in turn. */
+            roundRobin
+        };
+
+        Mode mode {Mode::none};
+
+        /** The number of event threads to spread devices across, zero uses
+            one per CPU core.
+         */
+        int numThreads {0};
+
+        /** The CPU cores to pin the threads to, thread n is pinned to core
+            cores[n % cores.size()]. If this is empty the threads can run on
+            any core.
+         */
+        juce::Array<int> cores;
+    };
+
+    /** Spreads devices across several libusb contexts, each with an event
+        thread of its own.
+
+        With one event thread every transfer of every device completes on the
+        same thread, which becomes the bottleneck once dozens of devices are
+        streaming at once. Sharding lets completions be handled on as many
+        cores as there are threads.
+
+        Devices are assigned a thread when they're opened, so devices already
+        open stay on the thread they're using until they're closed. Device
+        discovery and hotplug notifications always use the shared thread.
+     */
+    void setEventThreadSharding (const EventThreadSharding& newSharding) noexcept;
+
+    /** Returns the current event thread sharding. */
+    EventThreadSharding getEventThreadSharding() const noexcept;
+
+    /** Sets a file used to remember the manufacturer name, product name and
+        serial number of devices between runs.
+
+        Known devices then have their descriptor strings available as soon as
+        they're found, without waiting for the device to respond. The strings
+        are still read from every device in the background and the file is
+        updated if anything changed. Until then the strings are marked as
+        provisional, as the cache goes by location and a different unit of
+        the same product may have been plugged in there. Call this as early
+        as possible, passing an empty File stops using the cache.
+
+        @see USBDevice::areDescriptorStringsAvailable
+     */
+    void setDescriptorCacheFile (const juce::File& file) noexcept;
+
+    //==============================================================================
+    /** Describes the devices of interest.
+
+        A default constructed filter matches every device, each call to one of
+        the with methods narrows it down further. Filters only look at what
+        libusb already knows about a device, so devices are never opened to
+        decide whether they match.
+
+        @code
+        const auto audioInterfaces = USBDeviceManager::Filter()
+                                         .withVendorId (0x1234)
+                                         .withInterfaceClass (0x01); // audio
+        @endcode
+     */
+    class Filter
+    {
+    public:
+        /** Default constructor, creates a filter that matches any device. */
+        Filter() = default;
+
+        /** Only matches devices with this vendor ID. */
+        Filter withVendorId (int vendorId) const noexcept;
+
+        /** Only matches devices with a vendor ID in this inclusive range. */
+        Filter withVendorIdRange (int firstVendorId, int lastVendorId) const noexcept;
+
+        /** Only matches devices with this product ID. */
+        Filter withProductId (int productId) const noexcept;
+
+        /** Only matches devices with a product ID in this inclusive range. */
+        Filter withProductIdRange (int firstProductId, int lastProductId) const noexcept;
+
+        /** Only matches devices with this class in their device descriptor. */
+        Filter withDeviceClass (int deviceClass) const noexcept;
+
+        /** Only matches devices with at least one interface of this class in
+            their active configuration.
+         */
+        Filter withInterfaceClass (int interfaceClass) const noexcept;
+
+        /** Only matches devices on this bus. */
+        Filter withBusNumber (int busNumber) const noexcept;
+
+        /** Only matches devices plugged in at or below this port path, the
+            path is the port numbers from the root hub outwards.
+         */
+        Filter withPortPath (const juce::Array<int>& portPath) const noexcept;
+
+        /** Returns true if the device matches every rule of this filter. */
+        bool matches (const USBDevice& device) const noexcept;
+
+    private:
+        friend class USBDeviceManager;
+
+        struct Candidate;
+        bool matches (const Candidate& candidate) const noexcept;
+
+        int firstVendorId {0};
+        int lastVendorId {0xffff};
+        int firstProductId {0};
+        int lastProductId {0xffff};
+        int deviceClass {-1};
+        int interfaceClass {-1};
+        int busNumber {-1};
+        juce::Array<int> portPath;
+    };
+
+    /** Sets the filters a device must match to be reported by the manager.
+
+        A device is reported if it matches any of the filters, an empty array
+        reports every device. Devices that don't match are never opened and
+        never appear in getDevices() or a Snapshot. Changing the filters
+        reports devices that have started or stopped matching straight away.
+     */
+    void setFilters (const juce::Array<Filter>& filters) noexcept;
+
+    /** Returns the filters set with setFilters(). */
+    juce::Array<Filter> getFilters() const noexcept;
+
     /** Returns an array of the currently connected devices. */
     juce::Array<USBDevice> getDevices() const noexcept;
-    
+
+    /** Returns the connected device with the given key.
+
+        If no connected device has the key a default constructed USBDevice is
+        returned.
+
+        @see USBDevice::getKey
+     */
+    USBDevice getDeviceByKey (juce::uint64 key) const noexcept;
+
+    //==============================================================================
+    /** The devices that arrived and were removed between two generations. */
+    struct Changes
+    {
+        /** Returns true if no devices arrived or were removed. */
+        bool isEmpty() const noexcept;
+
+        juce::uint64 fromGeneration {0};
+        juce::uint64 toGeneration {0};
+        juce::Array<USBDevice> arrived;
+        juce::Array<USBDevice> removed;
+
+        /** False if the changes go back further than the history that is
+            kept, in which case every connected device is in arrived and
+            nothing is in removed.
+         */
+        bool isComplete {true};
+    };
+
+    //==============================================================================
+    /** An immutable view of the connected devices at one point in time.
+
+        A new snapshot is published every time devices arrive or are removed,
+        each with a generation one higher than the last. Holding on to a
+        snapshot is cheap and it will never change, even as devices come and
+        go.
+     */
+    class Snapshot
+    {
+    public:
+        /** Returns the generation of this snapshot. */
+        juce::uint64 getGeneration() const noexcept;
+
+        /** Returns the devices in this snapshot. */
+        const juce::Array<USBDevice>& getDevices() const noexcept;
+
+        /** Returns the number of devices in this snapshot. */
+        int size() const noexcept;
+
+        /** Returns true if a device in this snapshot has the given key. */
+        bool contains (juce::uint64 key) const noexcept;
+
+        /** Returns the device with the given key, or a default constructed
+            USBDevice if there isn't one.
+         */
+        USBDevice getDeviceByKey (juce::uint64 key) const noexcept;
+
+        const USBDevice* begin() const noexcept;
+        const USBDevice* end() const noexcept;
+
+    private:
+        friend class USBDeviceManager;
+
+        Snapshot() noexcept = default;
+        Snapshot (const Snapshot& previous, const Changes& changes) noexcept;
+
+        juce::uint64 generation {0};
+        juce::Array<USBDevice> devices;
+        std::unordered_map<juce::uint64, USBDevice> devicesByKey;
+
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (Snapshot)
+    };
+
+    /** Returns the current snapshot of the connected devices.
+
+        This never blocks or takes a lock, even while devices are being
+        added or removed.
+     */
+    std::shared_ptr<const Snapshot> getSnapshot() const noexcept;
+
+    /** Returns the generation of the current snapshot. */
+    juce::uint64 getGeneration() const noexcept;
+
+    /** Returns the changes between the given generation and the current one.
+
+        Devices that arrived and were removed again in the meantime aren't
+        included.
+     */
+    Changes getChangesSince (juce::uint64 generation) const noexcept;
+
+    //==============================================================================
     class Listener
     {
     public:
@@ -48,8 +319,83 @@ public:
      */
     void addListener (Listener& listenerToAdd, bool shouldCallBackWithCurrentDevices) noexcept;
 
-    /** Remove a listener to prevent it recieving further callabcks. */
+    /** Add a listener that is only called back for devices matching any of
+        the given filters.
+
+        @see addListener, Filter
+     */
+    void addListener (Listener& listenerToAdd,
+                      bool shouldCallBackWithCurrentDevices,
+                      const juce::Array<Filter>& filters) noexcept;
+
+    /** Remove a listener to prevent it recieving further callabcks.
+
+        If a callback is in progress on another thread this waits for it to
+        finish, so the listener can safely be deleted afterwards.
+     */
     void removeListener (Listener& listenerToRemove) noexcept;
+
+    //==============================================================================
+    /** Receives every device that arrived or was removed in one go, rather
+        than one callback per device.
+
+        When a hub full of devices is plugged in a Listener is called back
+        once for each of them, a BatchListener is called back once for the
+        lot, so any state built from the devices only has to be rebuilt once.
+     */
+    class BatchListener
+    {
+    public:
+        /** Destructor. */
+        virtual ~BatchListener() {}
+
+        /** Called back with the devices that arrived and were removed since
+            the last call.
+
+            Devices that arrived and were removed again in between aren't
+            included. The changes are always complete, even if more happened
+            since the last call than the history keeps.
+         */
+        virtual void devicesChanged (const Changes& changes) = 0;
+    };
+
+    /** Add a listener to be called back with batches of changes.
+
+        @param listenerToAdd                        The listener that will recieve callbacks.
+
+        @param shouldCallBackWithCurrentDevices     If true the listener is called back
+                                                    straight away with every currently
+                                                    connected device.
+     */
+    void addBatchListener (BatchListener& listenerToAdd, bool shouldCallBackWithCurrentDevices) noexcept;
+
+    /** Add a batch listener that is only told about devices matching any of
+        the given filters.
+
+        @see addBatchListener, Filter
+     */
+    void addBatchListener (BatchListener& listenerToAdd,
+                           bool shouldCallBackWithCurrentDevices,
+                           const juce::Array<Filter>& filters) noexcept;
+
+    /** Remove a batch listener, waiting for any callback in progress to
+        finish.
+     */
+    void removeBatchListener (BatchListener& listenerToRemove) noexcept;
+
+    /** Returns the time batches are collected for, in milliseconds. */
+    int getBatchDebounceMs() const noexcept;
+
+    /** Sets the time batches are collected for, in milliseconds.
+
+        With a debounce of zero batch listeners are called back once per scan
+        or per set of hotplug events handled together. Otherwise the first
+        change starts the debounce and everything that happens before it runs
+        out is delivered as one batch, from a separate thread. Devices plugged
+        in through a hub tend to arrive one by one over a few hundred
+        milliseconds.
+     */
+    void setBatchDebounceMs (int newBatchDebounceMs) noexcept;
     
 private:
     /** Default constructor. */
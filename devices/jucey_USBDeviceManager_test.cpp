@@ -0,0 +1,361 @@
+//==============================================================================
+class USBDeviceManagerTests : public juce::UnitTest
+{
+public:
+    USBDeviceManagerTests()
+        : juce::UnitTest ("USBDeviceManager", "jucey_libusb")
+    {
+    }
+
+    void runTest() override
+    {
+        LibUsbSimulatedDevices bus;
+        auto& manager = bus.getManager();
+
+        beginTest ("Devices plugged in and removed are reported as changes");
+        {
+            const auto generation {manager.getGeneration()};
+            const auto snapshot {manager.getSnapshot()};
+
+            const auto first {bus.addDevice (LibUsbSimulatedDevices::makeDeviceSpec (1))};
+            bus.addDevice (LibUsbSimulatedDevices::makeDeviceSpec (2));
+            expect (bus.waitForNumDevices (2));
+
+            auto changes {manager.getChangesSince (generation)};
+            expect (changes.isComplete);
+            expectEquals (changes.arrived.size(), 2);
+            expectEquals (changes.removed.size(), 0);
+            expect (changes.toGeneration == manager.getGeneration());
+
+            // a snapshot never changes once it's published
+            expectEquals (snapshot->size(), 0);
+
+            const auto generationWithBoth {manager.getGeneration()};
+            const auto removedKey {bus.findDevice (1).getKey()};
+
+            bus.removeDevice (first);
+            expect (bus.waitForNumDevices (1));
+
+            changes = manager.getChangesSince (generationWithBoth);
+            expectEquals (changes.arrived.size(), 0);
+            expectEquals (changes.removed.size(), 1);
+            expect (changes.removed.getFirst().getKey() == removedKey);
+            expect ( ! manager.getSnapshot()->contains (removedKey));
+            expect (manager.getDeviceByKey (removedKey) == USBDevice());
+        }
+
+        beginTest ("Devices that came and went in between aren't reported");
+        {
+            const auto generation {manager.getGeneration()};
+
+            const auto deviceId {bus.addDevice (LibUsbSimulatedDevices::makeDeviceSpec (3))};
+            expect (bus.waitForNumDevices (2));
+            bus.removeDevice (deviceId);
+            expect (bus.waitForNumDevices (1));
+
+            const auto changes {manager.getChangesSince (generation)};
+            expect (changes.isComplete);
+            expect (changes.isEmpty());
+            expect (changes.toGeneration > generation);
+
+            expect (manager.getChangesSince (manager.getGeneration()).isEmpty());
+        }
+
+        beginTest ("Changes older than the history report every device");
+        {
+            const auto generation {manager.getGeneration()};
+
+            for (auto iteration {0}; iteration < 40; ++iteration)
+            {
+                const auto deviceId {bus.addDevice (LibUsbSimulatedDevices::makeDeviceSpec (4))};
+                expect (bus.waitForNumDevices (2));
+                bus.removeDevice (deviceId);
+                expect (bus.waitForNumDevices (1));
+            }
+
+            const auto changes {manager.getChangesSince (generation)};
+            expect ( ! changes.isComplete);
+            expectEquals (changes.arrived.size(), 1);
+            expectEquals (changes.arrived.getFirst().getProductId(), 2);
+            expectEquals (changes.removed.size(), 0);
+        }
+
+        beginTest ("Snapshots can be read while devices come and go");
+        {
+            std::atomic<bool> reading {true};
+            std::atomic<bool> generationsInOrder {true};
+            juce::WaitableEvent finishedReading;
+
+            juce::Thread::launch ([&]
+            {
+                auto lastGeneration {manager.getGeneration()};
+
+                while (reading)
+                {
+                    const auto snapshot {manager.getSnapshot()};
+
+                    if (snapshot->getGeneration() < lastGeneration)
+                        generationsInOrder = false;
+
+                    lastGeneration = snapshot->getGeneration();
+                }
+
+                finishedReading.signal();
+            });
+
+            for (auto iteration {0}; iteration < 20; ++iteration)
+            {
+                const auto deviceId {bus.addDevice (LibUsbSimulatedDevices::makeDeviceSpec (5))};
+                expect (bus.waitForNumDevices (2));
+                bus.removeDevice (deviceId);
+                expect (bus.waitForNumDevices (1));
+            }
+
+            reading = false;
+            finishedReading.wait (-1);
+            expect (generationsInOrder);
+        }
+
+        beginTest ("Filters match on the descriptors and the port path");
+        {
+            bus.addDevice (LibUsbSimulatedDevices::makeDeviceSpec (6));
+            expect (bus.waitForNumDevices (2));
+
+            const auto device {bus.findDevice (6)};
+            using Filter = USBDeviceManager::Filter;
+
+            expect (Filter().matches (device));
+            expect (Filter().withVendorId (LibUsbSimulatedDevices::vendorId).withProductId (6).matches (device));
+            expect (Filter().withProductIdRange (5, 7).matches (device));
+            expect ( ! Filter().withProductIdRange (7, 9).matches (device));
+            expect ( ! Filter().withVendorId (LibUsbSimulatedDevices::vendorId + 1).matches (device));
+            expect (Filter().withInterfaceClass (0xff).matches (device));
+            expect ( ! Filter().withInterfaceClass (0x01).matches (device));
+            expect (Filter().withBusNumber (1).withPortPath ({1}).matches (device));
+            expect (Filter().withPortPath ({1, 7}).matches (device));
+            expect ( ! Filter().withPortPath ({1, 2}).matches (device));
+            expect ( ! Filter().withBusNumber (2).matches (device));
+
+            manager.setFilters ({Filter().withProductId (6)});
+            expectEquals (manager.getSnapshot()->size(), 1);
+            expectEquals (manager.getDevices().getFirst().getProductId(), 6);
+
+            manager.setFilters ({});
+            expectEquals (manager.getSnapshot()->size(), 2);
+        }
+
+        beginTest ("Listeners are only told about devices matching their filters");
+        {
+            Listener listener;
+            manager.addListener (listener, true, {USBDeviceManager::Filter().withProductId (8)});
+
+            const auto unmatched {bus.addDevice (LibUsbSimulatedDevices::makeDeviceSpec (7))};
+            const auto matched {bus.addDevice (LibUsbSimulatedDevices::makeDeviceSpec (8))};
+            expect (bus.waitForNumDevices (4));
+
+            bus.removeDevice (unmatched);
+            bus.removeDevice (matched);
+            expect (bus.waitForNumDevices (2));
+            expect (LibUsbSimulatedDevices::waitUntil ([&] { return listener.getEvents().size() == 2; }));
+
+            manager.removeListener (listener);
+
+            expect (listener.getEvents() == juce::StringArray {"+8", "-8"});
+        }
+
+        // removed again while the next batch listener has fallen behind
+        auto firstBatchedDeviceId {0};
+
+        beginTest ("Batch listeners are told about everything before the debounce runs out at once");
+        {
+            BatchListener listener;
+            manager.setBatchDebounceMs (500);
+            manager.addBatchListener (listener, false);
+
+            firstBatchedDeviceId = bus.addDevice (LibUsbSimulatedDevices::makeDeviceSpec (9));
+            bus.addDevice (LibUsbSimulatedDevices::makeDeviceSpec (10));
+            bus.addDevice (LibUsbSimulatedDevices::makeDeviceSpec (11));
+
+            expect (bus.waitForNumDevices (5));
+            expect (LibUsbSimulatedDevices::waitUntil ([&] { return listener.getBatches().size() > 0; }));
+
+            manager.removeBatchListener (listener);
+
+            const auto batches {listener.getBatches()};
+            expectEquals (batches.size(), 1);
+            expectEquals (batches.getFirst().arrived.size(), 3);
+            expectEquals (batches.getFirst().removed.size(), 0);
+        }
+
+        beginTest ("Batch listeners that fall behind the history still get complete changes");
+        {
+            BatchListener listener;
+            manager.setBatchDebounceMs (3000);
+            manager.addBatchListener (listener, false);
+
+            const auto generation {manager.getGeneration()};
+            const auto removedKey {bus.findDevice (9).getKey()};
+
+            // more changes than the history keeps, all within the debounce
+            for (auto iteration {0}; iteration < 40; ++iteration)
+            {
+                const auto deviceId {bus.addDevice (LibUsbSimulatedDevices::makeDeviceSpec (12))};
+                expect (bus.waitForNumDevices (6));
+                bus.removeDevice (deviceId);
+                expect (bus.waitForNumDevices (5));
+            }
+
+            bus.removeDevice (firstBatchedDeviceId);
+            bus.addDevice (LibUsbSimulatedDevices::makeDeviceSpec (13));
+            expect (LibUsbSimulatedDevices::waitUntil ([&] { return bus.findDevice (13) != USBDevice() && bus.findDevice (9) == USBDevice(); }));
+            expect ( ! manager.getChangesSince (generation).isComplete);
+
+            expect (LibUsbSimulatedDevices::waitUntil ([&] { return listener.getBatches().size() > 0; }));
+
+            manager.removeBatchListener (listener);
+            manager.setBatchDebounceMs (0);
+
+            const auto batches {listener.getBatches()};
+            expectEquals (batches.size(), 1);
+
+            const auto& changes = batches.getFirst();
+            expect (changes.isComplete);
+            expectEquals (changes.arrived.size(), 1);
+            expectEquals (changes.arrived.getFirst().getProductId(), 13);
+            expectEquals (changes.removed.size(), 1);
+            expect (changes.removed.getFirst().getKey() == removedKey);
+        }
+
+        beginTest ("Devices can be spread across event threads");
+        {
+            using Sharding = USBDeviceManager::EventThreadSharding;
+
+            const auto idleHandleTimeoutMs {manager.getIdleHandleTimeoutMs()};
+            manager.setIdleHandleTimeoutMs (0);
+
+            // two devices on bus 1 and one on bus 2
+            for (const auto index : {20, 21, 120})
+                bus.addDevice (LibUsbSimulatedDevices::makeDeviceSpec (index));
+
+            expect (bus.waitForNumDevices (8));
+
+            // the strings are read as the devices arrive, which opens them
+            expect (LibUsbSimulatedDevices::waitUntil ([&]
+            {
+                for (const auto& device : manager.getDevices())
+                {
+                    if ( ! device.areDescriptorStringsAvailable() || device.areDescriptorStringsProvisional())
+                        return false;
+                }
+
+                return true;
+            }));
+
+            // devices are only given a thread as they're opened, so every
+            // handle has to be closed before the sharding changes
+            const auto getCompletionThreads = [&] (Sharding::Mode mode)
+            {
+                expect (LibUsbSimulatedDevices::waitUntil ([&] { return bus.getNumOpenHandles() == 0; }));
+
+                Sharding sharding {};
+                sharding.mode = mode;
+                sharding.numThreads = 2;
+                manager.setEventThreadSharding (sharding);
+
+                juce::Array<juce::Thread*> threads;
+
+                for (const auto productId : {20, 21, 120})
+                    threads.add (getCompletionThread (bus.findDevice (productId)));
+
+                return threads;
+            };
+
+            const auto shared {getCompletionThreads (Sharding::Mode::none)};
+            expect (shared[0] != nullptr);
+            expect (shared[0] == shared[1] && shared[0] == shared[2]);
+
+            const auto roundRobin {getCompletionThreads (Sharding::Mode::roundRobin)};
+            expect (roundRobin[0] != roundRobin[1]);
+            expect (roundRobin[0] == roundRobin[2]);
+            expect ( ! roundRobin.contains (shared[0]));
+
+            const auto byBus {getCompletionThreads (Sharding::Mode::byBus)};
+            expect (byBus[0] == byBus[1]);
+            expect (byBus[0] != byBus[2]);
+            expect ( ! byBus.contains (shared[0]));
+
+            expect (LibUsbSimulatedDevices::waitUntil ([&] { return bus.getNumOpenHandles() == 0; }));
+            manager.setEventThreadSharding ({});
+            manager.setIdleHandleTimeoutMs (idleHandleTimeoutMs);
+        }
+    }
+
+private:
+    // sends a request the simulated bus completes straight away and returns
+    // the thread it completed on. An event thread stops whenever nothing is
+    // using it, so its thread ID can change but the juce::Thread doesn't
+    static juce::Thread* getCompletionThread (const USBDevice& device)
+    {
+        USBDevice::ControlRequest request {};
+        request.requestType = (int) LIBUSB_ENDPOINT_IN | (int) LIBUSB_REQUEST_TYPE_VENDOR | (int) LIBUSB_RECIPIENT_DEVICE;
+        request.length = 8;
+
+        juce::Thread* thread {nullptr};
+        juce::WaitableEvent completed;
+
+        device.controlTransferAsync (request, [&] (const USBDevice::ControlResult&)
+        {
+            thread = juce::Thread::getCurrentThread();
+            completed.signal();
+        });
+
+        completed.wait (-1);
+        return thread;
+    }
+
+    // records each callback as + or - followed by the product ID
+    struct Listener : public USBDeviceManager::Listener
+    {
+        void deviceArrived (const USBDevice& device) override
+        {
+            std::unique_lock<std::mutex> lock (mutex);
+            events.add ("+" + juce::String (device.getProductId()));
+        }
+
+        void deviceRemoved (const USBDevice& device) override
+        {
+            std::unique_lock<std::mutex> lock (mutex);
+            events.add ("-" + juce::String (device.getProductId()));
+        }
+
+        juce::StringArray getEvents() const
+        {
+            std::unique_lock<std::mutex> lock (mutex);
+            return events;
+        }
+
+        mutable std::mutex mutex;
+        juce::StringArray events;
+    };
+
+    // records each batch of changes
+    struct BatchListener : public USBDeviceManager::BatchListener
+    {
+        void devicesChanged (const USBDeviceManager::Changes& changes) override
+        {
+            std::unique_lock<std::mutex> lock (mutex);
+            batches.add (changes);
+        }
+
+        juce::Array<USBDeviceManager::Changes> getBatches() const
+        {
+            std::unique_lock<std::mutex> lock (mutex);
+            return batches;
+        }
+
+        mutable std::mutex mutex;
+        juce::Array<USBDeviceManager::Changes> batches;
+    };
+};
+
+static USBDeviceManagerTests usbDeviceManagerTests;
@@ -0,0 +1,179 @@
+//==============================================================================
+class USBDeviceTests : public juce::UnitTest
+{
+public:
+    USBDeviceTests()
+        : juce::UnitTest ("USBDevice", "jucey_libusb")
+    {
+    }
+
+    void runTest() override
+    {
+        LibUsbSimulatedDevices bus;
+
+        const auto deviceId {bus.addDevice (LibUsbSimulatedDevices::makeDeviceSpec (1))};
+        expect (bus.waitForNumDevices (1));
+
+        const auto device {bus.findDevice (1)};
+
+        beginTest ("A control request calls back once it completes");
+        {
+            juce::WaitableEvent completed;
+            USBDevice::ControlResult result {};
+
+            device.controlTransferAsync (makeReadRequest (64), [&] (const USBDevice::ControlResult& controlResult)
+            {
+                result = controlResult;
+                completed.signal();
+            });
+
+            expect (completed.wait (1000));
+            expect (result.wasOk(), result.error);
+            expectEquals (result.numBytesTransferred, 64);
+            expectEquals ((int) result.data.getSize(), 64);
+        }
+
+        beginTest ("A control request returns a future of its result");
+        {
+            auto request {makeWriteRequest()};
+            request.data.setSize (16, true);
+
+            auto future {device.controlTransferAsync (request)};
+            expect (future.wait_for (std::chrono::seconds (1)) == std::future_status::ready);
+
+            const auto result {future.get()};
+            expect (result.wasOk(), result.error);
+            expectEquals (result.numBytesTransferred, 16);
+            expectEquals ((int) result.data.getSize(), 0);
+        }
+
+        beginTest ("Many control requests can be in flight at once");
+        {
+            std::vector<std::future<USBDevice::ControlResult>> futures;
+
+            for (auto index {0}; index < 32; ++index)
+                futures.push_back (device.controlTransferAsync (makeReadRequest (index)));
+
+            auto numCompleted {0};
+
+            for (auto& future : futures)
+            {
+                if (future.wait_for (std::chrono::seconds (1)) == std::future_status::ready && future.get().wasOk())
+                    ++numCompleted;
+            }
+
+            expectEquals (numCompleted, 32);
+        }
+
+        beginTest ("A request that can't be sent calls back straight away");
+        {
+            auto future {device.controlTransferAsync (makeReadRequest (0x10000))};
+            expect (future.wait_for (std::chrono::seconds (0)) == std::future_status::ready);
+            expect ( ! future.get().wasOk());
+        }
+
+        beginTest ("Devices are only kept open while they're in use");
+        {
+            auto& manager = bus.getManager();
+            const auto idleHandleTimeoutMs {manager.getIdleHandleTimeoutMs()};
+
+            manager.setIdleHandleTimeoutMs (0);
+            device.controlTransferAsync (makeReadRequest (8)).wait();
+            expect (LibUsbSimulatedDevices::waitUntil ([&] { return bus.getNumOpenHandles() == 0; }));
+
+            // descriptors are read when the device is found
+            expect (device.getSpeedMbps() > 0.0f);
+            expect (device.getManufacturerName().isNotEmpty());
+            expectEquals (bus.getNumOpenHandles(), 0);
+
+            manager.setIdleHandleTimeoutMs (200);
+            device.controlTransferAsync (makeReadRequest (8)).wait();
+            expectEquals (bus.getNumOpenHandles(), 1);
+            expect (LibUsbSimulatedDevices::waitUntil ([&] { return bus.getNumOpenHandles() == 0; }));
+
+            manager.setIdleHandleTimeoutMs (-1);
+            device.controlTransferAsync (makeReadRequest (8)).wait();
+            juce::Thread::sleep (300);
+            expectEquals (bus.getNumOpenHandles(), 1);
+
+            manager.setIdleHandleTimeoutMs (0);
+            device.controlTransferAsync (makeReadRequest (8)).wait();
+            expect (LibUsbSimulatedDevices::waitUntil ([&] { return bus.getNumOpenHandles() == 0; }));
+
+            manager.setIdleHandleTimeoutMs (idleHandleTimeoutMs);
+        }
+
+        beginTest ("The active configuration is only read when it may have changed");
+        {
+            auto& manager = bus.getManager();
+            const auto idleHandleTimeoutMs {manager.getIdleHandleTimeoutMs()};
+
+            manager.setIdleHandleTimeoutMs (0);
+            expect (LibUsbSimulatedDevices::waitUntil ([&] { return bus.getNumOpenHandles() == 0; }));
+
+            // the simulated configuration asks for 50 units of 2mA
+            const auto info {device.getInfo()};
+            expect (info.key == device.getKey());
+            expectEquals (info.productId, 1);
+            expectEquals (info.serialNumber, juce::String ("1"));
+            expect (info.areDescriptorStringsAvailable);
+            expect (info.activeConfiguration.isValid());
+            expectEquals (info.activeConfiguration.getConfigurationValue(), 1);
+            expectEquals (info.currentMilliampsRequired, 100);
+            expectEquals (info.maximumMilliampsRequired, 100);
+
+            const auto numReads {bus.getNumActiveConfigurationReads()};
+
+            for (auto iteration {0}; iteration < 10; ++iteration)
+            {
+                device.getInfo();
+                device.getActiveConfiguration();
+                device.getCurrentMilliampsRequired();
+            }
+
+            expectEquals (bus.getNumActiveConfigurationReads(), numReads);
+            expectEquals (bus.getNumOpenHandles(), 0);
+
+            USBDevice::ControlRequest setConfiguration {};
+            setConfiguration.requestType = (int) LIBUSB_REQUEST_TYPE_STANDARD | (int) LIBUSB_RECIPIENT_DEVICE;
+            setConfiguration.request = LIBUSB_REQUEST_SET_CONFIGURATION;
+            setConfiguration.value = 1;
+            expect (device.controlTransferAsync (setConfiguration).get().wasOk());
+
+            expectEquals (device.getInfo().activeConfiguration.getConfigurationValue(), 1);
+            expectEquals (bus.getNumActiveConfigurationReads(), numReads + 1);
+
+            manager.setIdleHandleTimeoutMs (idleHandleTimeoutMs);
+        }
+
+        beginTest ("Requests to a removed device fail");
+        {
+            bus.removeDevice (deviceId);
+            expect (bus.waitForNumDevices (0));
+
+            auto future {device.controlTransferAsync (makeReadRequest (64))};
+            expect (future.wait_for (std::chrono::seconds (1)) == std::future_status::ready);
+            expect ( ! future.get().wasOk());
+        }
+    }
+
+private:
+    static USBDevice::ControlRequest makeReadRequest (int length)
+    {
+        USBDevice::ControlRequest request {};
+        request.requestType = (int) LIBUSB_ENDPOINT_IN | (int) LIBUSB_REQUEST_TYPE_VENDOR | (int) LIBUSB_RECIPIENT_DEVICE;
+        request.request = 1;
+        request.length = length;
+        return request;
+    }
+
+    static USBDevice::ControlRequest makeWriteRequest()
+    {
+        USBDevice::ControlRequest request {};
+        request.requestType = (int) LIBUSB_ENDPOINT_OUT | (int) LIBUSB_REQUEST_TYPE_VENDOR | (int) LIBUSB_RECIPIENT_DEVICE;
+        request.request = 2;
+        return request;
+    }
+};
+
+static USBDeviceTests usbDeviceTests;
@@ -0,0 +1,76 @@
+#pragma once
+
+//==============================================================================
+/** A snapshot of the transfers made to or from a USBDevice or one of its
+    streams.
+
+    The counters only ever go up, so rates are worked out from two snapshots
+    taken some time apart.
+
+    @code
+    const auto before = stream.getStatistics();
+    juce::Thread::sleep (1000);
+    const auto after = stream.getStatistics();
+
+    DBG (after.getBytesPerSecondSince (before) << " bytes/s, p99 latency "
+         << after.getLatencyPercentileMicroseconds (0.99) << " us");
+    @endcode
+ */
+struct USBTransferStatistics
+{
+    /** Completion latencies are counted in buckets that double in width,
+        bucket 0 holds anything under a microsecond and bucket n anything from
+        2^(n-1) up to 2^n microseconds. The last bucket also holds anything
+        longer.
+     */
+    static constexpr int numLatencyBuckets {32};
+
+    /** Returns the bytes moved per second between an earlier snapshot and
+        this one.
+     */
+    double getBytesPerSecondSince (const USBTransferStatistics& earlier) const noexcept;
+
+    /** Returns the transfers completed per second between an earlier
+        snapshot and this one.
+     */
+    double getTransfersPerSecondSince (const USBTransferStatistics& earlier) const noexcept;
+
+    /** Returns the upper bound of the latency bucket below which the given
+        fraction of transfers completed, or zero if none have.
+     */
+    double getLatencyPercentileMicroseconds (double fraction) const noexcept;
+
+    /** The juce::Time::getHighResolutionTicks() value when this snapshot was
+        taken.
+     */
+    juce::int64 timeTicks {0};
+
+    /** The number of bytes sent or received. */
+    juce::int64 numBytes {0};
+
+    /** The number of transfers that completed successfully. */
+    juce::int64 numTransfersCompleted {0};
+
+    /** The number of transfers submitted but not yet completed. */
+    juce::int64 numTransfersInFlight {0};
+
+    /** Transfers that failed, including those that couldn't be submitted and
+        those cut short by the device being removed.
+     */
+    juce::int64 numErrors {0};
+
+    juce::int64 numStalls {0};
+    juce::int64 numTimeouts {0};
+    juce::int64 numCancellations {0};
+
+    /** The number of times a device sent more data than was asked for. */
+    juce::int64 numOverflows {0};
+
+    /** The number of isochronous packets that didn't complete successfully,
+        each is also counted by the reason it failed.
+     */
+    juce::int64 numPacketErrors {0};
+
+    /** The time from submitting each transfer to it completing. */
+    std::array<juce::int64, numLatencyBuckets> latencyHistogram {};
+};
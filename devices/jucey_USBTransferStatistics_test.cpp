@@ -0,0 +1,147 @@
+//==============================================================================
+class USBTransferStatisticsTests : public juce::UnitTest
+{
+public:
+    USBTransferStatisticsTests()
+        : juce::UnitTest ("USBTransferStatistics", "jucey_libusb")
+    {
+    }
+
+    void runTest() override
+    {
+        beginTest ("Transfers are counted by their outcome and passed on to the parent");
+        {
+            LibUsbTransferCounters deviceCounters {nullptr, 42};
+            LibUsbTransferCounters streamCounters {&deviceCounters};
+            expect (streamCounters.getDeviceKey() == 42);
+
+            libusb_transfer transfer {};
+            transfer.type = LIBUSB_TRANSFER_TYPE_BULK;
+
+            for (const auto status : {LIBUSB_TRANSFER_COMPLETED,
+                                      LIBUSB_TRANSFER_COMPLETED,
+                                      LIBUSB_TRANSFER_STALL,
+                                      LIBUSB_TRANSFER_TIMED_OUT,
+                                      LIBUSB_TRANSFER_CANCELLED,
+                                      LIBUSB_TRANSFER_OVERFLOW,
+                                      LIBUSB_TRANSFER_NO_DEVICE})
+            {
+                transfer.status = status;
+                transfer.actual_length = status == LIBUSB_TRANSFER_COMPLETED ? 100 : 0;
+
+                streamCounters.transferSubmitted();
+                streamCounters.transferCompleted (transfer, juce::Time::getHighResolutionTicks());
+            }
+
+            streamCounters.transferSubmitted();
+            streamCounters.transferSubmitted();
+            streamCounters.transferNotSubmitted();
+
+            for (const auto& statistics : {streamCounters.getStatistics(), deviceCounters.getStatistics()})
+            {
+                expectEquals (statistics.numBytes, (juce::int64) 200);
+                expectEquals (statistics.numTransfersCompleted, (juce::int64) 2);
+                expectEquals (statistics.numTransfersInFlight, (juce::int64) 1);
+                expectEquals (statistics.numStalls, (juce::int64) 1);
+                expectEquals (statistics.numTimeouts, (juce::int64) 1);
+                expectEquals (statistics.numCancellations, (juce::int64) 1);
+                expectEquals (statistics.numOverflows, (juce::int64) 1);
+                expectEquals (statistics.numErrors, (juce::int64) 2);
+                expectEquals (std::accumulate (statistics.latencyHistogram.begin(),
+                                               statistics.latencyHistogram.end(),
+                                               (juce::int64) 0),
+                              (juce::int64) 2);
+            }
+        }
+
+        beginTest ("Isochronous transfers count the bytes and failures of each packet");
+        {
+            LibUsbTransferCounters counters;
+
+            juce::HeapBlock<juce::uint8> storage (sizeof (libusb_transfer) + 4 * sizeof (libusb_iso_packet_descriptor), true);
+            auto& transfer = *reinterpret_cast<libusb_transfer*> (storage.getData());
+            transfer.type = LIBUSB_TRANSFER_TYPE_ISOCHRONOUS;
+            transfer.status = LIBUSB_TRANSFER_COMPLETED;
+            transfer.num_iso_packets = 4;
+
+            for (auto index {0}; index < transfer.num_iso_packets; ++index)
+            {
+                transfer.iso_packet_desc[index].actual_length = index == 3 ? 0 : 48;
+                transfer.iso_packet_desc[index].status = index == 3 ? LIBUSB_TRANSFER_STALL : LIBUSB_TRANSFER_COMPLETED;
+            }
+
+            counters.transferSubmitted();
+            counters.transferCompleted (transfer, juce::Time::getHighResolutionTicks());
+
+            const auto statistics {counters.getStatistics()};
+            expectEquals (statistics.numBytes, (juce::int64) 144);
+            expectEquals (statistics.numTransfersCompleted, (juce::int64) 1);
+            expectEquals (statistics.numPacketErrors, (juce::int64) 1);
+            expectEquals (statistics.numStalls, (juce::int64) 1);
+        }
+
+        beginTest ("Rates and latency percentiles are worked out from snapshots");
+        {
+            USBTransferStatistics earlier {};
+            earlier.timeTicks = 0;
+
+            USBTransferStatistics later {};
+            later.timeTicks = juce::Time::secondsToHighResolutionTicks (2.0);
+            later.numBytes = 1000;
+            later.numTransfersCompleted = 10;
+
+            expectWithinAbsoluteError (later.getBytesPerSecondSince (earlier), 500.0, 0.01);
+            expectWithinAbsoluteError (later.getTransfersPerSecondSince (earlier), 5.0, 0.01);
+            expectEquals (earlier.getBytesPerSecondSince (earlier), 0.0);
+
+            expectEquals (later.getLatencyPercentileMicroseconds (0.5), 0.0);
+
+            later.latencyHistogram[3] = 90;
+            later.latencyHistogram[10] = 10;
+
+            expectEquals (later.getLatencyPercentileMicroseconds (0.5), 8.0);
+            expectEquals (later.getLatencyPercentileMicroseconds (0.9), 8.0);
+            expectEquals (later.getLatencyPercentileMicroseconds (0.99), 1024.0);
+        }
+
+        beginTest ("A device totals up the transfers of its streams");
+        {
+            LibUsbSimulatedDevices bus;
+
+            auto spec {LibUsbSimulatedDevices::makeDeviceSpec (1)};
+            spec.endpoints.add ({0x81, USBDevice::Endpoint::TransferType::bulk, 512, 0, 1, 4.0e6});
+            bus.addDevice (spec);
+            expect (bus.waitForNumDevices (1));
+
+            const auto device {bus.findDevice (1)};
+            const auto before {device.getStatistics()};
+
+            try
+            {
+                USBEndpointStream::Options options {};
+                options.endpointAddress = 0x81;
+
+                // nothing is read, so this stops well before the buffer
+                // fills and the stream runs out of transfers to submit
+                USBEndpointStream stream {device, options};
+                expect (LibUsbSimulatedDevices::waitUntil ([&] { return stream.getStatistics().numTransfersCompleted >= 2; }));
+
+                const auto streamStatistics {stream.getStatistics()};
+                expect (streamStatistics.numBytes > 0);
+                expect (streamStatistics.numTransfersInFlight > 0);
+                expect (device.getStatistics().numBytes - before.numBytes >= streamStatistics.numBytes);
+            }
+            catch (const std::exception& e)
+            {
+                expect (false, e.what());
+            }
+
+            // the transfers still in flight are cancelled as the stream stops
+            const auto after {device.getStatistics()};
+            expectEquals (after.numTransfersInFlight, (juce::int64) 0);
+            expect (after.numCancellations > before.numCancellations);
+        }
+    }
+};
+
+static USBTransferStatisticsTests usbTransferStatisticsTests;
@@ -2,9 +2,38 @@
 #include "jucey_libusb.h"
 #include "libusb/libusb/libusb.h"
 
+#include <condition_variable>
+#include <limits>
+#include <map>
+#include <numeric>
 #include <unordered_map>
+#include <unordered_set>
 
+#include "utils/jucey_libusb_backend.h"
 #include "utils/jucey_libusb_utils.h"
 
 #include "devices/jucey_USBDevice.cpp"
+#include "devices/jucey_USBDescriptorCache.cpp"
 #include "devices/jucey_USBDeviceManager.cpp"
+#include "streams/jucey_USBEndpointStream.cpp"
+#include "streams/jucey_USBInterruptStream.cpp"
+#include "streams/jucey_USBIsochronousStream.cpp"
+#include "streams/jucey_USBSynchronizedCapture.cpp"
+#include "capture/jucey_USBTrafficCapture.cpp"
+
+#if JUCEY_LIBUSB_ENABLE_SIMULATION
+ #include "simulation/jucey_USBSimulatedBus.cpp"
+ #include "utils/jucey_libusb_simulation_utils.h"
+ #include "benchmarks/jucey_USBBenchmarks.cpp"
+
+ #if JUCE_UNIT_TESTS
+  #include "devices/jucey_USBDevice_test.cpp"
+  #include "devices/jucey_USBTransferStatistics_test.cpp"
+  #include "devices/jucey_USBDeviceManager_test.cpp"
+  #include "devices/jucey_USBDescriptorCache_test.cpp"
+  #include "streams/jucey_USBEndpointStream_test.cpp"
+  #include "streams/jucey_USBInterruptStream_test.cpp"
+  #include "streams/jucey_USBSynchronizedCapture_test.cpp"
+  #include "capture/jucey_USBTrafficCapture_test.cpp"
+ #endif
+#endif
@@ -21,7 +21,34 @@
 
 #pragma once
 
+//==============================================================================
+/** Config: JUCEY_LIBUSB_ENABLE_SIMULATION
+
+    Builds the USBSimulatedBus, the USBBenchmarks and the module's unit
+    tests, and lets every libusb call be redirected to the simulated bus.
+    With this off the module calls libusb directly, so leave it off in
+    anything that ships.
+*/
+#ifndef JUCEY_LIBUSB_ENABLE_SIMULATION
+ #define JUCEY_LIBUSB_ENABLE_SIMULATION 0
+#endif
+
 #include "juce_core/juce_core.h"
+#include <array>
+#include <functional>
+#include <future>
+#include <unordered_map>
 
+#include "devices/jucey_USBTransferStatistics.h"
 #include "devices/jucey_USBDevice.h"
 #include "devices/jucey_USBDeviceManager.h"
+#include "streams/jucey_USBEndpointStream.h"
+#include "streams/jucey_USBInterruptStream.h"
+#include "streams/jucey_USBIsochronousStream.h"
+#include "streams/jucey_USBSynchronizedCapture.h"
+#include "capture/jucey_USBTrafficCapture.h"
+
+#if JUCEY_LIBUSB_ENABLE_SIMULATION
+ #include "simulation/jucey_USBSimulatedBus.h"
+ #include "benchmarks/jucey_USBBenchmarks.h"
+#endif
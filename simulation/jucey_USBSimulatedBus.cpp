@@ -0,0 +1,993 @@
+//==============================================================================
+/** Implements the libusb functions the module uses on top of simulated
+    devices.
+
+    Devices, handles and contexts are plain objects handed to the module as
+    libusb's opaque pointer types. Transfers are queued with the time they're
+    due to complete, based on the rate of their endpoint, and are completed by
+    whichever thread is handling events, exactly as libusb would.
+ */
+class USBSimulatedBus::Pimpl : public LibUsbBackend
+{
+public:
+    Pimpl() = default;
+
+    ~Pimpl() override
+    {
+        removeAllDevices();
+
+        for (const auto& notification : pendingHotplugNotifications)
+            unrefDevice (toLibUsb (notification.device));
+    }
+
+    //==============================================================================
+    int addDevice (const DeviceSpec& spec) noexcept
+    {
+        std::unique_lock<std::mutex> lock (mutex);
+
+        auto& nextAddress = nextAddresses[spec.busNumber];
+        nextAddress = nextAddress % 127 + 1;
+
+        auto* device = new Device (++lastDeviceId, spec, nextAddress);
+        devices.emplace (device->id, device);
+
+        queueHotplugNotifications (*device, LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED);
+        return device->id;
+    }
+
+    bool removeDevice (int deviceId) noexcept
+    {
+        Device* device {nullptr};
+
+        {
+            std::unique_lock<std::mutex> lock (mutex);
+
+            const auto iter {devices.find (deviceId)};
+
+            if (iter == devices.end())
+                return false;
+
+            device = iter->second;
+            devices.erase (iter);
+            disconnect (*device);
+        }
+
+        // the bus holds one reference for as long as the device is plugged in
+        unrefDevice (toLibUsb (device));
+        return true;
+    }
+
+    void removeAllDevices() noexcept
+    {
+        juce::Array<int> deviceIds;
+
+        {
+            std::unique_lock<std::mutex> lock (mutex);
+
+            for (const auto& idAndDevice : devices)
+                deviceIds.add (idAndDevice.first);
+        }
+
+        for (const auto deviceId : deviceIds)
+            removeDevice (deviceId);
+    }
+
+    int getNumDevices() const noexcept
+    {
+        std::unique_lock<std::mutex> lock (mutex);
+        return (int) devices.size();
+    }
+
+    int getNumOpenHandles() const noexcept
+    {
+        return numOpenHandles;
+    }
+
+    int getNumActiveConfigurationReads() const noexcept
+    {
+        return numActiveConfigurationReads;
+    }
+
+    //==============================================================================
+    int init (libusb_context** context) override
+    {
+        *context = reinterpret_cast<libusb_context*> (new Context());
+        return LIBUSB_SUCCESS;
+    }
+
+    void exit (libusb_context* context) override
+    {
+        std::unique_lock<std::mutex> lock (mutex);
+        interruptedContexts.erase (context);
+        delete reinterpret_cast<Context*> (context);
+    }
+
+    int hasCapability (uint32_t capability) override
+    {
+        return capability == LIBUSB_CAP_HAS_HOTPLUG ? 1 : 0;
+    }
+
+    ssize_t getDeviceList (libusb_context*, libusb_device*** list) override
+    {
+        std::unique_lock<std::mutex> lock (mutex);
+
+        auto* deviceList = new libusb_device*[devices.size() + 1];
+        auto index {0};
+
+        for (const auto& idAndDevice : devices)
+            deviceList[index++] = refDevice (toLibUsb (idAndDevice.second));
+
+        deviceList[index] = nullptr;
+        *list = deviceList;
+        return (ssize_t) index;
+    }
+
+    void freeDeviceList (libusb_device** list, int unrefDevices) override
+    {
+        if (list == nullptr)
+            return;
+
+        if (unrefDevices != 0)
+        {
+            for (auto* device = list; *device != nullptr; ++device)
+                unrefDevice (*device);
+        }
+
+        delete[] list;
+    }
+
+    libusb_device* refDevice (libusb_device* device) override
+    {
+        ++toDevice (device)->refCount;
+        return device;
+    }
+
+    void unrefDevice (libusb_device* device) override
+    {
+        if (--toDevice (device)->refCount == 0)
+            delete toDevice (device);
+    }
+
+    int getDeviceDescriptor (libusb_device* device, libusb_device_descriptor* descriptor) override
+    {
+        *descriptor = toDevice (device)->descriptor;
+        return LIBUSB_SUCCESS;
+    }
+
+    // the descriptors live as long as the device, so there's nothing to free
+    int getConfigDescriptor (libusb_device* device, uint8_t index, libusb_config_descriptor** config) override
+    {
+        if (index != 0)
+            return LIBUSB_ERROR_NOT_FOUND;
+
+        *config = &toDevice (device)->config;
+        return LIBUSB_SUCCESS;
+    }
+
+    int getActiveConfigDescriptor (libusb_device* device, libusb_config_descriptor** config) override
+    {
+        ++numActiveConfigurationReads;
+        return getConfigDescriptor (device, 0, config);
+    }
+
+    void freeConfigDescriptor (libusb_config_descriptor*) override
+    {
+    }
+
+    uint8_t getBusNumber (libusb_device* device) override
+    {
+        return (uint8_t) toDevice (device)->spec.busNumber;
+    }
+
+    uint8_t getDeviceAddress (libusb_device* device) override
+    {
+        return (uint8_t) toDevice (device)->address;
+    }
+
+    uint8_t getPortNumber (libusb_device* device) override
+    {
+        const auto& portPath = toDevice (device)->spec.portPath;
+        return portPath.isEmpty() ? 0 : (uint8_t) portPath.getLast();
+    }
+
+    int getPortNumbers (libusb_device* device, uint8_t* portNumbers, int portNumbersLength) override
+    {
+        const auto& portPath = toDevice (device)->spec.portPath;
+
+        if (portPath.size() > portNumbersLength)
+            return LIBUSB_ERROR_OVERFLOW;
+
+        for (auto index {0}; index < portPath.size(); ++index)
+            portNumbers[index] = (uint8_t) portPath[index];
+
+        return portPath.size();
+    }
+
+    int getDeviceSpeed (libusb_device* device) override
+    {
+        return toDevice (device)->speed;
+    }
+
+    //==============================================================================
+    int open (libusb_device* device, libusb_device_handle** handle) override
+    {
+        if ( ! toDevice (device)->connected)
+            return LIBUSB_ERROR_NO_DEVICE;
+
+        *handle = reinterpret_cast<libusb_device_handle*> (new Handle {toDevice (refDevice (device))});
+        ++numOpenHandles;
+        return LIBUSB_SUCCESS;
+    }
+
+    void close (libusb_device_handle* handle) override
+    {
+        auto* deviceHandle = toHandle (handle);
+        unrefDevice (toLibUsb (deviceHandle->device));
+        delete deviceHandle;
+        --numOpenHandles;
+    }
+
+    int getStringDescriptorAscii (libusb_device_handle* handle, uint8_t index, unsigned char* data, int length) override
+    {
+        const auto& device = *toHandle (handle)->device;
+
+        if ( ! device.connected)
+            return LIBUSB_ERROR_NO_DEVICE;
+
+        if (device.spec.descriptorReadDelayMs > 0)
+            juce::Thread::sleep (device.spec.descriptorReadDelayMs);
+
+        const auto string = [&]
+        {
+            switch (index)
+            {
+                case manufacturerNameIndex: return device.spec.manufacturerName;
+                case productNameIndex:      return device.spec.productName;
+                case serialNumberIndex:     return device.spec.serialNumber;
+                default:                    return juce::String();
+            }
+        }();
+
+        if (string.isEmpty() || length <= 0)
+            return LIBUSB_ERROR_INVALID_PARAM;
+
+        const auto numBytes {juce::jmin ((int) string.getNumBytesAsUTF8(), length - 1)};
+        std::memcpy (data, string.toRawUTF8(), (size_t) numBytes);
+        data[numBytes] = 0;
+        return numBytes;
+    }
+
+    int claimInterface (libusb_device_handle* handle, int interfaceNumber) override
+    {
+        if ( ! toHandle (handle)->device->connected)
+            return LIBUSB_ERROR_NO_DEVICE;
+
+        return interfaceNumber == 0 ? LIBUSB_SUCCESS : LIBUSB_ERROR_NOT_FOUND;
+    }
+
+    int releaseInterface (libusb_device_handle* handle, int interfaceNumber) override
+    {
+        return claimInterface (handle, interfaceNumber);
+    }
+
+    int setInterfaceAltSetting (libusb_device_handle* handle, int interfaceNumber, int alternateSetting) override
+    {
+        const auto& device = *toHandle (handle)->device;
+
+        if ( ! device.connected)
+            return LIBUSB_ERROR_NO_DEVICE;
+
+        for (const auto& setting : device.alternateSettings)
+        {
+            if (setting.bInterfaceNumber == interfaceNumber && setting.bAlternateSetting == alternateSetting)
+                return LIBUSB_SUCCESS;
+        }
+
+        return LIBUSB_ERROR_NOT_FOUND;
+    }
+
+    // there's no device memory, so buffers fall back to host memory
+    unsigned char* devMemAlloc (libusb_device_handle*, size_t) override
+    {
+        return nullptr;
+    }
+
+    int devMemFree (libusb_device_handle*, unsigned char*, size_t) override
+    {
+        return LIBUSB_ERROR_NOT_SUPPORTED;
+    }
+
+    // the number of streams granted is limited by the endpoint that supports
+    // the fewest, as the host controller would
+    int allocStreams (libusb_device_handle* handle, uint32_t numStreams, unsigned char* endpoints, int numEndpoints) override
+    {
+        const auto& device = *toHandle (handle)->device;
+
+        if ( ! device.connected)
+            return LIBUSB_ERROR_NO_DEVICE;
+
+        if (numStreams == 0 || numEndpoints <= 0 || device.speed < LIBUSB_SPEED_SUPER)
+            return LIBUSB_ERROR_INVALID_PARAM;
+
+        auto numGranted {(int) juce::jmin (numStreams, (uint32_t) 65533)};
+
+        for (auto index {0}; index < numEndpoints; ++index)
+        {
+            const auto* endpoint {device.findEndpoint (endpoints[index])};
+
+            if (endpoint == nullptr || endpoint->transferType != USBDevice::Endpoint::TransferType::bulk)
+                return LIBUSB_ERROR_INVALID_PARAM;
+
+            const auto exponent {Device::getStreamsExponent (endpoint->maxBulkStreams)};
+
+            if (exponent == 0)
+                return LIBUSB_ERROR_INVALID_PARAM;
+
+            numGranted = juce::jmin (numGranted, 1 << exponent);
+        }
+
+        return numGranted;
+    }
+
+    int freeStreams (libusb_device_handle* handle, unsigned char*, int) override
+    {
+        return toHandle (handle)->device->connected ? LIBUSB_SUCCESS : LIBUSB_ERROR_NO_DEVICE;
+    }
+
+    //==============================================================================
+    libusb_transfer* allocTransfer (int numIsoPackets) override
+    {
+        const auto size {sizeof (TransferHeader)
+                         + sizeof (libusb_transfer)
+                         + sizeof (libusb_iso_packet_descriptor) * (size_t) juce::jmax (0, numIsoPackets)};
+        auto* header = static_cast<TransferHeader*> (std::calloc (1, size));
+
+        if (header == nullptr)
+            return nullptr;
+
+        auto* transfer = toTransfer (header);
+        transfer->num_iso_packets = numIsoPackets;
+        return transfer;
+    }
+
+    void freeTransfer (libusb_transfer* transfer) override
+    {
+        if (transfer == nullptr)
+            return;
+
+        if ((transfer->flags & LIBUSB_TRANSFER_FREE_BUFFER) != 0)
+            std::free (transfer->buffer);
+
+        std::free (toHeader (transfer));
+    }
+
+    int submitTransfer (libusb_transfer* transfer) override
+    {
+        std::unique_lock<std::mutex> lock (mutex);
+
+        auto& device = *toHandle (transfer->dev_handle)->device;
+
+        if ( ! device.connected)
+            return LIBUSB_ERROR_NO_DEVICE;
+
+        if (pendingTransferLookup.find (transfer) != pendingTransferLookup.end())
+            return LIBUSB_ERROR_BUSY;
+
+        const auto* endpoint {device.findEndpoint (transfer->endpoint)};
+
+        if (endpoint == nullptr && transfer->type != LIBUSB_TRANSFER_TYPE_CONTROL)
+            return LIBUSB_ERROR_NOT_FOUND;
+
+        // transfers on one endpoint complete one after the other, so each
+        // one starts when the previous one finishes
+        const auto now {juce::Time::getHighResolutionTicks()};
+        const auto duration {getTransferDuration (device, endpoint, *transfer)};
+        auto& busyUntil = device.endpointsBusyUntil[transfer->endpoint];
+        auto dueTime {juce::jmax (now, busyUntil) + duration};
+        busyUntil = dueTime;
+
+        // a device works on all its bulk streams at once, so a transfer on a
+        // stream can complete up to two transfers' time after its turn,
+        // behind transfers submitted after it
+        if (transfer->type == LIBUSB_TRANSFER_TYPE_BULK_STREAM)
+            dueTime += (juce::int64) (random.nextDouble() * 2.0 * (double) duration);
+
+        toHeader (transfer)->sequenceNumber = device.endpointsSubmitted[transfer->endpoint]++;
+
+        schedule (transfer, dueTime, LIBUSB_TRANSFER_COMPLETED);
+        return LIBUSB_SUCCESS;
+    }
+
+    void transferSetStreamId (libusb_transfer* transfer, uint32_t streamId) override
+    {
+        toHeader (transfer)->streamId = streamId;
+    }
+
+    int cancelTransfer (libusb_transfer* transfer) override
+    {
+        std::unique_lock<std::mutex> lock (mutex);
+
+        const auto iter {pendingTransferLookup.find (transfer)};
+
+        if (iter == pendingTransferLookup.end() || iter->second->second.status != LIBUSB_TRANSFER_COMPLETED)
+            return LIBUSB_ERROR_NOT_FOUND;
+
+        unschedule (transfer);
+        schedule (transfer, 0, LIBUSB_TRANSFER_CANCELLED);
+        return LIBUSB_SUCCESS;
+    }
+
+    //==============================================================================
+    int handleEventsTimeoutCompleted (libusb_context* context, timeval* timeout, int*) override
+    {
+        juce::Array<PendingTransfer> completedTransfers;
+        juce::Array<HotplugNotification> notifications;
+
+        {
+            std::unique_lock<std::mutex> lock (mutex);
+
+            const auto ticksPerSecond {juce::Time::getHighResolutionTicksPerSecond()};
+            const auto timeoutTicks {timeout == nullptr ? (juce::int64) 0
+                                                        : (juce::int64) timeout->tv_sec * ticksPerSecond
+                                                            + (juce::int64) timeout->tv_usec * ticksPerSecond / 1000000};
+            const auto deadline {juce::Time::getHighResolutionTicks() + timeoutTicks};
+
+            for (;;)
+            {
+                if (interruptedContexts.erase (context) > 0)
+                    return LIBUSB_SUCCESS;
+
+                const auto now {juce::Time::getHighResolutionTicks()};
+
+                if (hasHotplugNotificationsFor (context) || isTransferDue (now) || now >= deadline)
+                    break;
+
+                const auto wakeTime {pendingTransfers.empty() ? deadline
+                                                              : juce::jmin (deadline, pendingTransfers.begin()->first)};
+
+                eventsAvailable.wait_for (lock, std::chrono::microseconds (juce::jmax ((juce::int64) 1, (wakeTime - now) * 1000000 / ticksPerSecond)));
+            }
+
+            // hotplug callbacks only run on the thread handling events for
+            // the context they were registered with
+            for (auto index {0}; index < pendingHotplugNotifications.size();)
+            {
+                if (pendingHotplugNotifications.getReference (index).context == context)
+                    notifications.add (pendingHotplugNotifications.removeAndReturn (index));
+                else
+                    ++index;
+            }
+
+            const auto now {juce::Time::getHighResolutionTicks()};
+
+            while (isTransferDue (now))
+            {
+                completedTransfers.add (pendingTransfers.begin()->second);
+                unschedule (pendingTransfers.begin()->second.transfer);
+            }
+        }
+
+        // libusb calls back on the thread handling events with nothing locked
+        for (const auto& notification : notifications)
+        {
+            if (notification.callback (notification.context, toLibUsb (notification.device), notification.event, notification.userData) != 0)
+                hotplugDeregisterCallback (notification.context, notification.callbackHandle);
+
+            unrefDevice (toLibUsb (notification.device));
+        }
+
+        for (const auto& completed : completedTransfers)
+            complete (*completed.transfer, completed.status, completed.dueTime);
+
+        return LIBUSB_SUCCESS;
+    }
+
+    void interruptEventHandler (libusb_context* context) override
+    {
+        std::unique_lock<std::mutex> lock (mutex);
+        interruptedContexts.insert (context);
+        eventsAvailable.notify_all();
+    }
+
+    int hotplugRegisterCallback (libusb_context* context,
+                                 int events,
+                                 int,
+                                 int,
+                                 int,
+                                 int,
+                                 libusb_hotplug_callback_fn callback,
+                                 void* userData,
+                                 libusb_hotplug_callback_handle* callbackHandle) override
+    {
+        std::unique_lock<std::mutex> lock (mutex);
+
+        const HotplugCallback hotplugCallback {++lastCallbackHandle, context, events, callback, userData};
+        hotplugCallbacks.add (hotplugCallback);
+
+        if (callbackHandle != nullptr)
+            *callbackHandle = hotplugCallback.handle;
+
+        return LIBUSB_SUCCESS;
+    }
+
+    void hotplugDeregisterCallback (libusb_context*, libusb_hotplug_callback_handle callbackHandle) override
+    {
+        juce::Array<HotplugNotification> notifications;
+
+        {
+            std::unique_lock<std::mutex> lock (mutex);
+
+            hotplugCallbacks.removeIf ([callbackHandle] (const HotplugCallback& callback)
+            {
+                return callback.handle == callbackHandle;
+            });
+
+            // no more calls once a callback is deregistered
+            for (auto index {pendingHotplugNotifications.size()}; --index >= 0;)
+            {
+                if (pendingHotplugNotifications.getReference (index).callbackHandle == callbackHandle)
+                    notifications.add (pendingHotplugNotifications.removeAndReturn (index));
+            }
+        }
+
+        for (const auto& notification : notifications)
+            unrefDevice (toLibUsb (notification.device));
+    }
+
+private:
+    enum
+    {
+        manufacturerNameIndex = 1,
+        productNameIndex,
+        serialNumberIndex
+    };
+
+    //==============================================================================
+    struct Context
+    {
+        int unused {0};
+    };
+
+    struct Device
+    {
+        Device (int deviceId, const DeviceSpec& deviceSpec, int deviceAddress) noexcept
+            : id (deviceId)
+            , spec (deviceSpec)
+            , address (deviceAddress)
+            , speed (toLibUsbSpeed (deviceSpec.speed))
+        {
+            descriptor.bLength = LIBUSB_DT_DEVICE_SIZE;
+            descriptor.bDescriptorType = LIBUSB_DT_DEVICE;
+            descriptor.bcdUSB = speed >= LIBUSB_SPEED_SUPER ? 0x0300 : 0x0200;
+            descriptor.bDeviceClass = (uint8_t) spec.deviceClass;
+            descriptor.bMaxPacketSize0 = 64;
+            descriptor.idVendor = (uint16_t) spec.vendorId;
+            descriptor.idProduct = (uint16_t) spec.productId;
+            descriptor.bcdDevice = (uint16_t) spec.deviceVersion;
+            descriptor.iManufacturer = spec.manufacturerName.isEmpty() ? 0 : manufacturerNameIndex;
+            descriptor.iProduct = spec.productName.isEmpty() ? 0 : productNameIndex;
+            descriptor.iSerialNumber = spec.serialNumber.isEmpty() ? 0 : serialNumberIndex;
+            descriptor.bNumConfigurations = 1;
+
+            // endpoints are grouped by alternate setting so each setting can
+            // point at a run of them, setting zero always exists
+            auto endpoints {spec.endpoints};
+            std::stable_sort (endpoints.begin(), endpoints.end(), [] (const EndpointSpec& a, const EndpointSpec& b)
+            {
+                return a.alternateSetting < b.alternateSetting;
+            });
+
+            // at SuperSpeed every endpoint is followed by a companion
+            // descriptor, which is where support for bulk streams is found
+            const auto superSpeed {speed >= LIBUSB_SPEED_SUPER};
+
+            if (superSpeed)
+                companionDescriptors.resize ((size_t) endpoints.size() * LIBUSB_DT_SS_ENDPOINT_COMPANION_SIZE);
+
+            for (const auto& endpoint : endpoints)
+            {
+                libusb_endpoint_descriptor endpointDescriptor {};
+                endpointDescriptor.bLength = LIBUSB_DT_ENDPOINT_SIZE;
+                endpointDescriptor.bDescriptorType = LIBUSB_DT_ENDPOINT;
+                endpointDescriptor.bEndpointAddress = (uint8_t) endpoint.address;
+                endpointDescriptor.bmAttributes = (uint8_t) toLibUsbTransferType (endpoint.transferType);
+                endpointDescriptor.wMaxPacketSize = (uint16_t) endpoint.maxPacketSize;
+                endpointDescriptor.bInterval = (uint8_t) endpoint.interval;
+
+                if (superSpeed)
+                {
+                    auto* companion = companionDescriptors.data() + endpointDescriptors.size() * LIBUSB_DT_SS_ENDPOINT_COMPANION_SIZE;
+                    const auto isBulk {endpoint.transferType == USBDevice::Endpoint::TransferType::bulk};
+
+                    companion[0] = LIBUSB_DT_SS_ENDPOINT_COMPANION_SIZE;
+                    companion[1] = LIBUSB_DT_SS_ENDPOINT_COMPANION;
+                    companion[2] = 0;
+                    companion[3] = (uint8_t) (isBulk ? getStreamsExponent (endpoint.maxBulkStreams) : 0);
+                    companion[4] = (uint8_t) (isBulk ? 0 : endpoint.maxPacketSize & 0xff);
+                    companion[5] = (uint8_t) (isBulk ? 0 : (endpoint.maxPacketSize >> 8) & 0xff);
+
+                    endpointDescriptor.extra = companion;
+                    endpointDescriptor.extra_length = LIBUSB_DT_SS_ENDPOINT_COMPANION_SIZE;
+                }
+
+                endpointDescriptors.push_back (endpointDescriptor);
+            }
+
+            auto firstEndpoint {0};
+
+            for (auto alternateSetting {0}; firstEndpoint < (int) endpoints.size() || alternateSetting == 0; ++alternateSetting)
+            {
+                auto numEndpoints {0};
+
+                while (firstEndpoint + numEndpoints < (int) endpoints.size()
+                       && endpoints.getReference (firstEndpoint + numEndpoints).alternateSetting == alternateSetting)
+                {
+                    ++numEndpoints;
+                }
+
+                libusb_interface_descriptor setting {};
+                setting.bLength = LIBUSB_DT_INTERFACE_SIZE;
+                setting.bDescriptorType = LIBUSB_DT_INTERFACE;
+                setting.bInterfaceNumber = 0;
+                setting.bAlternateSetting = (uint8_t) alternateSetting;
+                setting.bNumEndpoints = (uint8_t) numEndpoints;
+                setting.bInterfaceClass = (uint8_t) spec.interfaceClass;
+                setting.endpoint = numEndpoints > 0 ? endpointDescriptors.data() + firstEndpoint : nullptr;
+                alternateSettings.push_back (setting);
+
+                firstEndpoint += numEndpoints;
+            }
+
+            usbInterface.altsetting = alternateSettings.data();
+            usbInterface.num_altsetting = (int) alternateSettings.size();
+
+            config.bLength = LIBUSB_DT_CONFIG_SIZE;
+            config.bDescriptorType = LIBUSB_DT_CONFIG;
+            config.bNumInterfaces = 1;
+            config.bConfigurationValue = 1;
+            config.MaxPower = 50;
+            config.interface = &usbInterface;
+        }
+
+        static int getStreamsExponent (int maxBulkStreams) noexcept
+        {
+            auto exponent {0};
+
+            while (exponent < 16 && (2 << exponent) <= maxBulkStreams)
+                ++exponent;
+
+            return exponent;
+        }
+
+        const EndpointSpec* findEndpoint (int endpointAddress) const noexcept
+        {
+            for (const auto& endpoint : spec.endpoints)
+            {
+                if (endpoint.address == endpointAddress)
+                    return &endpoint;
+            }
+
+            return nullptr;
+        }
+
+        std::atomic<int> refCount {1};
+        std::atomic<bool> connected {true};
+
+        const int id;
+        const DeviceSpec spec;
+        const int address;
+        const libusb_speed speed;
+
+        libusb_device_descriptor descriptor {};
+        std::vector<libusb_endpoint_descriptor> endpointDescriptors;
+        std::vector<unsigned char> companionDescriptors;
+        std::vector<libusb_interface_descriptor> alternateSettings;
+        libusb_interface usbInterface {};
+        libusb_config_descriptor config {};
+
+        // guarded by the bus mutex
+        std::unordered_map<int, juce::int64> endpointsBusyUntil;
+        std::unordered_map<int, juce::int64> endpointsSubmitted;
+
+        JUCE_DECLARE_NON_COPYABLE (Device)
+    };
+
+    struct Handle
+    {
+        Device* device;
+    };
+
+    // like libusb, the parts of a transfer that aren't public are kept in
+    // front of it
+    struct alignas (libusb_transfer) TransferHeader
+    {
+        uint32_t streamId;
+
+        // the number of transfers submitted to the endpoint before this one
+        juce::int64 sequenceNumber;
+    };
+
+    struct PendingTransfer
+    {
+        libusb_transfer* transfer;
+        libusb_transfer_status status;
+        juce::int64 dueTime;
+    };
+
+    struct HotplugCallback
+    {
+        libusb_hotplug_callback_handle handle;
+        libusb_context* context;
+        int events;
+        libusb_hotplug_callback_fn callback;
+        void* userData;
+    };
+
+    struct HotplugNotification
+    {
+        libusb_hotplug_callback_handle callbackHandle;
+        libusb_context* context;
+        libusb_hotplug_callback_fn callback;
+        void* userData;
+        Device* device;
+        libusb_hotplug_event event;
+    };
+
+    //==============================================================================
+    static Device* toDevice (libusb_device* device) noexcept                 { return reinterpret_cast<Device*> (device); }
+    static libusb_device* toLibUsb (Device* device) noexcept                 { return reinterpret_cast<libusb_device*> (device); }
+    static Handle* toHandle (libusb_device_handle* handle) noexcept          { return reinterpret_cast<Handle*> (handle); }
+    static libusb_transfer* toTransfer (TransferHeader* header) noexcept    { return reinterpret_cast<libusb_transfer*> (header + 1); }
+    static TransferHeader* toHeader (libusb_transfer* transfer) noexcept    { return reinterpret_cast<TransferHeader*> (transfer) - 1; }
+
+    static libusb_speed toLibUsbSpeed (Speed speed) noexcept
+    {
+        switch (speed)
+        {
+            case Speed::low:        return LIBUSB_SPEED_LOW;
+            case Speed::full:       return LIBUSB_SPEED_FULL;
+            case Speed::high:       return LIBUSB_SPEED_HIGH;
+            case Speed::super:      return LIBUSB_SPEED_SUPER;
+            case Speed::superPlus:  return LIBUSB_SPEED_SUPER_PLUS;
+            default:                return LIBUSB_SPEED_UNKNOWN;
+        }
+    }
+
+    static int toLibUsbTransferType (USBDevice::Endpoint::TransferType transferType) noexcept
+    {
+        switch (transferType)
+        {
+            case USBDevice::Endpoint::TransferType::isochronous:    return LIBUSB_ENDPOINT_TRANSFER_TYPE_ISOCHRONOUS;
+            case USBDevice::Endpoint::TransferType::bulk:           return LIBUSB_ENDPOINT_TRANSFER_TYPE_BULK;
+            case USBDevice::Endpoint::TransferType::interrupt:      return LIBUSB_ENDPOINT_TRANSFER_TYPE_INTERRUPT;
+            case USBDevice::Endpoint::TransferType::control:
+            default:                                                return LIBUSB_ENDPOINT_TRANSFER_TYPE_CONTROL;
+        }
+    }
+
+    static juce::int64 getTransferDuration (const Device& device,
+                                            const EndpointSpec* endpoint,
+                                            const libusb_transfer& transfer) noexcept
+    {
+        const auto ticksPerSecond {(double) juce::Time::getHighResolutionTicksPerSecond()};
+
+        if (endpoint == nullptr)
+            return 0;
+
+        if (endpoint->bytesPerSecond > 0.0)
+            return (juce::int64) (ticksPerSecond * transfer.length / endpoint->bytesPerSecond);
+
+        if (endpoint->transferType != USBDevice::Endpoint::TransferType::isochronous)
+            return 0;
+
+        // one packet per service interval, which is a number of 1 ms frames
+        // at full speed or 125 us microframes at high speed and above
+        const auto frameSeconds {device.speed >= LIBUSB_SPEED_HIGH ? 0.000125 : 0.001};
+        const auto interval {1 << juce::jlimit (0, 15, endpoint->interval - 1)};
+        return (juce::int64) (ticksPerSecond * frameSeconds * interval * transfer.num_iso_packets);
+    }
+
+    static void complete (libusb_transfer& transfer, libusb_transfer_status status, juce::int64 dueTime) noexcept
+    {
+        const auto completed {status == LIBUSB_TRANSFER_COMPLETED};
+        const auto stampData {completed
+                              && transfer.type != LIBUSB_TRANSFER_TYPE_CONTROL
+                              && (transfer.endpoint & LIBUSB_ENDPOINT_DIR_MASK) == LIBUSB_ENDPOINT_IN};
+
+        // the length of a control transfer includes its setup packet, but the
+        // actual length doesn't
+        const auto setupSize {transfer.type == LIBUSB_TRANSFER_TYPE_CONTROL ? LIBUSB_CONTROL_SETUP_SIZE : 0};
+
+        transfer.status = status;
+        transfer.actual_length = completed ? juce::jmax (0, transfer.length - setupSize) : 0;
+
+        const auto sequenceNumber {toHeader (&transfer)->sequenceNumber};
+
+        if (stampData && transfer.num_iso_packets == 0)
+            stamp (transfer.buffer, transfer.actual_length, dueTime, sequenceNumber);
+
+        for (auto index {0}, offset {0}; index < transfer.num_iso_packets; ++index)
+        {
+            auto& packet = transfer.iso_packet_desc[index];
+            packet.actual_length = completed ? packet.length : 0;
+            packet.status = status;
+
+            if (stampData)
+                stamp (transfer.buffer + offset, (int) packet.actual_length, dueTime, sequenceNumber);
+
+            offset += (int) packet.length;
+        }
+
+        if (transfer.callback != nullptr)
+            transfer.callback (&transfer);
+    }
+
+    static void stamp (unsigned char* data, int length, juce::int64 dueTime, juce::int64 sequenceNumber) noexcept
+    {
+        if (length >= (int) sizeof (dueTime))
+            std::memcpy (data, &dueTime, sizeof (dueTime));
+
+        if (length >= (int) (sizeof (dueTime) + sizeof (sequenceNumber)))
+            std::memcpy (data + sizeof (dueTime), &sequenceNumber, sizeof (sequenceNumber));
+    }
+
+    //==============================================================================
+    // all of these are called with the mutex locked
+    void schedule (libusb_transfer* transfer, juce::int64 dueTime, libusb_transfer_status status) noexcept
+    {
+        const auto iter {pendingTransfers.emplace (dueTime, PendingTransfer {transfer, status, dueTime})};
+        pendingTransferLookup.emplace (transfer, iter);
+        eventsAvailable.notify_all();
+    }
+
+    void unschedule (libusb_transfer* transfer) noexcept
+    {
+        const auto lookup {pendingTransferLookup.find (transfer)};
+        pendingTransfers.erase (lookup->second);
+        pendingTransferLookup.erase (lookup);
+    }
+
+    bool hasHotplugNotificationsFor (libusb_context* context) const noexcept
+    {
+        return std::any_of (pendingHotplugNotifications.begin(),
+                            pendingHotplugNotifications.end(),
+                            [context] (const HotplugNotification& notification) { return notification.context == context; });
+    }
+
+    // transfers aren't tied to a context here, any thread handling events
+    // completes them
+    bool isTransferDue (juce::int64 now) const noexcept
+    {
+        return ! pendingTransfers.empty() && pendingTransfers.begin()->first <= now;
+    }
+
+    void disconnect (Device& device) noexcept
+    {
+        device.connected = false;
+
+        juce::Array<libusb_transfer*> transfersToFail;
+
+        for (const auto& dueAndTransfer : pendingTransfers)
+        {
+            const auto* transfer = dueAndTransfer.second.transfer;
+
+            if (toHandle (transfer->dev_handle)->device == &device
+                && dueAndTransfer.second.status == LIBUSB_TRANSFER_COMPLETED)
+            {
+                transfersToFail.add (dueAndTransfer.second.transfer);
+            }
+        }
+
+        for (auto* transfer : transfersToFail)
+        {
+            unschedule (transfer);
+            schedule (transfer, 0, LIBUSB_TRANSFER_NO_DEVICE);
+        }
+
+        queueHotplugNotifications (device, LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT);
+    }
+
+    void queueHotplugNotifications (Device& device, libusb_hotplug_event event) noexcept
+    {
+        for (const auto& callback : hotplugCallbacks)
+        {
+            if ((callback.events & event) == 0)
+                continue;
+
+            refDevice (toLibUsb (&device));
+            pendingHotplugNotifications.add ({callback.handle,
+                                              callback.context,
+                                              callback.callback,
+                                              callback.userData,
+                                              &device,
+                                              event});
+        }
+
+        eventsAvailable.notify_all();
+    }
+
+    //==============================================================================
+    mutable std::mutex mutex;
+    std::condition_variable eventsAvailable;
+
+    std::map<int, Device*> devices;
+    std::unordered_map<int, int> nextAddresses;
+    int lastDeviceId {0};
+    std::atomic<int> numOpenHandles {0};
+    std::atomic<int> numActiveConfigurationReads {0};
+
+    std::multimap<juce::int64, PendingTransfer> pendingTransfers;
+    std::unordered_map<libusb_transfer*, std::multimap<juce::int64, PendingTransfer>::iterator> pendingTransferLookup;
+
+    juce::Array<HotplugCallback> hotplugCallbacks;
+    juce::Array<HotplugNotification> pendingHotplugNotifications;
+    libusb_hotplug_callback_handle lastCallbackHandle {0};
+
+    std::unordered_set<libusb_context*> interruptedContexts;
+    juce::Random random;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (Pimpl)
+};
+
+//==============================================================================
+USBSimulatedBus& USBSimulatedBus::getInstance()
+{
+    static USBSimulatedBus instance;
+    return instance;
+}
+
+USBSimulatedBus::USBSimulatedBus() noexcept
+    : pimpl (std::make_unique<Pimpl>())
+{
+}
+
+USBSimulatedBus::~USBSimulatedBus() noexcept
+{
+    uninstall();
+}
+
+void USBSimulatedBus::install() noexcept
+{
+    LibUsbBackend::setCurrent (pimpl.get());
+}
+
+void USBSimulatedBus::uninstall() noexcept
+{
+    if (isInstalled())
+        LibUsbBackend::setCurrent (nullptr);
+}
+
+bool USBSimulatedBus::isInstalled() const noexcept
+{
+    return &LibUsbBackend::getCurrent() == pimpl.get();
+}
+
+int USBSimulatedBus::addDevice (const DeviceSpec& spec) noexcept
+{
+    return pimpl->addDevice (spec);
+}
+
+bool USBSimulatedBus::removeDevice (int deviceId) noexcept
+{
+    return pimpl->removeDevice (deviceId);
+}
+
+void USBSimulatedBus::removeAllDevices() noexcept
+{
+    pimpl->removeAllDevices();
+}
+
+int USBSimulatedBus::getNumDevices() const noexcept
+{
+    return pimpl->getNumDevices();
+}
+
+int USBSimulatedBus::getNumOpenHandles() const noexcept
+{
+    return pimpl->getNumOpenHandles();
+}
+
+int USBSimulatedBus::getNumActiveConfigurationReads() const noexcept
+{
+    return pimpl->getNumActiveConfigurationReads();
+}
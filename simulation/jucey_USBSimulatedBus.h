@@ -0,0 +1,149 @@
+#pragma once
+
+//==============================================================================
+/** An in-process USB bus that stands in for libusb, so the USBDeviceManager
+    and the streams can be exercised and measured without any hardware.
+
+    Once installed every device the module sees is a simulated one. Devices
+    can be added and removed at any time and are reported through the same
+    hotplug path as real devices. Reading their descriptor strings can be made
+    artificially slow, and their endpoints move data at a configurable rate.
+
+    Data received from an IN endpoint starts with the
+    juce::Time::getHighResolutionTicks() value at which the transfer
+    completed, followed by the number of transfers submitted to the endpoint
+    before it, both as juce::int64. For isochronous endpoints they're at the
+    start of every packet. This lets the time taken to deliver the data be
+    measured and the order it arrives in be checked.
+
+    This is only built when JUCEY_LIBUSB_ENABLE_SIMULATION is enabled.
+
+    @code
+    auto& bus = USBSimulatedBus::getInstance();
+    bus.install();
+
+    USBSimulatedBus::DeviceSpec spec;
+    spec.vendorId = 0x1234;
+    spec.productId = 0x0001;
+    spec.endpoints.add ({0x81, USBDevice::Endpoint::TransferType::bulk, 512, 0, 1, 40.0e6});
+
+    const auto id = bus.addDevice (spec);
+    @endcode
+ */
+class USBSimulatedBus
+{
+public:
+    /** Returns the one and only instance of this object */
+    static USBSimulatedBus& getInstance();
+
+    /** Destructor. */
+    ~USBSimulatedBus() noexcept;
+
+    enum class Speed
+    {
+        low,
+        full,
+        high,
+        super,
+        superPlus
+    };
+
+    /** Describes one endpoint of a simulated device, all endpoints belong to
+        interface zero.
+     */
+    struct EndpointSpec
+    {
+        int address {0x81};
+        USBDevice::Endpoint::TransferType transferType {USBDevice::Endpoint::TransferType::bulk};
+        int maxPacketSize {512};
+        int alternateSetting {0};
+        int interval {1};
+
+        /** The rate data moves at in bytes per second.
+
+            For bulk and interrupt endpoints zero completes transfers as soon
+            as they're submitted, isochronous endpoints default to one packet
+            per service interval.
+         */
+        double bytesPerSecond {0.0};
+
+        /** The number of SuperSpeed bulk streams a bulk endpoint supports,
+            rounded down to a power of two. This is only reported when the
+            device runs at SuperSpeed or above. Transfers on streams don't
+            complete in the order they were submitted.
+         */
+        int maxBulkStreams {0};
+    };
+
+    /** Describes a simulated device. */
+    struct DeviceSpec
+    {
+        int vendorId {0};
+        int productId {0};
+        int deviceVersion {0x0100};
+        int deviceClass {0};
+        int interfaceClass {0xff};
+        Speed speed {Speed::high};
+
+        /** The bus and the ports from the root hub outwards. */
+        int busNumber {1};
+        juce::Array<int> portPath {1};
+
+        juce::String manufacturerName;
+        juce::String productName;
+        juce::String serialNumber;
+
+        /** How long it takes to read each descriptor string. */
+        int descriptorReadDelayMs {0};
+
+        juce::Array<EndpointSpec> endpoints;
+    };
+
+    /** Makes the module use this bus instead of libusb.
+
+        This has to be called before USBDeviceManager::getInstance() or any
+        other use of the module.
+     */
+    void install() noexcept;
+
+    /** Goes back to using libusb, only call this once nothing from the module
+        is in use.
+     */
+    void uninstall() noexcept;
+
+    /** Returns true if the module is using this bus. */
+    bool isInstalled() const noexcept;
+
+    /** Plugs in a device and returns an ID that can be used to remove it. */
+    int addDevice (const DeviceSpec& spec) noexcept;
+
+    /** Unplugs a device, any transfers in flight complete with a no device
+        error. Returns false if there's no device with the ID.
+     */
+    bool removeDevice (int deviceId) noexcept;
+
+    /** Unplugs every device. */
+    void removeAllDevices() noexcept;
+
+    /** Returns the number of devices plugged in. */
+    int getNumDevices() const noexcept;
+
+    /** Returns the number of handles the module has open to devices on the
+        bus.
+     */
+    int getNumOpenHandles() const noexcept;
+
+    /** Returns the number of times the module has asked for the active
+        configuration of a device on the bus.
+     */
+    int getNumActiveConfigurationReads() const noexcept;
+
+private:
+    /** Default constructor. */
+    USBSimulatedBus() noexcept;
+
+    class Pimpl;
+    std::unique_ptr<Pimpl> pimpl;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (USBSimulatedBus)
+};
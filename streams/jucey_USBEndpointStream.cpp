@@ -0,0 +1,662 @@
+
+//==============================================================================
+class USBEndpointStream::Pimpl
+{
+public:
+    Pimpl (const std::shared_ptr<USBDevice::Pimpl>& devicePimpl, const Options& streamOptions)
+        : device (devicePimpl)
+        , options (streamOptions)
+        , input ((options.endpointAddress & LIBUSB_ENDPOINT_DIR_MASK) == LIBUSB_ENDPOINT_IN)
+        , claimedInterface (*device, options.interfaceNumber)
+    {
+        jassert (options.tuning.enabled || options.numTransfers > 0);
+        jassert (options.tuning.enabled || options.transferSize > 0);
+
+        // zero leaves the current alternate setting, so any setting of the
+        // interface may hold the endpoint
+        const auto endpointIndex {device->findActiveEndpoint (options.interfaceNumber,
+                                                              options.alternateSetting != 0 ? options.alternateSetting : -1,
+                                                              options.endpointAddress)};
+
+        if (endpointIndex < 0)
+            throwOnLibUsbError (LIBUSB_ERROR_NOT_FOUND);
+
+        const auto& endpoint = device->descriptorTree->getEndpoint (endpointIndex);
+
+        maxPacketSize = (int) endpoint.maxPacketSize;
+        options.transferSize = roundToPackets (options.transferSize);
+
+        auto numTransfersToAllocate {options.numTransfers};
+        auto transferSizeToAllocate {options.transferSize};
+
+        if (options.tuning.enabled)
+        {
+            options.tuning.maxNumTransfers = juce::jmax (minNumTransfers, options.tuning.maxNumTransfers);
+            options.tuning.maxTransferSize = roundToPackets (juce::jmax (1, options.tuning.maxTransferSize));
+
+            numTransfersToAllocate = options.tuning.maxNumTransfers;
+            transferSizeToAllocate = options.tuning.maxTransferSize;
+
+            // start with enough transfers to cover about a millisecond of the
+            // bus each, and grow or shrink from there
+            transferSize = juce::jmin (options.tuning.maxTransferSize,
+                                       roundToPackets (getBytesPerMillisecond (device->speed)));
+            numTransfers = juce::jmin (initialNumTransfers, options.tuning.maxNumTransfers);
+
+            bestTransferSize = transferSize;
+            bestNumTransfers = numTransfers;
+        }
+        else
+        {
+            transferSize = options.transferSize;
+            numTransfers = options.numTransfers;
+        }
+
+        if (options.bufferSize <= 0)
+            options.bufferSize = 2 * numTransfersToAllocate * transferSizeToAllocate;
+
+        // the buffer should be able to hold every transfer that can be in flight
+        jassert (options.bufferSize >= numTransfersToAllocate * transferSizeToAllocate);
+
+        if (options.alternateSetting != 0)
+        {
+            throwOnLibUsbError (getLibUsbBackend().setInterfaceAltSetting (device->getHandle(),
+                                                                           options.interfaceNumber,
+                                                                           options.alternateSetting));
+        }
+
+        // selecting an alternate setting frees any streams, so they're
+        // allocated after it
+        if (options.numBulkStreams > 0)
+        {
+            if (endpoint.maxBulkStreamsExponent == 0)
+                throwOnLibUsbError (LIBUSB_ERROR_NOT_SUPPORTED);
+
+            bulkStreams = std::make_unique<BulkStreams> (device->getHandle(),
+                                                         options.endpointAddress,
+                                                         juce::jmin (options.numBulkStreams, 1 << endpoint.maxBulkStreamsExponent));
+
+            options.numBulkStreams = bulkStreams->numStreams;
+        }
+
+        fifo = std::make_unique<ByteFifo> (options.bufferSize);
+        sequenceNumbers.calloc ((size_t) numTransfersToAllocate);
+        completedTransfers.ensureStorageAllocated (numTransfersToAllocate);
+
+        for (auto index {0}; index < numTransfersToAllocate; ++index)
+        {
+            auto* transfer = transfers.add (std::make_unique<LibUsbTransfer> (device->getBufferPool(),
+                                                                              transferSizeToAllocate));
+
+            libusb_fill_bulk_transfer (transfer->transfer,
+                                       device->getHandle(),
+                                       (unsigned char) options.endpointAddress,
+                                       transfer->buffer.getData(),
+                                       transferSizeToAllocate,
+                                       transferCallback,
+                                       transfer,
+                                       0);
+
+            // the stream ID is set each time the transfer is submitted, and
+            // through the backend as libusb keeps it outside the transfer
+            if (bulkStreams != nullptr)
+                transfer->transfer->type = LIBUSB_TRANSFER_TYPE_BULK_STREAM;
+
+            transfer->owner = this;
+            idleTransfers.add (transfer->transfer);
+        }
+
+        std::unique_lock<std::mutex> lock (mutex);
+        running = true;
+        tuningWindowStart = juce::Time::getHighResolutionTicks();
+        submitIdleTransfers();
+
+        if ( ! running)
+        {
+            const auto error {lastError};
+            lock.unlock();
+            stop();
+
+            throw std::runtime_error (error.toStdString());
+        }
+    }
+
+    ~Pimpl() noexcept
+    {
+        stop();
+    }
+
+    Options getOptions() const noexcept
+    {
+        return options;
+    }
+
+    int getTransferSize() const noexcept
+    {
+        return transferSize;
+    }
+
+    int getNumTransfers() const noexcept
+    {
+        return numTransfers;
+    }
+
+    int getNumBulkStreams() const noexcept
+    {
+        return options.numBulkStreams;
+    }
+
+    bool isInput() const noexcept
+    {
+        return input;
+    }
+
+    bool isRunning() const noexcept
+    {
+        return running;
+    }
+
+    USBTransferStatistics getStatistics() const noexcept
+    {
+        return counters.getStatistics();
+    }
+
+    juce::String getLastError() const noexcept
+    {
+        std::unique_lock<std::mutex> lock (mutex);
+        return lastError;
+    }
+
+    int getNumBytesAvailable() const noexcept
+    {
+        return input ? fifo->getNumReady() : fifo->getFreeSpace();
+    }
+
+    bool waitUntilReady (int timeoutMs) const noexcept
+    {
+        std::unique_lock<std::mutex> lock (mutex);
+
+        return stateChanged.wait_for (lock,
+                                      std::chrono::milliseconds (timeoutMs),
+                                      [this] { return getNumBytesAvailable() > 0 || ! running; })
+            && getNumBytesAvailable() > 0;
+    }
+
+    int read (void* destBuffer, int maxBytes) noexcept
+    {
+        // you can only read from an IN endpoint!
+        jassert (input);
+
+        const auto numBytesRead {fifo->read (destBuffer, maxBytes)};
+
+        if (numBytesRead > 0)
+        {
+            std::unique_lock<std::mutex> lock (mutex);
+            submitIdleTransfers();
+        }
+
+        return numBytesRead;
+    }
+
+    int write (const void* sourceData, int numBytes) noexcept
+    {
+        // you can only write to an OUT endpoint!
+        jassert ( ! input);
+
+        const auto numBytesWritten {fifo->write (sourceData, numBytes)};
+
+        if (numBytesWritten > 0)
+        {
+            std::unique_lock<std::mutex> lock (mutex);
+            submitIdleTransfers();
+        }
+
+        return numBytesWritten;
+    }
+
+private:
+    static void LIBUSB_CALL transferCallback (libusb_transfer* transfer)
+    {
+        auto& usbTransfer = LibUsbTransfer::fromLibUsb (*transfer);
+        static_cast<Pimpl*> (usbTransfer.owner)->transferCompleted (usbTransfer);
+    }
+
+    void transferCompleted (LibUsbTransfer& usbTransfer) noexcept
+    {
+        usbTransfer.completed (counters);
+
+        auto& transfer = *usbTransfer.transfer;
+        std::unique_lock<std::mutex> lock (mutex);
+
+        --numTransfersInFlight;
+
+        if (options.tuning.enabled)
+            measure (usbTransfer);
+
+        if (input)
+        {
+            completedTransfers.add (&transfer);
+            writeCompletedTransfers();
+        }
+        else
+        {
+            idleTransfers.add (&transfer);
+        }
+
+        if (transfer.status != LIBUSB_TRANSFER_COMPLETED
+         && transfer.status != LIBUSB_TRANSFER_CANCELLED)
+        {
+            fail (getTransferStatusString (transfer.status));
+        }
+
+        submitIdleTransfers();
+        stateChanged.notify_all();
+    }
+
+    // called with the mutex locked. Transfers on different bulk streams can
+    // complete in any order, so each one waits until every transfer submitted
+    // before it has been written
+    void writeCompletedTransfers() noexcept
+    {
+        for (auto index {0}; index < completedTransfers.size();)
+        {
+            auto* transfer = completedTransfers.getUnchecked (index);
+
+            if (getSequenceNumber (*transfer) != nextSequenceNumberToWrite)
+            {
+                ++index;
+                continue;
+            }
+
+            // the transfer size may have changed since this was submitted
+            numBytesReserved -= transfer->length;
+
+            if (transfer->status == LIBUSB_TRANSFER_COMPLETED)
+                fifo->write (transfer->buffer, transfer->actual_length);
+
+            completedTransfers.remove (index);
+            idleTransfers.add (transfer);
+            ++nextSequenceNumberToWrite;
+            index = 0;
+        }
+    }
+
+    juce::int64& getSequenceNumber (libusb_transfer& transfer) noexcept
+    {
+        return sequenceNumbers[transfers.indexOf (&LibUsbTransfer::fromLibUsb (transfer))];
+    }
+
+    // called with the mutex locked
+    void submitIdleTransfers() noexcept
+    {
+        while (running && ! idleTransfers.isEmpty() && numTransfersInFlight < numTransfers)
+        {
+            auto* transfer = idleTransfers.getLast();
+            const auto size {transferSize.load()};
+
+            if (input)
+            {
+                // only ask for data there is guaranteed to be room for
+                if (fifo->getFreeSpace() - numBytesReserved < size)
+                    return;
+
+                transfer->length = size;
+            }
+            else
+            {
+                if (fifo->getNumReady() == 0)
+                    return;
+
+                transfer->length = fifo->read (transfer->buffer, size);
+            }
+
+            if (bulkStreams != nullptr)
+                getLibUsbBackend().transferSetStreamId (transfer, (uint32_t) (nextSequenceNumberToSubmit % bulkStreams->numStreams) + 1);
+
+            getSequenceNumber (*transfer) = nextSequenceNumberToSubmit;
+
+            const auto result {LibUsbTransfer::fromLibUsb (*transfer).submit (counters)};
+
+            if (result != LIBUSB_SUCCESS)
+            {
+                fail (getLibUsbErrorString (result));
+                return;
+            }
+
+            idleTransfers.removeLast();
+            ++numTransfersInFlight;
+            ++nextSequenceNumberToSubmit;
+
+            if (input)
+                numBytesReserved += transfer->length;
+        }
+    }
+
+    //==============================================================================
+    int roundToPackets (int size) const noexcept
+    {
+        // a short packet ends an IN transfer, so anything other than a whole
+        // number of packets risks the device overflowing the buffer
+        if ( ! input || maxPacketSize <= 0)
+            return size;
+
+        return juce::jmax (1, (size + maxPacketSize - 1) / maxPacketSize) * maxPacketSize;
+    }
+
+    static int getBytesPerMillisecond (libusb_speed speed) noexcept
+    {
+        switch (speed)
+        {
+            case LIBUSB_SPEED_LOW:          return 187;
+            case LIBUSB_SPEED_HIGH:         return 60000;
+            case LIBUSB_SPEED_SUPER:        return 625000;
+            case LIBUSB_SPEED_SUPER_PLUS:   return 1250000;
+            case LIBUSB_SPEED_FULL:
+            case LIBUSB_SPEED_UNKNOWN:
+            default:                        return 1500;
+        }
+    }
+
+    // called with the mutex locked
+    void measure (const LibUsbTransfer& usbTransfer) noexcept
+    {
+        const auto now {juce::Time::getHighResolutionTicks()};
+
+        if (usbTransfer.transfer->status == LIBUSB_TRANSFER_COMPLETED)
+        {
+            tuningBytes += usbTransfer.transfer->actual_length;
+            tuningLatencyTicks += now - usbTransfer.submitTicks;
+            ++tuningCompletions;
+        }
+
+        const auto windowSeconds {juce::Time::highResolutionTicksToSeconds (now - tuningWindowStart)};
+
+        if (windowSeconds * 1000.0 < options.tuning.intervalMs || tuningCompletions == 0)
+            return;
+
+        const auto bytesPerSecond {(double) tuningBytes / windowSeconds};
+        const auto latencyMs {juce::Time::highResolutionTicksToSeconds (tuningLatencyTicks) * 1000.0 / (double) tuningCompletions};
+
+        if (options.tuning.targetLatencyMs > 0.0)
+            tuneForLatency (latencyMs);
+        else
+            tuneForThroughput (bytesPerSecond);
+
+        tuningWindowStart = now;
+        tuningBytes = 0;
+        tuningLatencyTicks = 0;
+        tuningCompletions = 0;
+    }
+
+    // transfers complete one after another, so the latency is roughly
+    // proportional to the transfer size, a smaller queue is only tried once
+    // the transfers are as small as they can be
+    void tuneForLatency (double latencyMs) noexcept
+    {
+        const auto target {options.tuning.targetLatencyMs};
+        const auto minTransferSize {roundToPackets (1)};
+
+        if (latencyMs > target)
+        {
+            if (transferSize > minTransferSize)
+                transferSize = juce::jmax (minTransferSize, roundToPackets (transferSize / 2));
+            else if (numTransfers > minNumTransfers)
+                --numTransfers;
+        }
+        else if (latencyMs * 2.0 < target)
+        {
+            if (numTransfers < initialNumTransfers && numTransfers < options.tuning.maxNumTransfers)
+                ++numTransfers;
+            else if (transferSize < options.tuning.maxTransferSize)
+                transferSize = juce::jmin (options.tuning.maxTransferSize, roundToPackets (transferSize * 2));
+        }
+    }
+
+    // steps the transfer size and the number of transfers independently, one
+    // direction at a time from the best settings found, for as long as each
+    // step improves throughput noticeably. Once every direction has been
+    // tried it holds the best settings, then every so often probes each
+    // direction again in case the device or bus has changed
+    void tuneForThroughput (double bytesPerSecond) noexcept
+    {
+        if (probeDirection < 0)
+        {
+            const auto firstMeasurement {bestBytesPerSecond <= 0.0};
+
+            // measured at the best settings, so the probes have to beat it
+            bestBytesPerSecond = bytesPerSecond;
+
+            if ( ! firstMeasurement && ++numIntervalsSettled < numIntervalsBeforeClimbing)
+                return;
+
+            numIntervalsSettled = 0;
+            probeDirection = 0;
+            probeNextDirection();
+            return;
+        }
+
+        if (bytesPerSecond > bestBytesPerSecond * 1.05)
+        {
+            bestBytesPerSecond = bytesPerSecond;
+            bestTransferSize = transferSize;
+            bestNumTransfers = numTransfers;
+
+            // keep going the same way while it helps
+            if (stepFromBest (probeDirection))
+                return;
+        }
+
+        ++probeDirection;
+        probeNextDirection();
+    }
+
+    void probeNextDirection() noexcept
+    {
+        for (; probeDirection < numProbeDirections; ++probeDirection)
+        {
+            if (stepFromBest (probeDirection))
+                return;
+        }
+
+        probeDirection = -1;
+        transferSize = bestTransferSize;
+        numTransfers = bestNumTransfers;
+    }
+
+    // returns false if the best settings are already at the limit in that
+    // direction
+    bool stepFromBest (int direction) noexcept
+    {
+        auto newTransferSize {bestTransferSize};
+        auto newNumTransfers {bestNumTransfers};
+
+        switch (direction)
+        {
+            case 0:     newTransferSize = juce::jmin (options.tuning.maxTransferSize, roundToPackets (bestTransferSize * 2)); break;
+            case 1:     newNumTransfers = juce::jmin (options.tuning.maxNumTransfers, bestNumTransfers * 2); break;
+            case 2:     newTransferSize = juce::jmax (roundToPackets (1), roundToPackets (bestTransferSize / 2)); break;
+            case 3:     newNumTransfers = juce::jmax (minNumTransfers, bestNumTransfers / 2); break;
+            default:    break;
+        }
+
+        if (newTransferSize == bestTransferSize && newNumTransfers == bestNumTransfers)
+            return false;
+
+        transferSize = newTransferSize;
+        numTransfers = newNumTransfers;
+        return true;
+    }
+
+    // called with the mutex locked
+    void fail (const juce::String& error) noexcept
+    {
+        if (running)
+        {
+            running = false;
+            lastError = error;
+        }
+    }
+
+    void stop() noexcept
+    {
+        std::unique_lock<std::mutex> lock (mutex);
+        running = false;
+
+        for (auto* transfer : transfers)
+        {
+            if ( ! idleTransfers.contains (transfer->transfer)
+                && ! completedTransfers.contains (transfer->transfer))
+            {
+                getLibUsbBackend().cancelTransfer (transfer->transfer);
+            }
+        }
+
+        stateChanged.wait (lock, [this] { return numTransfersInFlight == 0; });
+        stateChanged.notify_all();
+    }
+
+    const std::shared_ptr<USBDevice::Pimpl> device;
+    Options options;
+    const bool input;
+    const LibUsbClaimedInterface claimedInterface;
+    LibUsbTransferCounters counters {&device->transferCounters};
+
+    /** Allocates streams on the endpoint for as long as the stream exists. */
+    struct BulkStreams
+    {
+        BulkStreams (libusb_device_handle* handleToUse, int endpointAddress, int numStreamsToAllocate)
+            : handle (handleToUse)
+            , endpoint ((unsigned char) endpointAddress)
+            , numStreams (getLibUsbBackend().allocStreams (handle, (uint32_t) numStreamsToAllocate, &endpoint, 1))
+        {
+            if (numStreams < 0)
+                throwOnLibUsbError (numStreams);
+
+            jassert (numStreams > 0);
+        }
+
+        ~BulkStreams() noexcept
+        {
+            getLibUsbBackend().freeStreams (handle, &endpoint, 1);
+        }
+
+        libusb_device_handle* const handle;
+        unsigned char endpoint;
+        const int numStreams;
+
+        JUCE_DECLARE_NON_COPYABLE (BulkStreams)
+    };
+
+    std::unique_ptr<BulkStreams> bulkStreams;
+
+    static constexpr int minNumTransfers {2};
+    static constexpr int initialNumTransfers {4};
+    static constexpr int numIntervalsBeforeClimbing {20};
+
+    // larger transfers, more transfers, smaller transfers, fewer transfers
+    static constexpr int numProbeDirections {4};
+
+    int maxPacketSize {0};
+    std::atomic<int> transferSize {0};
+    std::atomic<int> numTransfers {0};
+
+    // only touched with the mutex locked
+    juce::int64 tuningWindowStart {0};
+    juce::int64 tuningBytes {0};
+    juce::int64 tuningLatencyTicks {0};
+    int tuningCompletions {0};
+    double bestBytesPerSecond {0.0};
+    int bestTransferSize {0};
+    int bestNumTransfers {0};
+    int numIntervalsSettled {0};
+    int probeDirection {-1};
+
+    std::unique_ptr<ByteFifo> fifo;
+    juce::OwnedArray<LibUsbTransfer> transfers;
+    juce::Array<libusb_transfer*> idleTransfers;
+    juce::Array<libusb_transfer*> completedTransfers;
+    juce::HeapBlock<juce::int64> sequenceNumbers;
+    juce::int64 nextSequenceNumberToSubmit {0};
+    juce::int64 nextSequenceNumberToWrite {0};
+    int numTransfersInFlight {0};
+    int numBytesReserved {0};
+
+    std::atomic<bool> running {false};
+    juce::String lastError;
+    mutable std::mutex mutex;
+    mutable std::condition_variable stateChanged;
+
+    const LibUsbEventHandler eventHandler {claimedInterface.lease.getContext()};
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (Pimpl)
+};
+
+//==============================================================================
+USBEndpointStream::USBEndpointStream (const USBDevice& device, const Options& options)
+    : pimpl (std::make_unique<Pimpl> (device.pimpl, options))
+{
+}
+
+USBEndpointStream::~USBEndpointStream() noexcept
+{
+}
+
+USBEndpointStream::Options USBEndpointStream::getOptions() const noexcept
+{
+    return pimpl->getOptions();
+}
+
+int USBEndpointStream::getTransferSize() const noexcept
+{
+    return pimpl->getTransferSize();
+}
+
+int USBEndpointStream::getNumTransfers() const noexcept
+{
+    return pimpl->getNumTransfers();
+}
+
+int USBEndpointStream::getNumBulkStreams() const noexcept
+{
+    return pimpl->getNumBulkStreams();
+}
+
+bool USBEndpointStream::isInput() const noexcept
+{
+    return pimpl->isInput();
+}
+
+bool USBEndpointStream::isRunning() const noexcept
+{
+    return pimpl->isRunning();
+}
+
+USBTransferStatistics USBEndpointStream::getStatistics() const noexcept
+{
+    return pimpl->getStatistics();
+}
+
+juce::String USBEndpointStream::getLastError() const noexcept
+{
+    return pimpl->getLastError();
+}
+
+int USBEndpointStream::getNumBytesAvailable() const noexcept
+{
+    return pimpl->getNumBytesAvailable();
+}
+
+bool USBEndpointStream::waitUntilReady (int timeoutMs) const noexcept
+{
+    return pimpl->waitUntilReady (timeoutMs);
+}
+
+int USBEndpointStream::read (void* destBuffer, int maxBytes) noexcept
+{
+    return pimpl->read (destBuffer, maxBytes);
+}
+
+int USBEndpointStream::write (const void* sourceData, int numBytes) noexcept
+{
+    return pimpl->write (sourceData, numBytes);
+}
@@ -0,0 +1,183 @@
+
+#pragma once
+
+/** Streams data to or from a bulk endpoint of a USBDevice.
+
+    A number of asynchronous transfers are kept queued on the endpoint at all
+    times so the bus never sits idle waiting for the next request, data moves
+    between the transfers and a ring buffer that can be read or written from
+    any single thread.
+
+    For an IN endpoint call read() to collect the data as it arrives, for an
+    OUT endpoint call write() and the data will be sent as soon as a transfer
+    is free. Transfers are only queued for an IN endpoint while there is room
+    for them in the ring buffer, so if the data isn't read the device will be
+    held off rather than data being lost.
+ */
+class USBEndpointStream
+{
+public:
+    struct Options
+    {
+        /** The interface the endpoint belongs to, this will be claimed for
+            the lifetime of the stream.
+         */
+        int interfaceNumber {0};
+
+        /** The alternate setting of the interface to select, if this is zero
+            the current setting is left alone.
+         */
+        int alternateSetting {0};
+
+        /** The endpoint address, including the direction bit. */
+        int endpointAddress {0};
+
+        /** The number of transfers to keep in flight at once. */
+        int numTransfers {8};
+
+        /** The size of each transfer in bytes.
+
+            For IN endpoints this will be rounded up to a whole number of
+            packets.
+         */
+        int transferSize {64 * 1024};
+
+        /** The size of the ring buffer in bytes.
+
+            If this is zero the buffer will be large enough to hold twice the
+            number of bytes that can be in flight at once.
+         */
+        int bufferSize {0};
+
+        /** Lets the stream pick its own transfer size and number of
+            transfers, adjusting them as it measures how the device and host
+            controller perform.
+         */
+        struct Tuning
+        {
+            /** When enabled numTransfers and transferSize are ignored, the
+                stream starts from the connection speed and the endpoint's
+                packet size instead.
+             */
+            bool enabled {false};
+
+            /** The time a transfer should take from being submitted to
+                completing, which is roughly how long data waits before it can
+                be read. Zero tunes for the most throughput instead.
+             */
+            double targetLatencyMs {0.0};
+
+            /** The limits the tuning stays within, every transfer is
+                allocated at the largest size up front.
+             */
+            int maxTransferSize {256 * 1024};
+            int maxNumTransfers {16};
+
+            /** How often the measurements are looked at. */
+            int intervalMs {100};
+        };
+
+        Tuning tuning;
+
+        /** The number of SuperSpeed bulk streams to spread the transfers
+            across, zero uses the endpoint as a single bulk pipe.
+
+            Streams let a device such as a UAS storage device work on several
+            requests at once and complete them in any order. Received data is
+            still written to the ring buffer in the order the transfers were
+            submitted. The transfers take stream IDs from 1 upwards in turn,
+            so numTransfers should be at least the number of streams for
+            every stream to be used.
+
+            The device has to run at SuperSpeed or above and the endpoint has
+            to support streams, see USBDevice::Endpoint::getMaxBulkStreams().
+            The host controller may grant fewer streams than are asked for.
+         */
+        int numBulkStreams {0};
+    };
+
+    /** Claims the interface and starts streaming.
+
+        Throws a std::runtime_error if the device can't be opened, the
+        interface can't be claimed, bulk streams were asked for but can't be
+        allocated or the transfers can't be submitted.
+     */
+    USBEndpointStream (const USBDevice& device, const Options& options);
+
+    /** Destructor, cancels any transfers and releases the interface. */
+    ~USBEndpointStream() noexcept;
+
+    /** Returns the options the stream was created with, the transfer size
+        reflects any rounding that was applied.
+     */
+    Options getOptions() const noexcept;
+
+    /** Returns the size of the transfers currently being submitted, this
+        only changes if tuning is enabled.
+     */
+    int getTransferSize() const noexcept;
+
+    /** Returns the number of transfers currently allowed in flight, this
+        only changes if tuning is enabled.
+     */
+    int getNumTransfers() const noexcept;
+
+    /** Returns the number of bulk streams allocated on the endpoint, or zero
+        if it's used as a single bulk pipe.
+     */
+    int getNumBulkStreams() const noexcept;
+
+    /** Returns true if this stream reads from an IN endpoint. */
+    bool isInput() const noexcept;
+
+    /** Returns true until the stream stops because of an error, such as the
+        device being removed or the endpoint stalling.
+     */
+    bool isRunning() const noexcept;
+
+    /** Returns the statistics of this stream's transfers, this never blocks
+        and can be called from any thread.
+
+        The transfers are also counted by the device's statistics.
+     */
+    USBTransferStatistics getStatistics() const noexcept;
+
+    /** Returns a description of the error that stopped the stream. */
+    juce::String getLastError() const noexcept;
+
+    /** Returns the number of bytes that can be read for an IN endpoint, or
+        written for an OUT endpoint, without waiting.
+     */
+    int getNumBytesAvailable() const noexcept;
+
+    /** Waits until bytes are available to read or write, or the timeout
+        expires.
+
+        @returns true if bytes are available.
+     */
+    bool waitUntilReady (int timeoutMs) const noexcept;
+
+    /** Copies up to maxBytes of received data into the destination buffer.
+
+        This doesn't block, it should only be called for IN endpoints and only
+        from one thread at a time.
+
+        @returns the number of bytes copied.
+     */
+    int read (void* destBuffer, int maxBytes) noexcept;
+
+    /** Queues up to numBytes of data to be sent.
+
+        This doesn't block, it should only be called for OUT endpoints and
+        only from one thread at a time.
+
+        @returns the number of bytes queued.
+     */
+    int write (const void* sourceData, int numBytes) noexcept;
+
+private:
+    class Pimpl;
+    std::unique_ptr<Pimpl> pimpl;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (USBEndpointStream)
+};
@@ -0,0 +1,175 @@
+//==============================================================================
+class USBEndpointStreamTests : public juce::UnitTest
+{
+public:
+    USBEndpointStreamTests()
+        : juce::UnitTest ("USBEndpointStream", "jucey_libusb")
+    {
+    }
+
+    void runTest() override
+    {
+        LibUsbSimulatedDevices bus;
+
+        auto spec {LibUsbSimulatedDevices::makeDeviceSpec (1)};
+        spec.speed = USBSimulatedBus::Speed::super;
+        spec.endpoints.add ({bulkEndpoint, USBDevice::Endpoint::TransferType::bulk, 1024, 0, 1, 64.0e6, 16});
+        bus.addDevice (spec);
+        expect (bus.waitForNumDevices (1));
+
+        const auto device {bus.findDevice (1)};
+
+        beginTest ("Data is read in the order it was sent");
+        {
+            expectInOrder (device, 0);
+        }
+
+        beginTest ("Data on bulk streams is read in the order it was submitted");
+        {
+            expectInOrder (device, 4);
+        }
+
+        // the simulated endpoint moves 64 bytes a microsecond, so four of the
+        // largest transfers take 16ms from being submitted to completing
+        beginTest ("Tuning for latency shrinks the transfers until they meet the target");
+        {
+            auto options {makeTuningOptions()};
+            options.tuning.targetLatencyMs = 2.0;
+
+            try
+            {
+                USBEndpointStream stream {device, options};
+                expectEquals (stream.getTransferSize(), options.tuning.maxTransferSize);
+
+                readFor (stream, 1000, [] {});
+
+                expect (stream.isRunning(), stream.getLastError());
+                expect (stream.getTransferSize() <= options.tuning.maxTransferSize / 4);
+                expect (stream.getNumTransfers() >= 2);
+            }
+            catch (const std::exception& e)
+            {
+                expect (false, e.what());
+            }
+        }
+
+        beginTest ("Tuning for throughput stays within its limits");
+        {
+            auto options {makeTuningOptions()};
+            options.tuning.maxTransferSize = 64 * 1024;
+            options.tuning.maxNumTransfers = 6;
+
+            try
+            {
+                USBEndpointStream stream {device, options};
+                auto withinLimits {true};
+
+                readFor (stream, 1000, [&]
+                {
+                    const auto transferSize {stream.getTransferSize()};
+                    const auto numTransfers {stream.getNumTransfers()};
+
+                    if (transferSize <= 0 || transferSize > options.tuning.maxTransferSize || transferSize % 1024 != 0
+                        || numTransfers < 2 || numTransfers > options.tuning.maxNumTransfers)
+                    {
+                        withinLimits = false;
+                    }
+                });
+
+                expect (stream.isRunning(), stream.getLastError());
+                expect (withinLimits);
+                expect (stream.getStatistics().numBytes > 0);
+            }
+            catch (const std::exception& e)
+            {
+                expect (false, e.what());
+            }
+        }
+    }
+
+private:
+    static constexpr int bulkEndpoint {0x81};
+    static constexpr int transferSize {4096};
+    static constexpr int numTransfersToRead {500};
+
+    static USBEndpointStream::Options makeTuningOptions()
+    {
+        USBEndpointStream::Options options {};
+        options.endpointAddress = bulkEndpoint;
+        options.tuning.enabled = true;
+        options.tuning.intervalMs = 50;
+        return options;
+    }
+
+    // keeps the stream's buffer drained, so the transfers keep flowing
+    static void readFor (USBEndpointStream& stream, int milliseconds, const std::function<void()>& afterEachRead)
+    {
+        juce::HeapBlock<juce::uint8> chunk ((size_t) transferSize);
+        const auto endTime {juce::Time::getMillisecondCounterHiRes() + milliseconds};
+
+        while (juce::Time::getMillisecondCounterHiRes() < endTime && stream.isRunning())
+        {
+            if (stream.waitUntilReady (10))
+            {
+                while (stream.getNumBytesAvailable() > 0)
+                    stream.read (chunk, transferSize);
+            }
+
+            afterEachRead();
+        }
+    }
+
+    // the simulated bus numbers every transfer submitted to an endpoint just
+    // after the time stamp at the start of its data, counting from the first
+    // transfer any stream submitted to it
+    void expectInOrder (const USBDevice& device, int numBulkStreams)
+    {
+        USBEndpointStream::Options options {};
+        options.endpointAddress = bulkEndpoint;
+        options.transferSize = transferSize;
+        options.numTransfers = 8;
+        options.numBulkStreams = numBulkStreams;
+
+        try
+        {
+            USBEndpointStream stream {device, options};
+            expectEquals (stream.getNumBulkStreams(), numBulkStreams);
+
+            juce::HeapBlock<juce::uint8> chunk ((size_t) transferSize);
+            juce::int64 expectedSequenceNumber {-1};
+            auto numTransfersRead {0};
+
+            while (numTransfersRead < numTransfersToRead && stream.isRunning())
+            {
+                if ( ! stream.waitUntilReady (1000))
+                    break;
+
+                while (stream.getNumBytesAvailable() >= transferSize)
+                {
+                    expectEquals (stream.read (chunk, transferSize), transferSize);
+
+                    juce::int64 sequenceNumber {0};
+                    std::memcpy (&sequenceNumber, chunk + sizeof (juce::int64), sizeof (sequenceNumber));
+
+                    if (expectedSequenceNumber >= 0 && sequenceNumber != expectedSequenceNumber)
+                    {
+                        expectEquals (sequenceNumber, expectedSequenceNumber);
+                        return;
+                    }
+
+                    expectedSequenceNumber = sequenceNumber + 1;
+                    ++numTransfersRead;
+                }
+            }
+
+            expect (stream.isRunning(), stream.getLastError());
+            expect (numTransfersRead >= numTransfersToRead);
+        }
+        catch (const std::exception& e)
+        {
+            expect (false, e.what());
+        }
+    }
+};
+
+static USBEndpointStreamTests usbEndpointStreamTests;
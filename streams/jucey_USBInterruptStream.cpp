@@ -0,0 +1,289 @@
+//==============================================================================
+class USBInterruptStream::Pimpl
+{
+public:
+    Pimpl (const std::shared_ptr<USBDevice::Pimpl>& devicePimpl, const Options& streamOptions)
+        : device (devicePimpl)
+        , options (streamOptions)
+        , claimedInterface (*device, options.interfaceNumber)
+        , reports (juce::jmax (1, streamOptions.numReports) + 1)
+    {
+        jassert (options.numTransfers > 0);
+        jassert (options.numReports > 0);
+
+        // you can only read reports from an IN endpoint!
+        jassert ((options.endpointAddress & LIBUSB_ENDPOINT_DIR_MASK) == LIBUSB_ENDPOINT_IN);
+
+        if (options.alternateSetting != 0)
+        {
+            throwOnLibUsbError (getLibUsbBackend().setInterfaceAltSetting (device->getHandle(),
+                                                                           options.interfaceNumber,
+                                                                           options.alternateSetting));
+        }
+
+        const auto endpointIndex {device->findActiveEndpoint (options.interfaceNumber,
+                                                              options.alternateSetting != 0 ? options.alternateSetting : -1,
+                                                              options.endpointAddress)};
+
+        if (endpointIndex < 0)
+            throwOnLibUsbError (LIBUSB_ERROR_NOT_FOUND);
+
+        const auto& endpoint = device->descriptorTree->getEndpoint (endpointIndex);
+
+        if ((endpoint.attributes & LIBUSB_TRANSFER_TYPE_MASK) != LIBUSB_ENDPOINT_TRANSFER_TYPE_INTERRUPT
+            || (options.endpointAddress & LIBUSB_ENDPOINT_DIR_MASK) != LIBUSB_ENDPOINT_IN)
+        {
+            throwOnLibUsbError (LIBUSB_ERROR_INVALID_PARAM);
+        }
+
+        if (options.maxReportSize <= 0)
+            options.maxReportSize = (int) endpoint.maxBytesPerInterval;
+
+        // every slot is allocated up front, nothing is allocated once the
+        // stream is running
+        const auto numSlots {reports.getTotalSize()};
+        reportData.calloc ((size_t) numSlots * (size_t) options.maxReportSize);
+        reportLengths.calloc ((size_t) numSlots);
+
+        for (auto index {0}; index < options.numTransfers; ++index)
+        {
+            auto* transfer = transfers.add (std::make_unique<LibUsbTransfer> (device->getBufferPool(),
+                                                                              options.maxReportSize));
+
+            libusb_fill_interrupt_transfer (transfer->transfer,
+                                            device->getHandle(),
+                                            (unsigned char) options.endpointAddress,
+                                            transfer->buffer.getData(),
+                                            options.maxReportSize,
+                                            transferCallback,
+                                            transfer,
+                                            0);
+
+            transfer->owner = this;
+        }
+
+        running = true;
+
+        for (auto* transfer : transfers)
+        {
+            if ( ! submit (*transfer))
+                break;
+        }
+
+        if ( ! running)
+        {
+            const auto error {getLastError()};
+            stop();
+
+            throw std::runtime_error (error.toStdString());
+        }
+    }
+
+    ~Pimpl() noexcept
+    {
+        stop();
+    }
+
+    Options getOptions() const noexcept
+    {
+        return options;
+    }
+
+    bool isRunning() const noexcept
+    {
+        return running;
+    }
+
+    USBTransferStatistics getStatistics() const noexcept
+    {
+        return counters.getStatistics();
+    }
+
+    juce::String getLastError() const noexcept
+    {
+        std::unique_lock<std::mutex> lock (lastErrorMutex);
+        return lastError;
+    }
+
+    int getNumReportsAvailable() const noexcept
+    {
+        return reports.getNumReady();
+    }
+
+    juce::int64 getNumReportsDropped() const noexcept
+    {
+        return numReportsDropped.load (std::memory_order_relaxed);
+    }
+
+    int readReport (void* destBuffer, int maxBytes) noexcept
+    {
+        int start1, size1, start2, size2;
+        reports.prepareToRead (1, start1, size1, start2, size2);
+
+        if (size1 == 0)
+            return -1;
+
+        const auto length {reportLengths[start1]};
+        memcpy (destBuffer, getSlot (start1), (size_t) juce::jlimit (0, length, maxBytes));
+
+        reports.finishedRead (size1);
+        return length;
+    }
+
+private:
+    static void LIBUSB_CALL transferCallback (libusb_transfer* transfer)
+    {
+        auto& usbTransfer = LibUsbTransfer::fromLibUsb (*transfer);
+        static_cast<Pimpl*> (usbTransfer.owner)->transferCompleted (usbTransfer);
+    }
+
+    // called on the libusb event thread, the report is queued and the
+    // transfer resubmitted straight away so the next poll isn't missed
+    void transferCompleted (LibUsbTransfer& usbTransfer) noexcept
+    {
+        usbTransfer.completed (counters);
+
+        const auto& transfer = *usbTransfer.transfer;
+
+        if (transfer.status == LIBUSB_TRANSFER_COMPLETED)
+        {
+            pushReport (transfer.buffer, transfer.actual_length);
+
+            if (running && submit (usbTransfer))
+                return;
+        }
+        else if (transfer.status != LIBUSB_TRANSFER_CANCELLED)
+        {
+            fail (getTransferStatusString (transfer.status));
+        }
+
+        if (--numTransfersInFlight == 0)
+            allTransfersCompleted.signal();
+    }
+
+    void pushReport (const juce::uint8* data, int length) noexcept
+    {
+        int start1, size1, start2, size2;
+        reports.prepareToWrite (1, start1, size1, start2, size2);
+
+        if (size1 == 0)
+        {
+            numReportsDropped.fetch_add (1, std::memory_order_relaxed);
+            return;
+        }
+
+        length = juce::jlimit (0, options.maxReportSize, length);
+        memcpy (getSlot (start1), data, (size_t) length);
+        reportLengths[start1] = length;
+
+        reports.finishedWrite (size1);
+    }
+
+    juce::uint8* getSlot (int slotIndex) const noexcept
+    {
+        return reportData + (size_t) slotIndex * (size_t) options.maxReportSize;
+    }
+
+    bool submit (LibUsbTransfer& transfer) noexcept
+    {
+        ++numTransfersInFlight;
+        const auto result {transfer.submit (counters)};
+
+        if (result == LIBUSB_SUCCESS)
+            return true;
+
+        --numTransfersInFlight;
+        fail (getLibUsbErrorString (result));
+        return false;
+    }
+
+    void fail (const juce::String& error) noexcept
+    {
+        std::unique_lock<std::mutex> lock (lastErrorMutex);
+
+        if (running.exchange (false))
+            lastError = error;
+    }
+
+    void stop() noexcept
+    {
+        running = false;
+
+        // a transfer completing while this runs may be resubmitted before it
+        // sees the stream has stopped, so keep cancelling until none are left
+        while (numTransfersInFlight > 0)
+        {
+            for (auto* transfer : transfers)
+                getLibUsbBackend().cancelTransfer (transfer->transfer);
+
+            allTransfersCompleted.wait (100);
+        }
+    }
+
+    const std::shared_ptr<USBDevice::Pimpl> device;
+    Options options;
+    const LibUsbClaimedInterface claimedInterface;
+    LibUsbTransferCounters counters {&device->transferCounters};
+
+    juce::OwnedArray<LibUsbTransfer> transfers;
+    std::atomic<int> numTransfersInFlight {0};
+
+    juce::AbstractFifo reports;
+    juce::HeapBlock<juce::uint8> reportData;
+    juce::HeapBlock<int> reportLengths;
+    std::atomic<juce::int64> numReportsDropped {0};
+
+    std::atomic<bool> running {false};
+    juce::String lastError;
+    mutable std::mutex lastErrorMutex;
+    juce::WaitableEvent allTransfersCompleted;
+
+    const LibUsbEventHandler eventHandler {claimedInterface.lease.getContext()};
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (Pimpl)
+};
+
+//==============================================================================
+USBInterruptStream::USBInterruptStream (const USBDevice& device, const Options& options)
+    : pimpl (std::make_unique<Pimpl> (device.pimpl, options))
+{
+}
+
+USBInterruptStream::~USBInterruptStream() noexcept
+{
+}
+
+USBInterruptStream::Options USBInterruptStream::getOptions() const noexcept
+{
+    return pimpl->getOptions();
+}
+
+bool USBInterruptStream::isRunning() const noexcept
+{
+    return pimpl->isRunning();
+}
+
+USBTransferStatistics USBInterruptStream::getStatistics() const noexcept
+{
+    return pimpl->getStatistics();
+}
+
+juce::String USBInterruptStream::getLastError() const noexcept
+{
+    return pimpl->getLastError();
+}
+
+int USBInterruptStream::getNumReportsAvailable() const noexcept
+{
+    return pimpl->getNumReportsAvailable();
+}
+
+juce::int64 USBInterruptStream::getNumReportsDropped() const noexcept
+{
+    return pimpl->getNumReportsDropped();
+}
+
+int USBInterruptStream::readReport (void* destBuffer, int maxBytes) noexcept
+{
+    return pimpl->readReport (destBuffer, maxBytes);
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+/** Reads reports from an interrupt IN endpoint of a USBDevice.
+
+    Interrupt endpoints are polled by the host once every service interval,
+    which makes them the endpoint of choice for control surfaces and other
+    HID-like devices. A small number of transfers is kept queued on the
+    endpoint at all times, each one resubmitted the moment it completes, so
+    there is always a transfer waiting for the next poll.
+
+    Each report received is copied into a single producer, single consumer
+    FIFO of fixed size slots. Reading from it never blocks, allocates or
+    takes a lock, so it can be drained from an audio callback. Nothing on the
+    way from the transfer completing to the report being readable allocates
+    or takes a lock either, so a report can be read within one service
+    interval of it arriving.
+ */
+class USBInterruptStream
+{
+public:
+    struct Options
+    {
+        /** The interface the endpoint belongs to, this will be claimed for
+            the lifetime of the stream.
+         */
+        int interfaceNumber {0};
+
+        /** The alternate setting of the interface to select, if this is zero
+            the current setting is left alone.
+         */
+        int alternateSetting {0};
+
+        /** The endpoint address, including the direction bit. */
+        int endpointAddress {0};
+
+        /** The number of transfers to keep in flight at once, two means one
+            is always queued while the other is being handled.
+         */
+        int numTransfers {2};
+
+        /** The largest report expected, if this is zero the maximum packet
+            size of the endpoint is used.
+         */
+        int maxReportSize {0};
+
+        /** The number of reports the FIFO can hold before new ones are
+            dropped.
+         */
+        int numReports {64};
+    };
+
+    /** Claims the interface and starts reading.
+
+        Throws a std::runtime_error if the device can't be opened, the
+        interface can't be claimed, the endpoint isn't an interrupt IN
+        endpoint or the transfers can't be submitted.
+     */
+    USBInterruptStream (const USBDevice& device, const Options& options);
+
+    /** Destructor, cancels any transfers and releases the interface. */
+    ~USBInterruptStream() noexcept;
+
+    /** Returns the options the stream was created with, the report size
+        reflects the size actually used.
+     */
+    Options getOptions() const noexcept;
+
+    /** Returns true until the stream stops because of an error, such as the
+        device being removed or the endpoint stalling.
+     */
+    bool isRunning() const noexcept;
+
+    /** Returns the statistics of this stream's transfers, this never blocks
+        and can be called from any thread.
+
+        The transfers are also counted by the device's statistics.
+     */
+    USBTransferStatistics getStatistics() const noexcept;
+
+    /** Returns a description of the error that stopped the stream. */
+    juce::String getLastError() const noexcept;
+
+    /** Returns the number of reports waiting to be read. */
+    int getNumReportsAvailable() const noexcept;
+
+    /** Returns the number of reports dropped because the FIFO was full. */
+    juce::int64 getNumReportsDropped() const noexcept;
+
+    /** Copies the oldest report into the destination buffer and removes it
+        from the FIFO, anything that doesn't fit in the buffer is lost.
+
+        This never blocks and should only be called from one thread at a
+        time.
+
+        @returns the length of the report, or -1 if there are no reports to
+                 read. A device may send an empty report.
+     */
+    int readReport (void* destBuffer, int maxBytes) noexcept;
+
+private:
+    class Pimpl;
+    std::unique_ptr<Pimpl> pimpl;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (USBInterruptStream)
+};
@@ -0,0 +1,114 @@
+//==============================================================================
+class USBInterruptStreamTests : public juce::UnitTest
+{
+public:
+    USBInterruptStreamTests()
+        : juce::UnitTest ("USBInterruptStream", "jucey_libusb")
+    {
+    }
+
+    void runTest() override
+    {
+        LibUsbSimulatedDevices bus;
+
+        // one report every millisecond
+        auto spec {LibUsbSimulatedDevices::makeDeviceSpec (1)};
+        spec.endpoints.add ({interruptEndpoint, USBDevice::Endpoint::TransferType::interrupt, reportSize, 0, 1, 64.0e3});
+        const auto deviceId {bus.addDevice (spec)};
+        expect (bus.waitForNumDevices (1));
+
+        const auto device {bus.findDevice (1)};
+
+        beginTest ("Transfers are resubmitted as each report arrives");
+        {
+            try
+            {
+                USBInterruptStream stream {device, makeOptions (64)};
+                expectEquals (stream.getOptions().maxReportSize, reportSize);
+
+                // the simulated bus numbers every transfer submitted to an
+                // endpoint just after the time stamp at the start of its data
+                juce::uint8 report[reportSize];
+                juce::int64 expectedSequenceNumber {-1};
+                auto numReportsRead {0};
+                auto numReportsOutOfOrder {0};
+
+                const auto allRead = [&]
+                {
+                    while (stream.readReport (report, reportSize) == reportSize)
+                    {
+                        juce::int64 sequenceNumber {0};
+                        std::memcpy (&sequenceNumber, report + sizeof (juce::int64), sizeof (sequenceNumber));
+
+                        if (expectedSequenceNumber >= 0 && sequenceNumber != expectedSequenceNumber)
+                            ++numReportsOutOfOrder;
+
+                        expectedSequenceNumber = sequenceNumber + 1;
+                        ++numReportsRead;
+                    }
+
+                    return numReportsRead >= numReportsToRead || ! stream.isRunning();
+                };
+
+                expect (LibUsbSimulatedDevices::waitUntil (allRead));
+                expect (stream.isRunning(), stream.getLastError());
+                expect (numReportsRead >= numReportsToRead);
+                expectEquals (numReportsOutOfOrder, 0);
+                expectEquals (stream.getNumReportsDropped(), (juce::int64) 0);
+            }
+            catch (const std::exception& e)
+            {
+                expect (false, e.what());
+            }
+        }
+
+        beginTest ("Reports that don't fit in the FIFO are dropped");
+        {
+            try
+            {
+                USBInterruptStream stream {device, makeOptions (4)};
+
+                expect (LibUsbSimulatedDevices::waitUntil ([&] { return stream.getNumReportsDropped() > 0; }));
+                expect (stream.isRunning(), stream.getLastError());
+                expectEquals (stream.getNumReportsAvailable(), 4);
+            }
+            catch (const std::exception& e)
+            {
+                expect (false, e.what());
+            }
+        }
+
+        beginTest ("The stream stops when the device is removed");
+        {
+            try
+            {
+                USBInterruptStream stream {device, makeOptions (64)};
+                expect (stream.isRunning(), stream.getLastError());
+
+                bus.removeDevice (deviceId);
+
+                expect (LibUsbSimulatedDevices::waitUntil ([&] { return ! stream.isRunning(); }));
+                expect (stream.getLastError().isNotEmpty());
+            }
+            catch (const std::exception& e)
+            {
+                expect (false, e.what());
+            }
+        }
+    }
+
+private:
+    static constexpr int interruptEndpoint {0x81};
+    static constexpr int reportSize {64};
+    static constexpr int numReportsToRead {200};
+
+    static USBInterruptStream::Options makeOptions (int numReports)
+    {
+        USBInterruptStream::Options options {};
+        options.endpointAddress = interruptEndpoint;
+        options.numReports = numReports;
+        return options;
+    }
+};
+
+static USBInterruptStreamTests usbInterruptStreamTests;
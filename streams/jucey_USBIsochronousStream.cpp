@@ -0,0 +1,352 @@
+
+//==============================================================================
+class USBIsochronousStream::Pimpl   : private LibUsbUser
+                                    , private juce::Thread
+{
+public:
+    Pimpl (const std::shared_ptr<USBDevice::Pimpl>& devicePimpl,
+           const Options& streamOptions,
+           Callback& callbackToUse)
+        : juce::Thread ("jucey USB isochronous")
+        , device (devicePimpl)
+        , options (streamOptions)
+        , callback (callbackToUse)
+        , input ((options.endpointAddress & LIBUSB_ENDPOINT_DIR_MASK) == LIBUSB_ENDPOINT_IN)
+        , claimedInterface (*device, options.interfaceNumber)
+        , completedTransfers (streamOptions.numTransfers + 1)
+    {
+        jassert (options.numTransfers > 0);
+        jassert (options.packetsPerTransfer > 0);
+
+        if (options.alternateSetting != 0)
+        {
+            throwOnLibUsbError (getLibUsbBackend().setInterfaceAltSetting (device->getHandle(),
+                                                                           options.interfaceNumber,
+                                                                           options.alternateSetting));
+        }
+
+        // zero leaves the current alternate setting, so any setting of the
+        // interface may hold the endpoint
+        const auto endpointIndex {device->findActiveEndpoint (options.interfaceNumber,
+                                                              options.alternateSetting != 0 ? options.alternateSetting : -1,
+                                                              options.endpointAddress)};
+
+        if (endpointIndex < 0)
+            throwOnLibUsbError (LIBUSB_ERROR_NOT_FOUND);
+
+        const auto& endpoint = device->descriptorTree->getEndpoint (endpointIndex);
+
+        if ((endpoint.attributes & LIBUSB_TRANSFER_TYPE_MASK) != LIBUSB_ENDPOINT_TRANSFER_TYPE_ISOCHRONOUS)
+            throwOnLibUsbError (LIBUSB_ERROR_INVALID_PARAM);
+
+        const auto maxPacketSize {(int) endpoint.maxBytesPerInterval};
+
+        if (options.packetSize <= 0)
+            options.packetSize = maxPacketSize;
+
+        // the endpoint can't move packets this large!
+        jassert (options.packetSize <= maxPacketSize);
+
+        const auto transferSize {options.packetSize * options.packetsPerTransfer};
+
+        // every buffer is allocated up front, nothing is allocated once the
+        // stream is running
+        buffers = device->getBufferPool().allocate (transferSize * options.numTransfers);
+
+        if (buffers.getSize() < transferSize * options.numTransfers)
+            throwOnLibUsbError (LIBUSB_ERROR_NO_MEM);
+
+        packets.calloc ((size_t) options.packetsPerTransfer * (size_t) options.numTransfers);
+        completedTransferQueue.calloc ((size_t) completedTransfers.getTotalSize());
+
+        for (auto index {0}; index < options.numTransfers; ++index)
+        {
+            auto* transfer = transfers.add (std::make_unique<LibUsbTransfer> (device->getBufferPool(),
+                                                                              0,
+                                                                              options.packetsPerTransfer));
+
+            libusb_fill_iso_transfer (transfer->transfer,
+                                      device->getHandle(),
+                                      (unsigned char) options.endpointAddress,
+                                      buffers.getData() + index * transferSize,
+                                      transferSize,
+                                      options.packetsPerTransfer,
+                                      transferCallback,
+                                      transfer,
+                                      0);
+
+            transfer->owner = this;
+
+            libusb_set_iso_packet_lengths (transfer->transfer, (unsigned int) options.packetSize);
+        }
+
+        // nothing has been submitted until the thread runs, so there's
+        // nothing to stop if it can't be started
+        if ( ! startRealtimeThread (juce::Thread::RealtimeOptions{}.withPriority (10))
+            && ! startThread (juce::Thread::Priority::highest))
+        {
+            throw std::runtime_error ("Couldn't start the isochronous stream thread");
+        }
+
+        started.wait();
+
+        if ( ! running)
+        {
+            const auto error {getLastError()};
+            stop();
+
+            throw std::runtime_error (error.toStdString());
+        }
+    }
+
+    ~Pimpl() noexcept override
+    {
+        stop();
+    }
+
+    Options getOptions() const noexcept
+    {
+        return options;
+    }
+
+    bool isInput() const noexcept
+    {
+        return input;
+    }
+
+    bool isRunning() const noexcept
+    {
+        return running;
+    }
+
+    USBTransferStatistics getStatistics() const noexcept
+    {
+        return counters.getStatistics();
+    }
+
+    juce::String getLastError() const noexcept
+    {
+        std::unique_lock<std::mutex> lock (lastErrorMutex);
+        return lastError;
+    }
+
+private:
+    static void LIBUSB_CALL transferCallback (libusb_transfer* transfer)
+    {
+        auto& usbTransfer = LibUsbTransfer::fromLibUsb (*transfer);
+        static_cast<Pimpl*> (usbTransfer.owner)->transferCompleted (usbTransfer);
+    }
+
+    // called on the libusb event thread, this just counts and queues the
+    // transfer for the real-time thread
+    void transferCompleted (LibUsbTransfer& usbTransfer) noexcept
+    {
+        usbTransfer.completed (counters);
+
+        int start1, size1, start2, size2;
+        completedTransfers.prepareToWrite (1, start1, size1, start2, size2);
+
+        // there should always be room for every transfer in the queue!
+        jassert (size1 == 1);
+
+        completedTransferQueue[start1] = usbTransfer.transfer;
+        completedTransfers.finishedWrite (size1);
+
+        if (--numTransfersInFlight == 0)
+            allTransfersCompleted.signal();
+
+        notify();
+    }
+
+    void run() override
+    {
+        running = true;
+
+        for (auto* transfer : transfers)
+        {
+            if ( ! input)
+                processPackets (*transfer->transfer);
+
+            if ( ! submit (*transfer->transfer))
+                break;
+        }
+
+        started.signal();
+
+        while ( ! threadShouldExit())
+        {
+            wait (-1);
+
+            while (auto* transfer = popCompletedTransfer())
+                processCompletedTransfer (*transfer);
+        }
+    }
+
+    libusb_transfer* popCompletedTransfer() noexcept
+    {
+        int start1, size1, start2, size2;
+        completedTransfers.prepareToRead (1, start1, size1, start2, size2);
+
+        if (size1 == 0)
+            return nullptr;
+
+        auto* transfer = completedTransferQueue[start1];
+        completedTransfers.finishedRead (size1);
+        return transfer;
+    }
+
+    void processCompletedTransfer (libusb_transfer& transfer) noexcept
+    {
+        // the status of the individual packets is passed on to the callback,
+        // the status of the transfer only fails if it couldn't happen at all
+        if (transfer.status != LIBUSB_TRANSFER_COMPLETED)
+        {
+            if (transfer.status != LIBUSB_TRANSFER_CANCELLED)
+                fail (getTransferStatusString (transfer.status));
+
+            return;
+        }
+
+        if ( ! running)
+            return;
+
+        processPackets (transfer);
+        submit (transfer);
+    }
+
+    void processPackets (libusb_transfer& transfer) noexcept
+    {
+        const auto transferIndex {(int) (transfer.buffer - buffers.getData()) / (options.packetSize * options.packetsPerTransfer)};
+        auto* transferPackets = packets + transferIndex * options.packetsPerTransfer;
+
+        for (auto index {0}; index < transfer.num_iso_packets; ++index)
+        {
+            const auto& packetDescriptor = transfer.iso_packet_desc[index];
+            auto& packet = transferPackets[index];
+
+            packet.data = transfer.buffer + index * options.packetSize;
+            packet.length = (int) (input ? packetDescriptor.actual_length : packetDescriptor.length);
+            packet.maxLength = options.packetSize;
+            packet.status = (Packet::Status) packetDescriptor.status;
+        }
+
+        callback.processPackets (transferPackets, transfer.num_iso_packets);
+
+        if (input)
+            return;
+
+        // packets are sent back to back, so any shorter than the maximum
+        // need closing up
+        auto offset {0};
+
+        for (auto index {0}; index < transfer.num_iso_packets; ++index)
+        {
+            const auto length {juce::jlimit (0, options.packetSize, transferPackets[index].length)};
+
+            if (offset != index * options.packetSize)
+                memmove (transfer.buffer + offset, transferPackets[index].data, (size_t) length);
+
+            transfer.iso_packet_desc[index].length = (unsigned int) length;
+            offset += length;
+        }
+
+        transfer.length = offset;
+    }
+
+    bool submit (libusb_transfer& transfer) noexcept
+    {
+        ++numTransfersInFlight;
+        const auto result {LibUsbTransfer::fromLibUsb (transfer).submit (counters)};
+
+        if (result == LIBUSB_SUCCESS)
+            return true;
+
+        --numTransfersInFlight;
+        fail (getLibUsbErrorString (result));
+        return false;
+    }
+
+    void fail (const juce::String& error) noexcept
+    {
+        std::unique_lock<std::mutex> lock (lastErrorMutex);
+
+        if (running.exchange (false))
+            lastError = error;
+    }
+
+    void stop() noexcept
+    {
+        running = false;
+        signalThreadShouldExit();
+        notify();
+        stopThread (1000);
+
+        for (auto* transfer : transfers)
+            getLibUsbBackend().cancelTransfer (transfer->transfer);
+
+        while (numTransfersInFlight > 0)
+            allTransfersCompleted.wait (100);
+    }
+
+    const std::shared_ptr<USBDevice::Pimpl> device;
+    Options options;
+    Callback& callback;
+    const bool input;
+    const LibUsbClaimedInterface claimedInterface;
+    LibUsbTransferCounters counters {&device->transferCounters};
+
+    LibUsbBufferPool::Buffer buffers;
+    juce::HeapBlock<Packet> packets;
+    juce::OwnedArray<LibUsbTransfer> transfers;
+    std::atomic<int> numTransfersInFlight {0};
+
+    juce::AbstractFifo completedTransfers;
+    juce::HeapBlock<libusb_transfer*> completedTransferQueue;
+
+    std::atomic<bool> running {false};
+    juce::String lastError;
+    mutable std::mutex lastErrorMutex;
+    juce::WaitableEvent started;
+    juce::WaitableEvent allTransfersCompleted;
+
+    const LibUsbEventHandler eventHandler {claimedInterface.lease.getContext()};
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (Pimpl)
+};
+
+//==============================================================================
+USBIsochronousStream::USBIsochronousStream (const USBDevice& device,
+                                            const Options& options,
+                                            Callback& callback)
+    : pimpl (std::make_unique<Pimpl> (device.pimpl, options, callback))
+{
+}
+
+USBIsochronousStream::~USBIsochronousStream() noexcept
+{
+}
+
+USBIsochronousStream::Options USBIsochronousStream::getOptions() const noexcept
+{
+    return pimpl->getOptions();
+}
+
+bool USBIsochronousStream::isInput() const noexcept
+{
+    return pimpl->isInput();
+}
+
+bool USBIsochronousStream::isRunning() const noexcept
+{
+    return pimpl->isRunning();
+}
+
+USBTransferStatistics USBIsochronousStream::getStatistics() const noexcept
+{
+    return pimpl->getStatistics();
+}
+
+juce::String USBIsochronousStream::getLastError() const noexcept
+{
+    return pimpl->getLastError();
+}
@@ -0,0 +1,143 @@
+
+#pragma once
+
+/** Streams data to or from an isochronous endpoint of a USBDevice.
+
+    Isochronous endpoints move a packet every (micro)frame with guaranteed
+    bandwidth but no retries, which makes them the endpoint of choice for
+    audio interfaces. A fixed pool of transfers, each carrying a number of
+    packets, is kept queued on the endpoint and as each one completes its
+    packets are handed to a Callback on a dedicated real-time thread.
+
+    The latency of the stream is roughly the number of transfers multiplied
+    by the number of packets in each transfer, in (micro)frames: 1ms each at
+    full speed and 125us at high speed and above.
+ */
+class USBIsochronousStream
+{
+public:
+    struct Packet
+    {
+        /** The outcome of a packet, in the same order as libusb_transfer_status. */
+        enum class Status
+        {
+            completed,
+            error,
+            timedOut,
+            cancelled,
+            stalled,
+            noDevice,
+            overflow
+        };
+
+        /** For IN endpoints the data received, for OUT endpoints the buffer
+            to fill with the data to send.
+         */
+        juce::uint8* data {nullptr};
+
+        /** For IN endpoints the number of bytes received, for OUT endpoints
+            set this to the number of bytes to send.
+         */
+        int length {0};
+
+        /** The maximum number of bytes the packet can hold. */
+        int maxLength {0};
+
+        /** For IN endpoints the outcome of receiving this packet, for OUT
+            endpoints the outcome of the last packet sent from this slot.
+         */
+        Status status {Status::completed};
+    };
+
+    class Callback
+    {
+    public:
+        /** Destructor. */
+        virtual ~Callback() {}
+
+        /** Called on the stream's real-time thread each time a transfer
+            completes.
+
+            For IN endpoints the packets hold the data received. For OUT
+            endpoints the packets should be filled with the next data to
+            send, this is also called for every transfer before the stream
+            starts.
+
+            Avoid anything here that may block, such as allocating memory or
+            taking locks, the device won't wait.
+         */
+        virtual void processPackets (Packet* packets, int numPackets) = 0;
+    };
+
+    struct Options
+    {
+        /** The interface the endpoint belongs to, this will be claimed for
+            the lifetime of the stream.
+         */
+        int interfaceNumber {0};
+
+        /** The alternate setting of the interface to select, if this is zero
+            the current setting is left alone.
+
+            Isochronous endpoints are usually found in a non-zero alternate
+            setting, the zero setting reserving no bandwidth on the bus.
+         */
+        int alternateSetting {1};
+
+        /** The endpoint address, including the direction bit. */
+        int endpointAddress {0};
+
+        /** The number of transfers to keep in flight at once. */
+        int numTransfers {4};
+
+        /** The number of packets in each transfer. */
+        int packetsPerTransfer {8};
+
+        /** The size of each packet in bytes, if this is zero the maximum the
+            endpoint allows is used.
+         */
+        int packetSize {0};
+    };
+
+    /** Claims the interface and starts streaming.
+
+        Throws a std::runtime_error if the device can't be opened, the
+        interface can't be claimed, the endpoint isn't isochronous, the
+        stream's thread can't be started or the transfers can't be submitted.
+     */
+    USBIsochronousStream (const USBDevice& device, const Options& options, Callback& callback);
+
+    /** Destructor, stops the callbacks, cancels any transfers and releases
+        the interface.
+     */
+    ~USBIsochronousStream() noexcept;
+
+    /** Returns the options the stream was created with, the packet size
+        reflects the size actually used.
+     */
+    Options getOptions() const noexcept;
+
+    /** Returns true if this stream reads from an IN endpoint. */
+    bool isInput() const noexcept;
+
+    /** Returns true until the stream stops because of an error, such as the
+        device being removed.
+     */
+    bool isRunning() const noexcept;
+
+    /** Returns the statistics of this stream's transfers, this never blocks
+        and can be called from any thread.
+
+        The transfers are also counted by the device's statistics.
+     */
+    USBTransferStatistics getStatistics() const noexcept;
+
+    /** Returns a description of the error that stopped the stream. */
+    juce::String getLastError() const noexcept;
+
+private:
+    class Pimpl;
+    std::unique_ptr<Pimpl> pimpl;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (USBIsochronousStream)
+};
@@ -0,0 +1,541 @@
+
+//==============================================================================
+/** One source of a USBSynchronizedCapture.
+
+    The stream's real-time thread copies the data of every packet into a FIFO,
+    measures the rate frames arrive at against the host clock and publishes
+    how many frames had been written at the time of the last transfer. The
+    thread calling readBlock() reads the FIFO and uses that time to work out
+    when the next frame it reads was received.
+ */
+class LibUsbSynchronizedSource  : public USBIsochronousStream::Callback
+{
+public:
+    LibUsbSynchronizedSource (const USBSynchronizedCapture::Source& sourceToUse,
+                              int blockSize,
+                              int numBufferedBlocks)
+        : source (sourceToUse)
+        , fifo (source.bytesPerFrame * blockSize * numBufferedBlocks)
+        , scratch ((size_t) (source.bytesPerFrame * blockSize))
+        , lastFrame ((size_t) source.bytesPerFrame, true)
+        , ticksPerSecond ((double) juce::Time::getHighResolutionTicksPerSecond())
+        , scratchFrames (blockSize)
+    {
+    }
+
+    ~LibUsbSynchronizedSource() noexcept override
+    {
+        stop();
+    }
+
+    void start()
+    {
+        stream = std::make_unique<USBIsochronousStream> (source.device, source.streamOptions, *this);
+    }
+
+    void stop() noexcept
+    {
+        stream.reset();
+    }
+
+    bool isRunning() const noexcept
+    {
+        return stream != nullptr && stream->isRunning();
+    }
+
+    juce::String getLastError() const noexcept
+    {
+        return stream != nullptr ? stream->getLastError() : juce::String();
+    }
+
+    //==============================================================================
+    double getFramesPerSecond() const noexcept
+    {
+        const auto measured {measuredFramesPerSecond.load()};
+        return measured > 0.0 ? measured : source.framesPerSecond;
+    }
+
+    int getNumFramesReady() const noexcept
+    {
+        return fifo.getNumReady() / source.bytesPerFrame;
+    }
+
+    juce::int64 getNumFramesOverflowed() const noexcept
+    {
+        return numFramesOverflowed;
+    }
+
+    /** Returns the host time, in seconds, the next frame to be read was
+        received at, or a negative value if nothing has been received yet.
+     */
+    double getTimeOfNextFrame() const noexcept
+    {
+        juce::int64 ticks, framesWritten;
+        readTimestamp (ticks, framesWritten);
+
+        if (ticks == 0)
+            return -1.0;
+
+        return (double) ticks / ticksPerSecond - (double) (framesWritten - numFramesRead) / getFramesPerSecond();
+    }
+
+    /** Reads and throws away frames. */
+    void skip (int numFrames) noexcept
+    {
+        while (numFrames > 0)
+        {
+            const auto numToRead {juce::jmin (numFrames, scratchFrames)};
+            read (scratch, numToRead);
+            numFrames -= numToRead;
+        }
+    }
+
+    /** Reads a block of frames, dropping one first if slip is positive or
+        repeating the last frame read if slip is negative.
+     */
+    void readBlock (void* destination, int blockSize, int slip) noexcept
+    {
+        auto* dest = static_cast<juce::uint8*> (destination);
+
+        if (slip > 0)
+        {
+            read (lastFrame, 1);
+            ++numFramesDropped;
+        }
+        else if (slip < 0)
+        {
+            memcpy (dest, lastFrame, (size_t) source.bytesPerFrame);
+            dest += source.bytesPerFrame;
+            --blockSize;
+            ++numFramesRepeated;
+        }
+
+        read (dest, blockSize);
+        memcpy (lastFrame, dest + (blockSize - 1) * source.bytesPerFrame, (size_t) source.bytesPerFrame);
+    }
+
+    USBSynchronizedCapture::SourceStatus getStatus() const noexcept
+    {
+        USBSynchronizedCapture::SourceStatus status;
+        status.measuredFramesPerSecond = getFramesPerSecond();
+        status.driftPpm = (status.measuredFramesPerSecond / source.framesPerSecond - 1.0) * 1.0e6;
+        status.numBusFrames = numBusFrames;
+        status.numFramesReceived = numFramesReceived;
+        status.lastTransferTicks = lastTransferTicks;
+        status.numFramesBuffered = getNumFramesReady();
+        status.numFramesOverflowed = numFramesOverflowed;
+        status.numFramesDropped = numFramesDropped;
+        status.numFramesRepeated = numFramesRepeated;
+        return status;
+    }
+
+    const USBSynchronizedCapture::Source source;
+
+    // only used by the thread reading the capture
+    double phase {0.0};
+    juce::int64 numFramesOverflowedWhenAligned {0};
+
+private:
+    // called on the stream's real-time thread
+    void processPackets (USBIsochronousStream::Packet* packets, int numPackets) override
+    {
+        const auto now {juce::Time::getHighResolutionTicks()};
+        auto numFrames {0};
+        auto numLost {0};
+
+        for (auto index {0}; index < numPackets; ++index)
+        {
+            const auto& packet = packets[index];
+
+            if (packet.status != USBIsochronousStream::Packet::Status::completed)
+                continue;
+
+            // packets should only ever hold whole frames!
+            jassert (packet.length % source.bytesPerFrame == 0);
+
+            const auto length {packet.length - packet.length % source.bytesPerFrame};
+            const auto freeSpace {fifo.getFreeSpace() - fifo.getFreeSpace() % source.bytesPerFrame};
+            const auto written {fifo.write (packet.data, juce::jmin (length, freeSpace))};
+
+            numFrames += length / source.bytesPerFrame;
+            numLost += (length - written) / source.bytesPerFrame;
+        }
+
+        numFramesWritten += numFrames - numLost;
+        numBusFrames += numPackets;
+        numFramesReceived += numFrames;
+        lastTransferTicks = now;
+
+        if (numLost > 0)
+            numFramesOverflowed += numLost;
+        else
+            writeTimestamp (now, numFramesWritten);
+
+        measureRate (now);
+    }
+
+    // the rate is measured over windows of about a second, so the jitter in
+    // when transfers complete is small compared to the time they span, then
+    // smoothed across windows
+    void measureRate (juce::int64 now) noexcept
+    {
+        if (windowStartTicks == 0)
+        {
+            windowStartTicks = now;
+            windowStartFrames = numFramesReceived;
+            return;
+        }
+
+        const auto seconds {(double) (now - windowStartTicks) / ticksPerSecond};
+
+        if (seconds < measurementWindowSeconds)
+            return;
+
+        const auto rate {(double) (numFramesReceived - windowStartFrames) / seconds};
+
+        windowStartTicks = now;
+        windowStartFrames = numFramesReceived;
+
+        // anything this far out comes from missed packets or a stalled
+        // thread rather than the device's clock
+        if (std::abs (rate / source.framesPerSecond - 1.0) > maxPlausibleDeviation)
+            return;
+
+        const auto previous {measuredFramesPerSecond.load()};
+        measuredFramesPerSecond = previous > 0.0 ? previous + smoothing * (rate - previous) : rate;
+    }
+
+    // the time and frame count are read together from another thread, so
+    // they're written under a sequence number that's odd while they change
+    void writeTimestamp (juce::int64 ticks, juce::int64 framesWritten) noexcept
+    {
+        const auto sequence {timestampSequence.load (std::memory_order_relaxed)};
+        timestampSequence.store (sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence (std::memory_order_release);
+
+        timestampTicks.store (ticks, std::memory_order_relaxed);
+        timestampFramesWritten.store (framesWritten, std::memory_order_relaxed);
+
+        timestampSequence.store (sequence + 2, std::memory_order_release);
+    }
+
+    void readTimestamp (juce::int64& ticks, juce::int64& framesWritten) const noexcept
+    {
+        for (;;)
+        {
+            const auto sequence {timestampSequence.load (std::memory_order_acquire)};
+
+            ticks = timestampTicks.load (std::memory_order_relaxed);
+            framesWritten = timestampFramesWritten.load (std::memory_order_relaxed);
+
+            std::atomic_thread_fence (std::memory_order_acquire);
+
+            if ((sequence & 1) == 0 && sequence == timestampSequence.load (std::memory_order_relaxed))
+                return;
+        }
+    }
+
+    void read (void* destination, int numFrames) noexcept
+    {
+        const auto numRead {fifo.read (destination, numFrames * source.bytesPerFrame)};
+
+        // the caller should have checked there were enough frames!
+        jassert (numRead == numFrames * source.bytesPerFrame);
+
+        numFramesRead += numRead / source.bytesPerFrame;
+    }
+
+    static constexpr auto measurementWindowSeconds {1.0};
+    static constexpr auto maxPlausibleDeviation {0.005};
+    static constexpr auto smoothing {0.1};
+
+    ByteFifo fifo;
+    juce::HeapBlock<juce::uint8> scratch;
+    juce::HeapBlock<juce::uint8> lastFrame;
+    const double ticksPerSecond;
+    const int scratchFrames;
+
+    // only used by the stream's thread
+    juce::int64 numFramesWritten {0};
+    juce::int64 windowStartTicks {0};
+    juce::int64 windowStartFrames {0};
+
+    // only used by the thread reading the capture
+    juce::int64 numFramesRead {0};
+
+    std::atomic<juce::uint32> timestampSequence {0};
+    std::atomic<juce::int64> timestampTicks {0};
+    std::atomic<juce::int64> timestampFramesWritten {0};
+
+    std::atomic<double> measuredFramesPerSecond {0.0};
+    std::atomic<juce::int64> numBusFrames {0};
+    std::atomic<juce::int64> numFramesReceived {0};
+    std::atomic<juce::int64> lastTransferTicks {0};
+    std::atomic<juce::int64> numFramesOverflowed {0};
+    std::atomic<juce::int64> numFramesDropped {0};
+    std::atomic<juce::int64> numFramesRepeated {0};
+
+    std::unique_ptr<USBIsochronousStream> stream;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (LibUsbSynchronizedSource)
+};
+
+//==============================================================================
+class USBSynchronizedCapture::Pimpl
+{
+public:
+    Pimpl (const Options& optionsToUse)
+        : options (optionsToUse)
+        , numStartupFrames (options.blockSize * juce::jlimit (1, juce::jmax (1, options.numBufferedBlocks - 1), options.numStartupBlocks))
+    {
+        // there has to be room for a block, the frame that may be dropped
+        // with it and the blocks buffered at startup
+        jassert (options.numBufferedBlocks >= 2);
+
+        if (options.sources.isEmpty() || options.blockSize <= 0 || options.numBufferedBlocks < 2)
+            throwOnLibUsbError (LIBUSB_ERROR_INVALID_PARAM);
+
+        for (const auto& source : options.sources)
+        {
+            const auto input {(source.streamOptions.endpointAddress & LIBUSB_ENDPOINT_DIR_MASK) == LIBUSB_ENDPOINT_IN};
+
+            if ( ! input || source.bytesPerFrame <= 0 || source.framesPerSecond <= 0.0)
+                throwOnLibUsbError (LIBUSB_ERROR_INVALID_PARAM);
+
+            sources.add (std::make_unique<LibUsbSynchronizedSource> (source,
+                                                                      options.blockSize,
+                                                                      options.numBufferedBlocks));
+        }
+
+        slips.calloc ((size_t) sources.size());
+        phases.calloc ((size_t) sources.size());
+
+        // the streams only start once every source exists, if any of them
+        // throws the ones already started are stopped as the sources are
+        // destroyed
+        for (auto* source : sources)
+            source->start();
+    }
+
+    ~Pimpl() noexcept
+    {
+        for (auto* source : sources)
+            source->stop();
+    }
+
+    Options getOptions() const noexcept
+    {
+        return options;
+    }
+
+    int getNumSources() const noexcept
+    {
+        return sources.size();
+    }
+
+    bool isRunning() const noexcept
+    {
+        for (auto* source : sources)
+        {
+            if ( ! source->isRunning())
+                return false;
+        }
+
+        return true;
+    }
+
+    juce::String getLastError() const noexcept
+    {
+        for (auto* source : sources)
+        {
+            if ( ! source->isRunning())
+                return source->getLastError();
+        }
+
+        return {};
+    }
+
+    int getNumBlocksAvailable() const noexcept
+    {
+        auto numFrames {std::numeric_limits<int>::max()};
+
+        for (auto* source : sources)
+            numFrames = juce::jmin (numFrames, source->getNumFramesReady());
+
+        return numFrames / options.blockSize;
+    }
+
+    bool readBlock (void* const* destinations) noexcept
+    {
+        if ( ! aligned && ! align())
+            return false;
+
+        // frames lost to a full buffer leave a source behind the others
+        for (auto* source : sources)
+        {
+            if (source->getNumFramesOverflowed() != source->numFramesOverflowedWhenAligned)
+            {
+                aligned = false;
+                return false;
+            }
+        }
+
+        auto& reference = *sources.getFirst();
+
+        if (reference.getNumFramesReady() < options.blockSize)
+            return false;
+
+        const auto referenceRate {reference.getFramesPerSecond()};
+        const auto referenceTime {reference.getTimeOfNextFrame()};
+
+        // works out every slip before reading anything, so nothing is read if
+        // any source is short of frames
+        for (auto index {1}; index < sources.size(); ++index)
+        {
+            auto& source = *sources.getUnchecked (index);
+            const auto rate {source.getFramesPerSecond()};
+
+            // the drift between the clocks, as measured, plus a small share of
+            // how far apart the sources actually are, which stops any error in
+            // the measurement from building up
+            const auto framesBehind {(referenceTime - source.getTimeOfNextFrame()) * rate};
+            const auto phase {source.phase
+                              + (rate / referenceRate - 1.0) * options.blockSize
+                              + framesBehind * offsetCorrection};
+
+            slips[index] = phase >= 1.0 ? 1 : (phase <= -1.0 ? -1 : 0);
+            phases[index] = phase - slips[index];
+
+            if (source.getNumFramesReady() < options.blockSize + slips[index])
+                return false;
+        }
+
+        reference.readBlock (destinations[0], options.blockSize, 0);
+
+        for (auto index {1}; index < sources.size(); ++index)
+        {
+            auto& source = *sources.getUnchecked (index);
+            source.phase = phases[index];
+            source.readBlock (destinations[index], options.blockSize, slips[index]);
+        }
+
+        return true;
+    }
+
+    SourceStatus getSourceStatus (int sourceIndex) const noexcept
+    {
+        auto* source = sources[sourceIndex];
+
+        if (source == nullptr)
+            return {};
+
+        auto status {source->getStatus()};
+        status.driftFromReferencePpm = (source->getFramesPerSecond() / sources.getFirst()->getFramesPerSecond() - 1.0) * 1.0e6;
+        return status;
+    }
+
+private:
+    // lines the sources up by the time their oldest buffered frames were
+    // received, then trims them to the startup latency
+    bool align() noexcept
+    {
+        auto latestTime {0.0};
+
+        for (auto* source : sources)
+        {
+            const auto time {source->getTimeOfNextFrame()};
+
+            if (source->getNumFramesReady() < numStartupFrames || time < 0.0)
+                return false;
+
+            latestTime = juce::jmax (latestTime, time);
+        }
+
+        for (auto* source : sources)
+        {
+            const auto framesEarly {(latestTime - source->getTimeOfNextFrame()) * source->getFramesPerSecond()};
+            source->skip (juce::jlimit (0, source->getNumFramesReady(), juce::roundToInt (framesEarly)));
+        }
+
+        auto numFramesReady {std::numeric_limits<int>::max()};
+
+        for (auto* source : sources)
+            numFramesReady = juce::jmin (numFramesReady, source->getNumFramesReady());
+
+        const auto referenceRate {sources.getFirst()->getFramesPerSecond()};
+        const auto excess {numFramesReady - numStartupFrames};
+
+        for (auto* source : sources)
+        {
+            if (excess > 0)
+                source->skip (juce::jmin (source->getNumFramesReady(),
+                                          juce::roundToInt (excess * source->getFramesPerSecond() / referenceRate)));
+
+            source->phase = 0.0;
+            source->numFramesOverflowedWhenAligned = source->getNumFramesOverflowed();
+        }
+
+        aligned = true;
+        return true;
+    }
+
+    // the share of the measured offset between sources corrected each block,
+    // small enough that the jitter in transfer times averages out
+    static constexpr auto offsetCorrection {0.001};
+
+    const Options options;
+    const int numStartupFrames;
+    juce::OwnedArray<LibUsbSynchronizedSource> sources;
+
+    // only used by the thread reading the capture
+    bool aligned {false};
+    juce::HeapBlock<int> slips;
+    juce::HeapBlock<double> phases;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (Pimpl)
+};
+
+//==============================================================================
+USBSynchronizedCapture::USBSynchronizedCapture (const Options& options)
+    : pimpl (std::make_unique<Pimpl> (options))
+{
+}
+
+USBSynchronizedCapture::~USBSynchronizedCapture() noexcept
+{
+}
+
+USBSynchronizedCapture::Options USBSynchronizedCapture::getOptions() const noexcept
+{
+    return pimpl->getOptions();
+}
+
+int USBSynchronizedCapture::getNumSources() const noexcept
+{
+    return pimpl->getNumSources();
+}
+
+bool USBSynchronizedCapture::isRunning() const noexcept
+{
+    return pimpl->isRunning();
+}
+
+juce::String USBSynchronizedCapture::getLastError() const noexcept
+{
+    return pimpl->getLastError();
+}
+
+int USBSynchronizedCapture::getNumBlocksAvailable() const noexcept
+{
+    return pimpl->getNumBlocksAvailable();
+}
+
+bool USBSynchronizedCapture::readBlock (void* const* destinations) noexcept
+{
+    return pimpl->readBlock (destinations);
+}
+
+USBSynchronizedCapture::SourceStatus USBSynchronizedCapture::getSourceStatus (int sourceIndex) const noexcept
+{
+    return pimpl->getSourceStatus (sourceIndex);
+}
@@ -0,0 +1,164 @@
+#pragma once
+
+/** Reads several isochronous IN endpoints, usually on different devices, as
+    one stream of aligned blocks.
+
+    Every device runs on its own clock, so over time each one delivers
+    slightly more or fewer frames than the others. The capture notes the host
+    time and number of (micro)frames of every transfer that completes, from
+    which it keeps a running estimate of each device's real frame rate. The
+    first source is the reference, the others are kept in step with it by
+    dropping or repeating a single frame whenever their drift adds up to one,
+    which works for any frame format and needs no resampling.
+
+    There are no threads beyond the ones the streams already have, the data
+    is handed over through lock free FIFOs and the drift correction happens
+    inside readBlock(), which should be called from one thread such as an
+    audio callback.
+
+    @code
+    USBSynchronizedCapture::Options options;
+
+    for (const auto& device : USBDeviceManager::getInstance().getDevices())
+    {
+        USBSynchronizedCapture::Source source;
+        source.device = device;
+        source.streamOptions.endpointAddress = 0x81;
+        source.bytesPerFrame = 2 * 3;
+        source.framesPerSecond = 48000.0;
+        options.sources.add (source);
+    }
+
+    USBSynchronizedCapture capture (options);
+    @endcode
+ */
+class USBSynchronizedCapture
+{
+public:
+    struct Source
+    {
+        /** The device to read from, as found by the USBDeviceManager. */
+        USBDevice device;
+
+        /** The stream to open on the device, the endpoint must be an IN
+            endpoint.
+         */
+        USBIsochronousStream::Options streamOptions;
+
+        /** The size of one frame, such as one sample for every channel.
+            Packets should always hold a whole number of frames.
+         */
+        int bytesPerFrame {0};
+
+        /** The rate the device is meant to deliver frames at. */
+        double framesPerSecond {0.0};
+    };
+
+    struct Options
+    {
+        /** The sources to read, the first is the clock the others are kept
+            in step with.
+         */
+        juce::Array<Source> sources;
+
+        /** The number of frames in each block read. */
+        int blockSize {256};
+
+        /** The number of blocks each source can hold before frames are
+            dropped.
+         */
+        int numBufferedBlocks {8};
+
+        /** The number of blocks that have to be buffered for every source
+            before the first block can be read. More gives more tolerance of
+            late transfers, at the cost of latency.
+         */
+        int numStartupBlocks {2};
+    };
+
+    /** What is known about one source. */
+    struct SourceStatus
+    {
+        /** The frame rate measured against the host clock, or the nominal
+            rate until there have been enough transfers to measure it.
+         */
+        double measuredFramesPerSecond {0.0};
+
+        /** How far the measured rate is from the nominal rate, in parts per
+            million.
+         */
+        double driftPpm {0.0};
+
+        /** How far the measured rate is from the reference source's, in
+            parts per million. This is what the frame slips make up for.
+         */
+        double driftFromReferencePpm {0.0};
+
+        /** The number of packets received so far, one for every (micro)frame
+            of the bus the endpoint was serviced in, the number of frames of
+            data they held and the host time of the last transfer as
+            juce::Time::getHighResolutionTicks().
+         */
+        juce::int64 numBusFrames {0};
+        juce::int64 numFramesReceived {0};
+        juce::int64 lastTransferTicks {0};
+
+        /** The frames waiting to be read. */
+        int numFramesBuffered {0};
+
+        /** Frames lost because the source's buffer was full. */
+        juce::int64 numFramesOverflowed {0};
+
+        /** Frames dropped or repeated to keep the source in step. */
+        juce::int64 numFramesDropped {0};
+        juce::int64 numFramesRepeated {0};
+    };
+
+    /** Opens a stream on every source.
+
+        Throws a std::runtime_error if any of the streams can't be started.
+     */
+    explicit USBSynchronizedCapture (const Options& options);
+
+    /** Destructor, stops every stream. */
+    ~USBSynchronizedCapture() noexcept;
+
+    /** Returns the options the capture was created with. */
+    Options getOptions() const noexcept;
+
+    /** Returns the number of sources. */
+    int getNumSources() const noexcept;
+
+    /** Returns true until any of the streams stops, such as when a device is
+        removed.
+     */
+    bool isRunning() const noexcept;
+
+    /** Returns a description of the error that stopped the first stream to
+        stop.
+     */
+    juce::String getLastError() const noexcept;
+
+    /** Returns the number of blocks every source has enough frames for. */
+    int getNumBlocksAvailable() const noexcept;
+
+    /** Reads the next block from every source.
+
+        Each destination must have room for blockSize frames of its source.
+        This never blocks or allocates, it returns false without reading
+        anything if a source doesn't have enough frames yet. The first time
+        it succeeds it aligns the sources by the host time of their data.
+     */
+    bool readBlock (void* const* destinations) noexcept;
+
+    /** Returns what's known about a source, this can be called from any
+        thread.
+     */
+    SourceStatus getSourceStatus (int sourceIndex) const noexcept;
+
+private:
+    class Pimpl;
+    std::unique_ptr<Pimpl> pimpl;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (USBSynchronizedCapture)
+};
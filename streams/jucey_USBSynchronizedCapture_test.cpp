@@ -0,0 +1,114 @@
+//==============================================================================
+class USBSynchronizedCaptureTests : public juce::UnitTest
+{
+public:
+    USBSynchronizedCaptureTests()
+        : juce::UnitTest ("USBSynchronizedCapture", "jucey_libusb")
+    {
+    }
+
+    void runTest() override
+    {
+        LibUsbSimulatedDevices bus;
+
+        // one frame in every packet, so every frame starts with the time
+        // stamp the simulated bus puts at the start of each packet
+        for (auto productId {1}; productId <= 2; ++productId)
+        {
+            auto spec {LibUsbSimulatedDevices::makeDeviceSpec (productId)};
+            spec.endpoints.add ({isochronousEndpoint, USBDevice::Endpoint::TransferType::isochronous, bytesPerFrame, 1, 1, 0.0});
+            bus.addDevice (spec);
+        }
+
+        expect (bus.waitForNumDevices (2));
+
+        USBSynchronizedCapture::Options options {};
+        options.blockSize = blockSize;
+        options.numBufferedBlocks = 16;
+        options.numStartupBlocks = 2;
+
+        for (auto productId {1}; productId <= 2; ++productId)
+        {
+            USBSynchronizedCapture::Source source {};
+            source.device = bus.findDevice (productId);
+            source.streamOptions.endpointAddress = isochronousEndpoint;
+            source.streamOptions.packetSize = bytesPerFrame;
+            source.bytesPerFrame = bytesPerFrame;
+            source.framesPerSecond = framesPerSecond;
+            options.sources.add (source);
+        }
+
+        juce::HeapBlock<juce::uint8> firstBlock ((size_t) (blockSize * bytesPerFrame));
+        juce::HeapBlock<juce::uint8> secondBlock ((size_t) (blockSize * bytesPerFrame));
+        void* const destinations[] {firstBlock.getData(), secondBlock.getData()};
+
+        beginTest ("The first block read is aligned and trimmed to the startup latency");
+
+        try
+        {
+            USBSynchronizedCapture capture {options};
+            expectEquals (capture.getNumSources(), 2);
+
+            // lets both sources buffer far more than the startup latency
+            juce::Thread::sleep (60);
+
+            expect (LibUsbSimulatedDevices::waitUntil ([&] { return capture.readBlock (destinations); }));
+
+            const auto now {juce::Time::getHighResolutionTicks()};
+            const auto firstTicks {getFrameTicks (firstBlock)};
+            const auto secondTicks {getFrameTicks (secondBlock)};
+
+            expect (ticksToMs (std::abs (firstTicks - secondTicks)) < alignmentToleranceMs);
+
+            const auto startupLatencyMs {1000.0 * blockSize * options.numStartupBlocks / framesPerSecond};
+            expect (ticksToMs (now - firstTicks) < startupLatencyMs + alignmentToleranceMs);
+
+            beginTest ("The sources stay aligned");
+            {
+                auto numBlocksRead {0};
+                auto numBlocksAligned {0};
+
+                while (numBlocksRead < 20 && LibUsbSimulatedDevices::waitUntil ([&] { return capture.readBlock (destinations); }))
+                {
+                    ++numBlocksRead;
+
+                    if (ticksToMs (std::abs (getFrameTicks (firstBlock) - getFrameTicks (secondBlock))) < alignmentToleranceMs)
+                        ++numBlocksAligned;
+                }
+
+                expect (capture.isRunning(), capture.getLastError());
+                expectEquals (numBlocksRead, 20);
+                expectEquals (numBlocksAligned, 20);
+            }
+        }
+        catch (const std::exception& e)
+        {
+            expect (false, e.what());
+        }
+    }
+
+private:
+    static constexpr int isochronousEndpoint {0x81};
+    static constexpr int bytesPerFrame {16};
+    static constexpr int blockSize {64};
+
+    // a packet every 125us microframe at high speed
+    static constexpr double framesPerSecond {8000.0};
+
+    // a few transfers of eight packets
+    static constexpr double alignmentToleranceMs {4.0};
+
+    static juce::int64 getFrameTicks (const juce::uint8* frame) noexcept
+    {
+        juce::int64 ticks {0};
+        std::memcpy (&ticks, frame, sizeof (ticks));
+        return ticks;
+    }
+
+    static double ticksToMs (juce::int64 ticks) noexcept
+    {
+        return 1000.0 * (double) ticks / (double) juce::Time::getHighResolutionTicksPerSecond();
+    }
+};
+
+static USBSynchronizedCaptureTests usbSynchronizedCaptureTests;
@@ -0,0 +1,270 @@
+#pragma once
+
+//==============================================================================
+/** The libusb functions the module calls, gathered behind one interface so
+    that something other than real hardware, like the USBSimulatedBus, can
+    stand in for libusb.
+
+    Every function has the same arguments and return value as the libusb
+    function it's named after. Only functions that talk to the OS or a device,
+    or that touch memory libusb keeps next to a transfer, are here. Helpers
+    that just fill in structures, like libusb_fill_bulk_transfer, are still
+    called directly.
+
+    The backend can only be switched when JUCEY_LIBUSB_ENABLE_SIMULATION is
+    enabled, otherwise libusb is always used.
+ */
+class LibUsbBackend
+{
+public:
+    virtual ~LibUsbBackend() = default;
+
+    virtual int init (libusb_context** context) = 0;
+    virtual void exit (libusb_context* context) = 0;
+    virtual int hasCapability (uint32_t capability) = 0;
+
+    virtual ssize_t getDeviceList (libusb_context* context, libusb_device*** list) = 0;
+    virtual void freeDeviceList (libusb_device** list, int unrefDevices) = 0;
+    virtual libusb_device* refDevice (libusb_device* device) = 0;
+    virtual void unrefDevice (libusb_device* device) = 0;
+
+    virtual int getDeviceDescriptor (libusb_device* device, libusb_device_descriptor* descriptor) = 0;
+    virtual int getConfigDescriptor (libusb_device* device, uint8_t index, libusb_config_descriptor** config) = 0;
+    virtual int getActiveConfigDescriptor (libusb_device* device, libusb_config_descriptor** config) = 0;
+    virtual void freeConfigDescriptor (libusb_config_descriptor* config) = 0;
+
+    virtual uint8_t getBusNumber (libusb_device* device) = 0;
+    virtual uint8_t getDeviceAddress (libusb_device* device) = 0;
+    virtual uint8_t getPortNumber (libusb_device* device) = 0;
+    virtual int getPortNumbers (libusb_device* device, uint8_t* portNumbers, int portNumbersLength) = 0;
+    virtual int getDeviceSpeed (libusb_device* device) = 0;
+
+    virtual int open (libusb_device* device, libusb_device_handle** handle) = 0;
+    virtual void close (libusb_device_handle* handle) = 0;
+    virtual int getStringDescriptorAscii (libusb_device_handle* handle, uint8_t index, unsigned char* data, int length) = 0;
+    virtual int claimInterface (libusb_device_handle* handle, int interfaceNumber) = 0;
+    virtual int releaseInterface (libusb_device_handle* handle, int interfaceNumber) = 0;
+    virtual int setInterfaceAltSetting (libusb_device_handle* handle, int interfaceNumber, int alternateSetting) = 0;
+    virtual unsigned char* devMemAlloc (libusb_device_handle* handle, size_t length) = 0;
+    virtual int devMemFree (libusb_device_handle* handle, unsigned char* buffer, size_t length) = 0;
+    virtual int allocStreams (libusb_device_handle* handle, uint32_t numStreams, unsigned char* endpoints, int numEndpoints) = 0;
+    virtual int freeStreams (libusb_device_handle* handle, unsigned char* endpoints, int numEndpoints) = 0;
+
+    virtual libusb_transfer* allocTransfer (int numIsoPackets) = 0;
+    virtual void freeTransfer (libusb_transfer* transfer) = 0;
+    virtual int submitTransfer (libusb_transfer* transfer) = 0;
+    virtual int cancelTransfer (libusb_transfer* transfer) = 0;
+    virtual void transferSetStreamId (libusb_transfer* transfer, uint32_t streamId) = 0;
+
+    virtual int handleEventsTimeoutCompleted (libusb_context* context, timeval* timeout, int* completed) = 0;
+    virtual void interruptEventHandler (libusb_context* context) = 0;
+
+    virtual int hotplugRegisterCallback (libusb_context* context,
+                                         int events,
+                                         int flags,
+                                         int vendorId,
+                                         int productId,
+                                         int deviceClass,
+                                         libusb_hotplug_callback_fn callback,
+                                         void* userData,
+                                         libusb_hotplug_callback_handle* callbackHandle) = 0;
+
+    virtual void hotplugDeregisterCallback (libusb_context* context, libusb_hotplug_callback_handle callbackHandle) = 0;
+
+   #if JUCEY_LIBUSB_ENABLE_SIMULATION
+    /** Returns the backend in use, which is libusb itself unless another
+        backend has been set.
+     */
+    static LibUsbBackend& getCurrent() noexcept;
+
+    /** Sets the backend to use, nullptr goes back to libusb.
+
+        This has to happen before any context is created, switching backends
+        under devices or streams that are already in use isn't possible.
+     */
+    static void setCurrent (LibUsbBackend* newBackend) noexcept;
+
+private:
+    static std::atomic<LibUsbBackend*>& getCurrentPointer() noexcept
+    {
+        static std::atomic<LibUsbBackend*> current {nullptr};
+        return current;
+    }
+   #endif
+};
+
+//==============================================================================
+/** Forwards every call straight to libusb. */
+class NativeLibUsbBackend final : public LibUsbBackend
+{
+public:
+    int init (libusb_context** context) override                { return libusb_init (context); }
+    void exit (libusb_context* context) override                { libusb_exit (context); }
+    int hasCapability (uint32_t capability) override            { return libusb_has_capability (capability); }
+
+    ssize_t getDeviceList (libusb_context* context, libusb_device*** list) override
+    {
+        return libusb_get_device_list (context, list);
+    }
+
+    void freeDeviceList (libusb_device** list, int unrefDevices) override
+    {
+        libusb_free_device_list (list, unrefDevices);
+    }
+
+    libusb_device* refDevice (libusb_device* device) override    { return libusb_ref_device (device); }
+    void unrefDevice (libusb_device* device) override            { libusb_unref_device (device); }
+
+    int getDeviceDescriptor (libusb_device* device, libusb_device_descriptor* descriptor) override
+    {
+        return libusb_get_device_descriptor (device, descriptor);
+    }
+
+    int getConfigDescriptor (libusb_device* device, uint8_t index, libusb_config_descriptor** config) override
+    {
+        return libusb_get_config_descriptor (device, index, config);
+    }
+
+    int getActiveConfigDescriptor (libusb_device* device, libusb_config_descriptor** config) override
+    {
+        return libusb_get_active_config_descriptor (device, config);
+    }
+
+    void freeConfigDescriptor (libusb_config_descriptor* config) override
+    {
+        libusb_free_config_descriptor (config);
+    }
+
+    uint8_t getBusNumber (libusb_device* device) override        { return libusb_get_bus_number (device); }
+    uint8_t getDeviceAddress (libusb_device* device) override    { return libusb_get_device_address (device); }
+    uint8_t getPortNumber (libusb_device* device) override       { return libusb_get_port_number (device); }
+    int getDeviceSpeed (libusb_device* device) override          { return libusb_get_device_speed (device); }
+
+    int getPortNumbers (libusb_device* device, uint8_t* portNumbers, int portNumbersLength) override
+    {
+        return libusb_get_port_numbers (device, portNumbers, portNumbersLength);
+    }
+
+    int open (libusb_device* device, libusb_device_handle** handle) override   { return libusb_open (device, handle); }
+    void close (libusb_device_handle* handle) override                         { libusb_close (handle); }
+
+    int getStringDescriptorAscii (libusb_device_handle* handle, uint8_t index, unsigned char* data, int length) override
+    {
+        return libusb_get_string_descriptor_ascii (handle, index, data, length);
+    }
+
+    int claimInterface (libusb_device_handle* handle, int interfaceNumber) override
+    {
+        return libusb_claim_interface (handle, interfaceNumber);
+    }
+
+    int releaseInterface (libusb_device_handle* handle, int interfaceNumber) override
+    {
+        return libusb_release_interface (handle, interfaceNumber);
+    }
+
+    int setInterfaceAltSetting (libusb_device_handle* handle, int interfaceNumber, int alternateSetting) override
+    {
+        return libusb_set_interface_alt_setting (handle, interfaceNumber, alternateSetting);
+    }
+
+    unsigned char* devMemAlloc (libusb_device_handle* handle, size_t length) override
+    {
+        return libusb_dev_mem_alloc (handle, length);
+    }
+
+    int devMemFree (libusb_device_handle* handle, unsigned char* buffer, size_t length) override
+    {
+        return libusb_dev_mem_free (handle, buffer, length);
+    }
+
+    int allocStreams (libusb_device_handle* handle, uint32_t numStreams, unsigned char* endpoints, int numEndpoints) override
+    {
+        return libusb_alloc_streams (handle, numStreams, endpoints, numEndpoints);
+    }
+
+    int freeStreams (libusb_device_handle* handle, unsigned char* endpoints, int numEndpoints) override
+    {
+        return libusb_free_streams (handle, endpoints, numEndpoints);
+    }
+
+    libusb_transfer* allocTransfer (int numIsoPackets) override  { return libusb_alloc_transfer (numIsoPackets); }
+    void freeTransfer (libusb_transfer* transfer) override       { libusb_free_transfer (transfer); }
+    int submitTransfer (libusb_transfer* transfer) override      { return libusb_submit_transfer (transfer); }
+    int cancelTransfer (libusb_transfer* transfer) override      { return libusb_cancel_transfer (transfer); }
+
+    void transferSetStreamId (libusb_transfer* transfer, uint32_t streamId) override
+    {
+        libusb_transfer_set_stream_id (transfer, streamId);
+    }
+
+    int handleEventsTimeoutCompleted (libusb_context* context, timeval* timeout, int* completed) override
+    {
+        return libusb_handle_events_timeout_completed (context, timeout, completed);
+    }
+
+    void interruptEventHandler (libusb_context* context) override
+    {
+        libusb_interrupt_event_handler (context);
+    }
+
+    int hotplugRegisterCallback (libusb_context* context,
+                                 int events,
+                                 int flags,
+                                 int vendorId,
+                                 int productId,
+                                 int deviceClass,
+                                 libusb_hotplug_callback_fn callback,
+                                 void* userData,
+                                 libusb_hotplug_callback_handle* callbackHandle) override
+    {
+        return libusb_hotplug_register_callback (context,
+                                                 (libusb_hotplug_event) events,
+                                                 (libusb_hotplug_flag) flags,
+                                                 vendorId,
+                                                 productId,
+                                                 deviceClass,
+                                                 callback,
+                                                 userData,
+                                                 callbackHandle);
+    }
+
+    void hotplugDeregisterCallback (libusb_context* context, libusb_hotplug_callback_handle callbackHandle) override
+    {
+        libusb_hotplug_deregister_callback (context, callbackHandle);
+    }
+};
+
+//==============================================================================
+#if JUCEY_LIBUSB_ENABLE_SIMULATION
+LibUsbBackend& LibUsbBackend::getCurrent() noexcept
+{
+    static NativeLibUsbBackend nativeBackend;
+
+    if (auto* backend = getCurrentPointer().load())
+        return *backend;
+
+    return nativeBackend;
+}
+
+void LibUsbBackend::setCurrent (LibUsbBackend* newBackend) noexcept
+{
+    getCurrentPointer() = newBackend;
+}
+
+/** Shorthand for LibUsbBackend::getCurrent(). */
+LibUsbBackend& getLibUsbBackend() noexcept
+{
+    return LibUsbBackend::getCurrent();
+}
+#else
+/** Returns libusb itself, as the backend can't be switched without
+    JUCEY_LIBUSB_ENABLE_SIMULATION. Returning the final class lets every call
+    be made directly rather than through the vtable.
+ */
+NativeLibUsbBackend& getLibUsbBackend() noexcept
+{
+    static NativeLibUsbBackend nativeBackend;
+    return nativeBackend;
+}
+#endif
@@ -0,0 +1,122 @@
+#pragma once
+
+//==============================================================================
+/** Plugs devices into the USBSimulatedBus for the benchmarks and the unit
+    tests, and unplugs every device again once they're done with it.
+
+    The bus is installed the first time one of these is created, which has to
+    happen before the USBDeviceManager is, so the benchmarks and tests must
+    run before anything else in the process uses the module.
+ */
+class LibUsbSimulatedDevices
+{
+public:
+    static constexpr int vendorId {0x1234};
+
+    LibUsbSimulatedDevices() noexcept
+    {
+        if ( ! bus.isInstalled())
+            bus.install();
+    }
+
+    ~LibUsbSimulatedDevices() noexcept
+    {
+        getManager().setFilters ({});
+        removeAllDevices();
+    }
+
+    USBDeviceManager& getManager() const noexcept
+    {
+        return USBDeviceManager::getInstance();
+    }
+
+    /** Returns a device with the product ID and serial number index.
+
+        A hundred devices go on each bus, which keeps every device address
+        unique, behind two hubs of fifty ports, which keeps every port number
+        within the 6 bits a tier of the device key holds. Device index is
+        plugged into port 1 + index % 50 of the hub on port 1 + index % 100 / 50.
+     */
+    static USBSimulatedBus::DeviceSpec makeDeviceSpec (int index)
+    {
+        USBSimulatedBus::DeviceSpec spec {};
+        spec.vendorId = vendorId;
+        spec.productId = index & 0xffff;
+        spec.busNumber = 1 + index / 100;
+        spec.portPath = {1 + index % 100 / 50, 1 + index % 50};
+        spec.manufacturerName = "jucey";
+        spec.productName = "Simulated device";
+        spec.serialNumber = juce::String (index);
+        return spec;
+    }
+
+    int addDevice (const USBSimulatedBus::DeviceSpec& spec) noexcept
+    {
+        return bus.addDevice (spec);
+    }
+
+    void removeDevice (int deviceId) noexcept
+    {
+        bus.removeDevice (deviceId);
+    }
+
+    int getNumOpenHandles() const noexcept
+    {
+        return bus.getNumOpenHandles();
+    }
+
+    int getNumActiveConfigurationReads() const noexcept
+    {
+        return bus.getNumActiveConfigurationReads();
+    }
+
+    /** Unplugs every device and waits for the manager to see them go. */
+    void removeAllDevices() noexcept
+    {
+        bus.removeAllDevices();
+        waitForNumDevices (0);
+    }
+
+    /** Waits for the manager to report a number of devices, returns false
+        if it doesn't within five seconds.
+     */
+    bool waitForNumDevices (int numDevices) const noexcept
+    {
+        return waitUntil ([&] { return getManager().getSnapshot()->size() == numDevices; });
+    }
+
+    /** Returns the device the manager reports with the given product ID, or
+        a default constructed USBDevice if there isn't one.
+     */
+    USBDevice findDevice (int productId) const noexcept
+    {
+        for (const auto& device : *getManager().getSnapshot())
+        {
+            if (device.getProductId() == productId)
+                return device;
+        }
+
+        return {};
+    }
+
+    /** Polls a condition until it's true, returns false if it isn't within
+        five seconds.
+     */
+    static bool waitUntil (const std::function<bool()>& condition) noexcept
+    {
+        for (auto attempt {0}; attempt < 5000; ++attempt)
+        {
+            if (condition())
+                return true;
+
+            juce::Thread::sleep (1);
+        }
+
+        return condition();
+    }
+
+private:
+    USBSimulatedBus& bus {USBSimulatedBus::getInstance()};
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (LibUsbSimulatedDevices)
+};
@@ -1,26 +1,97 @@
 
 #pragma once
 
+juce::String getLibUsbErrorString (int result) noexcept
+{
+    return juce::String (libusb_error_name (result))
+         + ": "
+         + libusb_strerror ((libusb_error)result);
+}
+
 void throwOnLibUsbError (int result)
 {
     if (result == libusb_error::LIBUSB_SUCCESS)
         return;
 
-    std::stringstream errorMessage;
-    errorMessage << libusb_error_name (result);
-    errorMessage << ": ";
-    errorMessage << libusb_strerror ((libusb_error)result);
-    throw std::runtime_error (errorMessage.str());
+    throw std::runtime_error (getLibUsbErrorString (result).toStdString());
+}
+
+juce::String getTransferStatusString (libusb_transfer_status status) noexcept
+{
+    switch (status)
+    {
+        case LIBUSB_TRANSFER_COMPLETED:
+            return "Transfer completed";
+
+        case LIBUSB_TRANSFER_ERROR:
+            return "Transfer failed";
+
+        case LIBUSB_TRANSFER_TIMED_OUT:
+            return "Transfer timed out";
+
+        case LIBUSB_TRANSFER_CANCELLED:
+            return "Transfer was cancelled";
+
+        case LIBUSB_TRANSFER_STALL:
+            return "Endpoint stalled";
+
+        case LIBUSB_TRANSFER_NO_DEVICE:
+            return "Device was disconnected";
+
+        case LIBUSB_TRANSFER_OVERFLOW:
+            return "Device sent more data than requested";
+
+        default:
+            jassertfalse;
+            return "Unknown";
+    }
 }
 
 libusb_device_descriptor getDeviceDescriptor (libusb_device* device) noexcept
 {
     libusb_device_descriptor descriptor {};
-    libusb_get_device_descriptor (device, &descriptor);
+    getLibUsbBackend().getDeviceDescriptor (device, &descriptor);
 
     return descriptor;
 }
 
+juce::uint64 getDeviceKey (libusb_device* device) noexcept
+{
+    // the bus number takes the top 8 bits, followed by the 7 bit device
+    // address, the port path fills the bottom 42 bits using 6 bits per port
+    // for up to 7 tiers of hubs (port numbers start at 1 so 0 marks the end)
+    constexpr auto maxPortPathLength {7};
+    uint8_t portPath[maxPortPathLength] {};
+    const auto portPathLength {getLibUsbBackend().getPortNumbers (device, portPath, maxPortPathLength)};
+
+    auto key {(juce::uint64) getLibUsbBackend().getBusNumber (device) << 56
+            | (juce::uint64) (getLibUsbBackend().getDeviceAddress (device) & 0x7f) << 48};
+
+    for (auto index {0}; index < portPathLength; ++index)
+        key |= (juce::uint64) (portPath[index] & 0x3f) << (6 * index);
+
+    return key;
+}
+
+int getBusNumberFromDeviceKey (juce::uint64 key) noexcept
+{
+    return (int) (key >> 56);
+}
+
+int getDeviceAddressFromDeviceKey (juce::uint64 key) noexcept
+{
+    return (int) ((key >> 48) & 0x7f);
+}
+
+int getPortNumberFromDeviceKey (juce::uint64 key, int tier) noexcept
+{
+    // only 7 tiers fit in the key, anything deeper than that reads as no port
+    if ( ! juce::isPositiveAndBelow (tier, 7))
+        return 0;
+
+    return (int) ((key >> (6 * tier)) & 0x3f);
+}
+
 int getMajorVersionFromBinaryCodedDecimal (int versionNumber) noexcept
 {
     // remove the bottom 8 bits (minor version) by shifting the major version to
@@ -43,34 +114,1009 @@ juce::String getVersionStringFromBinaryCodedDecimal (int binaryCodedDecimal) noe
     return versions.joinIntoString (".");
 }
 
+//==============================================================================
+class LibUsbEventThread   : public juce::Thread
+{
+public:
+    LibUsbEventThread (libusb_context* contextToHandle) noexcept
+        : juce::Thread ("jucey libusb events")
+        , context (contextToHandle)
+    {
+    }
+
+    ~LibUsbEventThread() noexcept override
+    {
+        stop();
+    }
+
+    /** Starts the thread, falling back to a high priority thread if a
+        real-time thread can't be started. A non-zero affinity mask pins the
+        thread to those cores.
+
+        If the thread has been asked to stop but hasn't got round to it yet,
+        it just carries on running.
+     */
+    void start (bool shouldBeRealtime, int realtimePriority, juce::uint32 affinityMask) noexcept
+    {
+        {
+            std::unique_lock<std::mutex> lock (stateMutex);
+            stopRequested = false;
+
+            if (isThreadRunning() && ! exiting)
+                return;
+        }
+
+        // the thread has already left its loop, so it only has to return
+        stopThread (-1);
+
+        {
+            std::unique_lock<std::mutex> lock (stateMutex);
+            exiting = false;
+        }
+
+        // takes effect when the thread starts, zero lets it run on any core
+        setAffinityMask (affinityMask);
+
+        if ( ! shouldBeRealtime
+            || ! startRealtimeThread (juce::Thread::RealtimeOptions{}.withPriority (realtimePriority)))
+        {
+            startThread (juce::Thread::Priority::highest);
+        }
+    }
+
+    /** Stops the thread, waking libusb if it's currently blocked waiting for
+        events.
+
+        This can be called from a callback on the thread itself, such as one
+        that deletes the last transfer using it, in which case the thread exits
+        once the callback returns.
+     */
+    void stop() noexcept
+    {
+        {
+            std::unique_lock<std::mutex> lock (stateMutex);
+            stopRequested = true;
+        }
+
+        getLibUsbBackend().interruptEventHandler (context);
+
+        if (juce::Thread::getCurrentThreadId() != getThreadId())
+            stopThread (1000);
+    }
+
+private:
+    void run() override
+    {
+        for (;;)
+        {
+            {
+                std::unique_lock<std::mutex> lock (stateMutex);
+
+                if (stopRequested || threadShouldExit())
+                {
+                    exiting = true;
+                    return;
+                }
+            }
+
+            // libusb_interrupt_event_handler() will wake us early on shutdown
+            timeval timeout {1, 0};
+            getLibUsbBackend().handleEventsTimeoutCompleted (context, &timeout, nullptr);
+        }
+    }
+
+    libusb_context* const context;
+
+    std::mutex stateMutex;
+    bool stopRequested {false};
+    bool exiting {false};
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (LibUsbEventThread)
+};
+
+//==============================================================================
+/** A libusb context along with the thread that handles its events. */
+class LibUsbContext
+{
+public:
+    LibUsbContext() noexcept
+    {
+        getLibUsbBackend().init (&context);
+    }
+
+    ~LibUsbContext() noexcept
+    {
+        // every user of the event thread should have stopped using it!
+        jassert (numEventHandlingUsers == 0);
+
+        // the thread can't be stopped from itself, see ContextManager::createShard()
+        jassert ( ! isEventThread());
+
+        eventThread.reset();
+
+        for (const auto& entry : devices)
+            getLibUsbBackend().unrefDevice (entry.second);
+
+        getLibUsbBackend().exit (context);
+    }
+
+    libusb_context* get() const noexcept
+    {
+        return context;
+    }
+
+    /** Returns true if called from this context's event thread. */
+    bool isEventThread() const noexcept
+    {
+        std::unique_lock<std::mutex> lock (eventThreadMutex);
+        return eventThread != nullptr && eventThread->getThreadId() == juce::Thread::getCurrentThreadId();
+    }
+
+    /** Returns the device with the given key as this context sees it, with a
+        reference the caller owns, or nullptr if it isn't connected.
+
+        Devices belong to the context that listed them, so each context keeps
+        a directory of its devices by key. The devices are only listed again
+        when one isn't in the directory, so opening a device again, such as
+        after it was closed for being idle, doesn't enumerate the bus.
+     */
+    libusb_device* findDevice (juce::uint64 key) noexcept
+    {
+        std::unique_lock<std::mutex> lock (devicesMutex);
+        auto iter {devices.find (key)};
+
+        if (iter == devices.end())
+        {
+            listDevices();
+            iter = devices.find (key);
+
+            if (iter == devices.end())
+                return nullptr;
+        }
+
+        return getLibUsbBackend().refDevice (iter->second);
+    }
+
+    /** Removes a device that's gone from the directory. */
+    void forgetDevice (juce::uint64 key) noexcept
+    {
+        std::unique_lock<std::mutex> lock (devicesMutex);
+        const auto iter {devices.find (key)};
+
+        if (iter == devices.end())
+            return;
+
+        getLibUsbBackend().unrefDevice (iter->second);
+        devices.erase (iter);
+    }
+
+    void addEventHandlingUser() noexcept
+    {
+        std::unique_lock<std::mutex> lock (eventThreadMutex);
+
+        if (numEventHandlingUsers++ == 0)
+            startEventThread();
+    }
+
+    void removeEventHandlingUser() noexcept
+    {
+        std::unique_lock<std::mutex> lock (eventThreadMutex);
+        jassert (numEventHandlingUsers > 0);
+
+        if (--numEventHandlingUsers == 0)
+            eventThread->stop();
+    }
+
+    /** Changes how the event thread runs, restarting it if it's running. */
+    void setEventThreadOptions (bool shouldBeRealtime, int realtimePriority, juce::uint32 affinityMask) noexcept
+    {
+        std::unique_lock<std::mutex> lock (eventThreadMutex);
+
+        eventThreadIsRealtime = shouldBeRealtime;
+        eventThreadRealtimePriority = juce::jlimit (0, 10, realtimePriority);
+        eventThreadAffinityMask = affinityMask;
+
+        if (numEventHandlingUsers > 0)
+        {
+            eventThread->stop();
+            startEventThread();
+        }
+    }
+
+private:
+    // called with the devices mutex locked
+    void listDevices() noexcept
+    {
+        libusb_device** deviceList {nullptr};
+        const auto numDevices {getLibUsbBackend().getDeviceList (context, &deviceList)};
+        std::unordered_map<juce::uint64, libusb_device*> listedDevices;
+
+        for (auto index {(ssize_t) 0}; index < numDevices; ++index)
+            listedDevices.emplace (getDeviceKey (deviceList[index]), getLibUsbBackend().refDevice (deviceList[index]));
+
+        getLibUsbBackend().freeDeviceList (deviceList, true);
+
+        for (const auto& entry : devices)
+            getLibUsbBackend().unrefDevice (entry.second);
+
+        devices = std::move (listedDevices);
+    }
+
+    void startEventThread() noexcept
+    {
+        if (eventThread == nullptr)
+            eventThread = std::make_unique<LibUsbEventThread> (context);
+
+        eventThread->start (eventThreadIsRealtime, eventThreadRealtimePriority, eventThreadAffinityMask);
+    }
+
+    libusb_context* context = nullptr;
+
+    std::unique_ptr<LibUsbEventThread> eventThread;
+    int numEventHandlingUsers {0};
+    bool eventThreadIsRealtime {false};
+    int eventThreadRealtimePriority {10};
+    juce::uint32 eventThreadAffinityMask {0};
+    mutable std::mutex eventThreadMutex;
+
+    std::unordered_map<juce::uint64, libusb_device*> devices;
+    std::mutex devicesMutex;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (LibUsbContext)
+};
+
 //==============================================================================
 class LibUsbUser
 {
 public:
+    /** Returns the shared context devices are found and watched in. */
     libusb_context* getContext() const noexcept
     {
-        return contextManager->context;
+        return contextManager->primary->get();
+    }
+
+    /** Starts handling events for the shared context on a dedicated thread,
+        the thread keeps running until every call has been matched by a call
+        to stopHandlingEvents().
+
+        Asynchronous transfers and hotplug callbacks only complete while
+        events are being handled.
+     */
+    void startHandlingEvents() const noexcept
+    {
+        contextManager->primary->addEventHandlingUser();
+    }
+
+    void stopHandlingEvents() const noexcept
+    {
+        contextManager->primary->removeEventHandlingUser();
+    }
+
+    /** Sets whether the event threads run with real-time priority, the
+        realtime priority should be between 0 and 10.
+     */
+    void setEventThreadRealtime (bool shouldBeRealtime, int realtimePriority) const noexcept
+    {
+        contextManager->setEventThreadRealtime (shouldBeRealtime, realtimePriority);
+    }
+
+    /** Changes how devices opened from now on are spread across contexts,
+        devices that are already open stay where they are.
+     */
+    void setEventThreadSharding (const USBDeviceManager::EventThreadSharding& newSharding) const noexcept
+    {
+        contextManager->setSharding (newSharding);
+    }
+
+    USBDeviceManager::EventThreadSharding getEventThreadSharding() const noexcept
+    {
+        return contextManager->getSharding();
+    }
+
+    /** Picks the context a device should be opened in and returns it, along
+        with the device as that context sees it. The caller owns a reference
+        to the returned device.
+
+        Transfers on a handle complete on the event thread of the context the
+        device was opened in, so every shard gets a thread of its own.
+     */
+    std::shared_ptr<LibUsbContext> getContextForDevice (libusb_device* device,
+                                                        libusb_device*& deviceInContext) const noexcept
+    {
+        const auto context {contextManager->pickShard (device)};
+
+        if (context != nullptr)
+        {
+            deviceInContext = context->findDevice (getDeviceKey (device));
+
+            if (deviceInContext != nullptr)
+                return context;
+        }
+
+        deviceInContext = getLibUsbBackend().refDevice (device);
+        return contextManager->primary;
+    }
+
+    std::shared_ptr<LibUsbContext> getSharedContext() const noexcept
+    {
+        return contextManager->primary;
+    }
+
+    /** Tells every shard a device has gone, so it isn't kept in their
+        directories.
+     */
+    void forgetDeviceInShards (juce::uint64 key) const noexcept
+    {
+        contextManager->forgetDevice (key);
     }
 
 private:
     struct ContextManager
     {
-        ContextManager() noexcept
+        void setEventThreadRealtime (bool shouldBeRealtime, int realtimePriority) noexcept
+        {
+            std::unique_lock<std::mutex> lock (shardsMutex);
+
+            eventThreadIsRealtime = shouldBeRealtime;
+            eventThreadRealtimePriority = realtimePriority;
+
+            primary->setEventThreadOptions (eventThreadIsRealtime, eventThreadRealtimePriority, 0);
+
+            for (auto index {0}; index < (int) shards.size(); ++index)
+                shards[(size_t) index]->setEventThreadOptions (eventThreadIsRealtime, eventThreadRealtimePriority, getAffinityMask (index));
+        }
+
+        void setSharding (const USBDeviceManager::EventThreadSharding& newSharding) noexcept
+        {
+            std::unique_lock<std::mutex> lock (shardsMutex);
+
+            sharding = newSharding;
+            nextShard = 0;
+
+            // open devices keep their shard alive until they're closed, see
+            // createShard() for how the last of them lets it go
+            shards.clear();
+
+            if (sharding.mode == USBDeviceManager::EventThreadSharding::Mode::none)
+                return;
+
+            const auto numShards {sharding.numThreads > 0 ? sharding.numThreads
+                                                          : juce::SystemStats::getNumCpus()};
+
+            for (auto index {0}; index < numShards; ++index)
+            {
+                shards.push_back (createShard());
+                shards.back()->setEventThreadOptions (eventThreadIsRealtime, eventThreadRealtimePriority, getAffinityMask (index));
+            }
+        }
+
+        void forgetDevice (juce::uint64 key) noexcept
+        {
+            std::unique_lock<std::mutex> lock (shardsMutex);
+
+            for (const auto& shard : shards)
+                shard->forgetDevice (key);
+        }
+
+        // the last reference to a shard that's been replaced is usually held
+        // by an open handle, which can be closed by a transfer completing on
+        // the shard's own event thread. That thread can't stop itself or exit
+        // the context it's handling events for, so then the shard is deleted
+        // from another thread
+        static std::shared_ptr<LibUsbContext> createShard()
+        {
+            return std::shared_ptr<LibUsbContext> (new LibUsbContext(), [] (LibUsbContext* shard)
+            {
+                if (shard->isEventThread())
+                    juce::Thread::launch ([shard] { delete shard; });
+                else
+                    delete shard;
+            });
+        }
+
+        USBDeviceManager::EventThreadSharding getSharding() const noexcept
         {
-            libusb_init (&context);
+            std::unique_lock<std::mutex> lock (shardsMutex);
+            return sharding;
+        }
+
+        std::shared_ptr<LibUsbContext> pickShard (libusb_device* device) noexcept
+        {
+            std::unique_lock<std::mutex> lock (shardsMutex);
+
+            if (shards.empty())
+                return nullptr;
+
+            const auto index {sharding.mode == USBDeviceManager::EventThreadSharding::Mode::byBus
+                                  ? (size_t) getLibUsbBackend().getBusNumber (device) % shards.size()
+                                  : nextShard++ % shards.size()};
+
+            return shards[index];
         }
 
-        ~ContextManager() noexcept
+        // called with the shards mutex locked
+        juce::uint32 getAffinityMask (int shardIndex) const noexcept
         {
-            libusb_exit (context);
+            if (sharding.cores.isEmpty())
+                return 0;
+
+            const auto core {sharding.cores[shardIndex % sharding.cores.size()]};
+            return juce::isPositiveAndBelow (core, 32) ? (juce::uint32) 1 << core : 0;
         }
 
-        libusb_context* context = nullptr;
+        const std::shared_ptr<LibUsbContext> primary {std::make_shared<LibUsbContext>()};
 
-        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (ContextManager)
+        std::vector<std::shared_ptr<LibUsbContext>> shards;
+        USBDeviceManager::EventThreadSharding sharding;
+        size_t nextShard {0};
+        bool eventThreadIsRealtime {false};
+        int eventThreadRealtimePriority {10};
+        mutable std::mutex shardsMutex;
     };
 
     juce::SharedResourcePointer<ContextManager> contextManager;
 
     JUCE_LEAK_DETECTOR (LibUsbUser)
 };
+
+//==============================================================================
+/** Keeps an event thread running for as long as it exists, by default the
+    one handling the shared context.
+ */
+class LibUsbEventHandler : private LibUsbUser
+{
+public:
+    LibUsbEventHandler() noexcept
+        : LibUsbEventHandler (nullptr)
+    {
+    }
+
+    explicit LibUsbEventHandler (const std::shared_ptr<LibUsbContext>& contextToHandle) noexcept
+        : context (contextToHandle != nullptr ? contextToHandle : getSharedContext())
+    {
+        context->addEventHandlingUser();
+    }
+
+    ~LibUsbEventHandler() noexcept
+    {
+        context->removeEventHandlingUser();
+    }
+
+private:
+    const std::shared_ptr<LibUsbContext> context;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (LibUsbEventHandler)
+};
+
+//==============================================================================
+/** A single producer, single consumer ring buffer of bytes. */
+class ByteFifo
+{
+public:
+    ByteFifo (int capacity)
+        : fifo (capacity + 1)
+        , buffer ((size_t) capacity + 1)
+    {
+    }
+
+    int write (const void* sourceData, int numBytes) noexcept
+    {
+        int start1, size1, start2, size2;
+        fifo.prepareToWrite (numBytes, start1, size1, start2, size2);
+
+        const auto source {static_cast<const juce::uint8*> (sourceData)};
+        memcpy (buffer + start1, source, (size_t) size1);
+        memcpy (buffer + start2, source + size1, (size_t) size2);
+
+        fifo.finishedWrite (size1 + size2);
+        return size1 + size2;
+    }
+
+    int read (void* destBuffer, int maxBytes) noexcept
+    {
+        int start1, size1, start2, size2;
+        fifo.prepareToRead (maxBytes, start1, size1, start2, size2);
+
+        const auto dest {static_cast<juce::uint8*> (destBuffer)};
+        memcpy (dest, buffer + start1, (size_t) size1);
+        memcpy (dest + size1, buffer + start2, (size_t) size2);
+
+        fifo.finishedRead (size1 + size2);
+        return size1 + size2;
+    }
+
+    int getNumReady() const noexcept
+    {
+        return fifo.getNumReady();
+    }
+
+    int getFreeSpace() const noexcept
+    {
+        return fifo.getFreeSpace();
+    }
+
+private:
+    juce::AbstractFifo fifo;
+    juce::HeapBlock<juce::uint8> buffer;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (ByteFifo)
+};
+
+//==============================================================================
+/** Hands out transfer buffers for a device handle, reusing them once they're
+    released.
+
+    Where the platform supports it (currently Linux usbfs) buffers are mapped
+    from device memory with libusb_dev_mem_alloc() so the kernel can transfer
+    straight into them instead of copying, otherwise page aligned host memory
+    is used. If mapping device memory fails only that buffer falls back to
+    host memory. Buffers are grouped into power of two sizes so once a stream has
+    allocated its buffers, recreating it doesn't allocate again.
+ */
+class LibUsbBufferPool
+{
+    struct Slab;
+
+public:
+    LibUsbBufferPool (libusb_device_handle* handleToAllocateFor) noexcept
+        : handle (handleToAllocateFor)
+    {
+    }
+
+    ~LibUsbBufferPool() noexcept
+    {
+        // every buffer should have been released before the pool is destroyed!
+        jassert (numSlabsInUse == 0);
+
+        for (auto* slab : slabs)
+        {
+            if (slab->isDeviceMemory)
+                getLibUsbBackend().devMemFree (handle, slab->data, (size_t) slab->size);
+        }
+    }
+
+    class Buffer
+    {
+    public:
+        Buffer() = default;
+
+        Buffer (Buffer&& other) noexcept
+            : pool (std::exchange (other.pool, nullptr))
+            , slab (std::exchange (other.slab, nullptr))
+        {
+        }
+
+        Buffer& operator= (Buffer&& other) noexcept
+        {
+            reset();
+            pool = std::exchange (other.pool, nullptr);
+            slab = std::exchange (other.slab, nullptr);
+            return *this;
+        }
+
+        ~Buffer() noexcept
+        {
+            reset();
+        }
+
+        /** Returns the buffer to the pool. */
+        void reset() noexcept
+        {
+            if (slab != nullptr)
+                pool->release (*slab);
+
+            pool = nullptr;
+            slab = nullptr;
+        }
+
+        unsigned char* getData() const noexcept
+        {
+            return slab != nullptr ? slab->data : nullptr;
+        }
+
+        /** Returns the size of the buffer, this may be larger than requested. */
+        int getSize() const noexcept
+        {
+            return slab != nullptr ? slab->size : 0;
+        }
+
+        bool isDeviceMemory() const noexcept
+        {
+            return slab != nullptr && slab->isDeviceMemory;
+        }
+
+    private:
+        friend class LibUsbBufferPool;
+
+        Buffer (LibUsbBufferPool& owner, Slab& slabToUse) noexcept
+            : pool (&owner)
+            , slab (&slabToUse)
+        {
+        }
+
+        LibUsbBufferPool* pool {nullptr};
+        Slab* slab {nullptr};
+
+        JUCE_DECLARE_NON_COPYABLE (Buffer)
+    };
+
+    /** Returns a buffer of at least minimumSize bytes, or an empty buffer if
+        the memory couldn't be allocated.
+     */
+    Buffer allocate (int minimumSize) noexcept
+    {
+        if (minimumSize <= 0)
+            return {};
+
+        const auto sizeClass {getSizeClass (minimumSize)};
+
+        {
+            const juce::SpinLock::ScopedLockType lock (freeSlabsLock);
+            auto& freeSlabsOfSize = freeSlabs[sizeClass];
+
+            if ( ! freeSlabsOfSize.isEmpty())
+            {
+                ++numSlabsInUse;
+                return {*this, *freeSlabsOfSize.removeAndReturn (freeSlabsOfSize.size() - 1)};
+            }
+        }
+
+        auto* slab = createSlab (1 << sizeClass);
+
+        if (slab == nullptr)
+            return {};
+
+        const juce::SpinLock::ScopedLockType lock (freeSlabsLock);
+        slabs.add (slab);
+
+        // make sure returning the slab never needs to allocate
+        freeSlabs[sizeClass].ensureStorageAllocated (numSlabsOfSize[sizeClass]++ + 1);
+
+        ++numSlabsInUse;
+        return {*this, *slab};
+    }
+
+private:
+    struct Slab
+    {
+        unsigned char* data {nullptr};
+        int size {0};
+        int sizeClass {0};
+        bool isDeviceMemory {false};
+        juce::HeapBlock<unsigned char> hostMemory;
+    };
+
+    static constexpr int minSizeClass {12};
+    static constexpr int maxSizeClass {30};
+    static constexpr int hostMemoryAlignment {1 << minSizeClass};
+
+    static int getSizeClass (int size) noexcept
+    {
+        // you can't allocate a buffer this large!
+        jassert (size <= (1 << maxSizeClass));
+
+        auto sizeClass {minSizeClass};
+
+        while ((1 << sizeClass) < size && sizeClass < maxSizeClass)
+            ++sizeClass;
+
+        return sizeClass;
+    }
+
+    Slab* createSlab (int size) noexcept
+    {
+        auto slab {std::make_unique<Slab>()};
+        slab->size = size;
+        slab->sizeClass = getSizeClass (size);
+
+        if (handle != nullptr && deviceMemorySupported)
+        {
+            slab->data = getLibUsbBackend().devMemAlloc (handle, (size_t) size);
+            slab->isDeviceMemory = slab->data != nullptr;
+
+            // a failed allocation may just mean the kernel was short of memory
+            // for a large slab, so only stop asking if the backend can't map
+            // device memory at all. libusb_dev_mem_alloc() doesn't say why it
+            // failed, but freeing nothing only reports it as unsupported when
+            // the backend has no device memory
+            if ( ! slab->isDeviceMemory
+                && getLibUsbBackend().devMemFree (handle, nullptr, 0) == LIBUSB_ERROR_NOT_SUPPORTED)
+            {
+                deviceMemorySupported = false;
+            }
+        }
+
+        if (slab->data == nullptr)
+        {
+            slab->hostMemory.malloc ((size_t) size + hostMemoryAlignment);
+
+            if (slab->hostMemory == nullptr)
+                return nullptr;
+
+            const auto address {reinterpret_cast<juce::pointer_sized_int> (slab->hostMemory.get())};
+            const auto alignedAddress {(address + hostMemoryAlignment - 1) & ~(juce::pointer_sized_int) (hostMemoryAlignment - 1)};
+            slab->data = reinterpret_cast<unsigned char*> (alignedAddress);
+        }
+
+        return slab.release();
+    }
+
+    void release (Slab& slab) noexcept
+    {
+        const juce::SpinLock::ScopedLockType lock (freeSlabsLock);
+        freeSlabs[slab.sizeClass].add (&slab);
+        --numSlabsInUse;
+    }
+
+    libusb_device_handle* const handle;
+    std::atomic<bool> deviceMemorySupported {true};
+
+    juce::OwnedArray<Slab> slabs;
+    juce::Array<Slab*> freeSlabs[maxSizeClass + 1];
+    int numSlabsOfSize[maxSizeClass + 1] {};
+    int numSlabsInUse {0};
+    juce::SpinLock freeSlabsLock;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (LibUsbBufferPool)
+};
+
+//==============================================================================
+/** The lock free counters behind USBTransferStatistics.
+
+    Every update is a relaxed atomic add, so completing a transfer never waits
+    on a thread reading the counters. Each counter is exact, but a snapshot
+    taken while transfers complete may catch one counter before another.
+    Updates are passed on to the parent too, which is how a device totals up
+    the transfers of all its streams.
+ */
+class LibUsbTransferCounters
+{
+public:
+    /** Counters with a parent count transfers for the parent's device, a
+        device's own counters are given its key.
+     */
+    explicit LibUsbTransferCounters (LibUsbTransferCounters* parentToUpdate = nullptr,
+                                     juce::uint64 keyOfDevice = 0) noexcept
+        : parent (parentToUpdate)
+        , deviceKey (parentToUpdate != nullptr ? parentToUpdate->deviceKey : keyOfDevice)
+    {
+    }
+
+    /** Returns the key of the device the transfers are made to. */
+    juce::uint64 getDeviceKey() const noexcept
+    {
+        return deviceKey;
+    }
+
+    void transferSubmitted() noexcept
+    {
+        for (auto* counters = this; counters != nullptr; counters = counters->parent)
+            counters->numTransfersInFlight.fetch_add (1, std::memory_order_relaxed);
+    }
+
+    void transferNotSubmitted() noexcept
+    {
+        for (auto* counters = this; counters != nullptr; counters = counters->parent)
+        {
+            counters->numTransfersInFlight.fetch_sub (1, std::memory_order_relaxed);
+            counters->numErrors.fetch_add (1, std::memory_order_relaxed);
+        }
+    }
+
+    void transferCompleted (const libusb_transfer& transfer, juce::int64 submitTicks) noexcept
+    {
+        const auto latencyBucket {getLatencyBucket (juce::Time::getHighResolutionTicks() - submitTicks)};
+        auto numBytes {(juce::int64) transfer.actual_length};
+
+        // libusb only fills in the length of each packet of an isochronous
+        // transfer
+        if (transfer.type == LIBUSB_TRANSFER_TYPE_ISOCHRONOUS)
+        {
+            numBytes = 0;
+
+            for (auto index {0}; index < transfer.num_iso_packets; ++index)
+                numBytes += transfer.iso_packet_desc[index].actual_length;
+        }
+
+        for (auto* counters = this; counters != nullptr; counters = counters->parent)
+            counters->add (transfer, numBytes, latencyBucket);
+    }
+
+    USBTransferStatistics getStatistics() const noexcept
+    {
+        USBTransferStatistics statistics {};
+        statistics.timeTicks = juce::Time::getHighResolutionTicks();
+        statistics.numBytes = numBytes.load (std::memory_order_relaxed);
+        statistics.numTransfersCompleted = numTransfersCompleted.load (std::memory_order_relaxed);
+        statistics.numTransfersInFlight = numTransfersInFlight.load (std::memory_order_relaxed);
+        statistics.numErrors = numErrors.load (std::memory_order_relaxed);
+        statistics.numStalls = numStalls.load (std::memory_order_relaxed);
+        statistics.numTimeouts = numTimeouts.load (std::memory_order_relaxed);
+        statistics.numCancellations = numCancellations.load (std::memory_order_relaxed);
+        statistics.numOverflows = numOverflows.load (std::memory_order_relaxed);
+        statistics.numPacketErrors = numPacketErrors.load (std::memory_order_relaxed);
+
+        for (auto bucket {0}; bucket < USBTransferStatistics::numLatencyBuckets; ++bucket)
+            statistics.latencyHistogram[(size_t) bucket] = latencyHistogram[bucket].load (std::memory_order_relaxed);
+
+        return statistics;
+    }
+
+private:
+    static int getLatencyBucket (juce::int64 ticks) noexcept
+    {
+        const auto microseconds {(juce::uint32) juce::jlimit (0.0,
+                                                              (double) std::numeric_limits<juce::uint32>::max(),
+                                                              juce::Time::highResolutionTicksToSeconds (ticks) * 1.0e6)};
+        auto bucket {0};
+
+        while (bucket < USBTransferStatistics::numLatencyBuckets - 1 && (microseconds >> bucket) != 0)
+            ++bucket;
+
+        return bucket;
+    }
+
+    void add (const libusb_transfer& transfer, juce::int64 numBytesMoved, int latencyBucket) noexcept
+    {
+        numTransfersInFlight.fetch_sub (1, std::memory_order_relaxed);
+        numBytes.fetch_add (numBytesMoved, std::memory_order_relaxed);
+
+        if (transfer.status == LIBUSB_TRANSFER_COMPLETED)
+        {
+            numTransfersCompleted.fetch_add (1, std::memory_order_relaxed);
+            latencyHistogram[latencyBucket].fetch_add (1, std::memory_order_relaxed);
+        }
+        else
+        {
+            addStatus (transfer.status);
+        }
+
+        for (auto index {0}; index < transfer.num_iso_packets; ++index)
+        {
+            const auto packetStatus {transfer.iso_packet_desc[index].status};
+
+            if (packetStatus != LIBUSB_TRANSFER_COMPLETED)
+            {
+                numPacketErrors.fetch_add (1, std::memory_order_relaxed);
+                addStatus (packetStatus);
+            }
+        }
+    }
+
+    void addStatus (libusb_transfer_status status) noexcept
+    {
+        switch (status)
+        {
+            case LIBUSB_TRANSFER_COMPLETED:                                                             break;
+            case LIBUSB_TRANSFER_STALL:         numStalls.fetch_add (1, std::memory_order_relaxed);         break;
+            case LIBUSB_TRANSFER_TIMED_OUT:     numTimeouts.fetch_add (1, std::memory_order_relaxed);       break;
+            case LIBUSB_TRANSFER_CANCELLED:     numCancellations.fetch_add (1, std::memory_order_relaxed);  break;
+            case LIBUSB_TRANSFER_OVERFLOW:      numOverflows.fetch_add (1, std::memory_order_relaxed);      break;
+            case LIBUSB_TRANSFER_ERROR:
+            case LIBUSB_TRANSFER_NO_DEVICE:
+            default:                            numErrors.fetch_add (1, std::memory_order_relaxed);         break;
+        }
+    }
+
+    LibUsbTransferCounters* const parent;
+    const juce::uint64 deviceKey;
+
+    std::atomic<juce::int64> numBytes {0};
+    std::atomic<juce::int64> numTransfersCompleted {0};
+    std::atomic<juce::int64> numTransfersInFlight {0};
+    std::atomic<juce::int64> numErrors {0};
+    std::atomic<juce::int64> numStalls {0};
+    std::atomic<juce::int64> numTimeouts {0};
+    std::atomic<juce::int64> numCancellations {0};
+    std::atomic<juce::int64> numOverflows {0};
+    std::atomic<juce::int64> numPacketErrors {0};
+    std::atomic<juce::int64> latencyHistogram[USBTransferStatistics::numLatencyBuckets] {};
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (LibUsbTransferCounters)
+};
+
+//==============================================================================
+double USBTransferStatistics::getBytesPerSecondSince (const USBTransferStatistics& earlier) const noexcept
+{
+    const auto seconds {juce::Time::highResolutionTicksToSeconds (timeTicks - earlier.timeTicks)};
+    return seconds > 0.0 ? (double) (numBytes - earlier.numBytes) / seconds : 0.0;
+}
+
+double USBTransferStatistics::getTransfersPerSecondSince (const USBTransferStatistics& earlier) const noexcept
+{
+    const auto seconds {juce::Time::highResolutionTicksToSeconds (timeTicks - earlier.timeTicks)};
+    return seconds > 0.0 ? (double) (numTransfersCompleted - earlier.numTransfersCompleted) / seconds : 0.0;
+}
+
+double USBTransferStatistics::getLatencyPercentileMicroseconds (double fraction) const noexcept
+{
+    const auto total {std::accumulate (latencyHistogram.begin(), latencyHistogram.end(), (juce::int64) 0)};
+
+    if (total == 0)
+        return 0.0;
+
+    const auto target {(juce::int64) std::ceil (juce::jlimit (0.0, 1.0, fraction) * (double) total)};
+    juce::int64 count {0};
+
+    for (auto bucket {0}; bucket < numLatencyBuckets; ++bucket)
+    {
+        count += latencyHistogram[(size_t) bucket];
+
+        if (count >= target)
+            return std::ldexp (1.0, bucket);
+    }
+
+    return std::ldexp (1.0, numLatencyBuckets - 1);
+}
+
+//==============================================================================
+/** Records a completed transfer if a USBTrafficCapture is running, this is
+    defined along with the capture.
+ */
+void captureTransfer (const libusb_transfer& transfer, juce::uint64 deviceKey, juce::int64 submitTicks) noexcept;
+
+//==============================================================================
+struct LibUsbTransfer
+{
+    LibUsbTransfer (LibUsbBufferPool& bufferPool, int bufferSize, int numIsoPackets = 0)
+        : transfer (getLibUsbBackend().allocTransfer (numIsoPackets))
+        , buffer (bufferPool.allocate (bufferSize))
+    {
+        if (transfer == nullptr)
+            throwOnLibUsbError (LIBUSB_ERROR_NO_MEM);
+
+        if (buffer.getSize() < bufferSize)
+        {
+            getLibUsbBackend().freeTransfer (transfer);
+            throwOnLibUsbError (LIBUSB_ERROR_NO_MEM);
+        }
+    }
+
+    ~LibUsbTransfer() noexcept
+    {
+        getLibUsbBackend().freeTransfer (transfer);
+    }
+
+    /** Returns the LibUsbTransfer a transfer belongs to, the transfer's user
+        data must have been set to it when the transfer was filled in.
+     */
+    static LibUsbTransfer& fromLibUsb (libusb_transfer& libUsbTransfer) noexcept
+    {
+        return *static_cast<LibUsbTransfer*> (libUsbTransfer.user_data);
+    }
+
+    /** Submits the transfer, noting the time so the counters can measure how
+        long it takes to complete.
+     */
+    int submit (LibUsbTransferCounters& counters) noexcept
+    {
+        // counted first, as the transfer may complete before submit returns
+        counters.transferSubmitted();
+        submitTicks = juce::Time::getHighResolutionTicks();
+
+        const auto result {getLibUsbBackend().submitTransfer (transfer)};
+
+        if (result != LIBUSB_SUCCESS)
+            counters.transferNotSubmitted();
+
+        return result;
+    }
+
+    /** Counts the outcome of a transfer, and captures it if a capture is
+        running. Call this from its callback.
+     */
+    void completed (LibUsbTransferCounters& counters) const noexcept
+    {
+        counters.transferCompleted (*transfer, submitTicks);
+        captureTransfer (*transfer, counters.getDeviceKey(), submitTicks);
+    }
+
+    libusb_transfer* const transfer;
+    LibUsbBufferPool::Buffer buffer;
+
+    /** Whatever is handling the transfer's callback. */
+    void* owner {nullptr};
+    juce::int64 submitTicks {0};
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (LibUsbTransfer)
+};